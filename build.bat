@@ -3,5 +3,30 @@ del *.o
 del *.prg
 del *.lst
 cc6502 -O2 --speed --always-inline --target=mega65 --list-file m65.txt ./src/m65.c -o m65.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file dmagic.txt ./src/dmagic.c -o dmagic.o
 cc6502 -O2 --speed --always-inline --target=mega65 --list-file emu.txt ./src/emu.c -o emu.o
-ln6502 --target=mega65 --core=45gs02 --cstack-size=0x800 --heap-size=4000  --output-format=prg mega65-6502emu.scm m65.o emu.o --list-file emu.lst -o emu.prg
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file video.txt ./src/video.c -o video.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file mapfile.txt ./src/mapfile.c -o mapfile.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file autostart.txt ./src/autostart.c -o autostart.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file trap.txt ./src/trap.c -o trap.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file drive.txt ./src/drive.c -o drive.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file d81.txt ./src/d81.c -o d81.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file hostdir.txt ./src/hostdir.c -o hostdir.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file romset.txt ./src/romset.c -o romset.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file snapshot.txt ./src/snapshot.c -o snapshot.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file rewind.txt ./src/rewind.c -o rewind.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file input.txt ./src/input.c -o input.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file record.txt ./src/record.c -o record.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file diff.txt ./src/diff.c -o diff.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file symbols.txt ./src/symbols.c -o symbols.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file profile.txt ./src/profile.c -o profile.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file heatmap.txt ./src/heatmap.c -o heatmap.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file disasm.txt ./src/disasm.c -o disasm.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file trace.txt ./src/trace.c -o trace.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file watch.txt ./src/watch.c -o watch.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file sid.txt ./src/sid.c -o sid.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file cart.txt ./src/cart.c -o cart.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file reu.txt ./src/reu.c -o reu.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file runahead.txt ./src/runahead.c -o runahead.o
+cc6502 -O2 --speed --always-inline --target=mega65 --list-file basload.txt ./src/basload.c -o basload.o
+ln6502 --target=mega65 --core=45gs02 --cstack-size=0x800 --heap-size=4000  --output-format=prg mega65-6502emu.scm m65.o dmagic.o emu.o video.o mapfile.o autostart.o trap.o drive.o d81.o hostdir.o romset.o snapshot.o rewind.o input.o record.o diff.o symbols.o profile.o heatmap.o disasm.o trace.o watch.o sid.o cart.o reu.o runahead.o basload.o --list-file emu.lst -o emu.prg
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Linux host build, same modules as build.bat with platform_linux.c
+# standing in for the MEGA65 backend in m65.c
+set -e
+rm -f *.o emu bench runner conform tracedump
+for f in platform_linux dmagic emu video mapfile autostart trap drive d81 hostdir romset snapshot rewind input record diff symbols profile heatmap disasm trace watch sid cart reu runahead basload; do
+    ${CC:-cc} -std=gnu11 -O2 -Wall ${CFLAGS} -c ./src/$f.c -o $f.o
+done
+${CC:-cc} -o emu platform_linux.o dmagic.o emu.o video.o mapfile.o autostart.o trap.o drive.o d81.o hostdir.o romset.o snapshot.o rewind.o input.o record.o diff.o symbols.o profile.o heatmap.o disasm.o trace.o watch.o sid.o cart.o reu.o runahead.o basload.o -lpthread -lm
+
+# headless benchmark, emu.c is compiled into it without its main()
+${CC:-cc} -std=gnu11 -O2 -Wall ${CFLAGS} -o bench ./src/bench.c platform_linux.o dmagic.o video.o mapfile.o autostart.o trap.o drive.o d81.o hostdir.o romset.o snapshot.o rewind.o input.o record.o diff.o symbols.o profile.o heatmap.o disasm.o trace.o watch.o sid.o cart.o reu.o runahead.o basload.o -lpthread -lm
+
+# many machines in one process: machine.o carries emu.c the same way
+${CC:-cc} -std=gnu11 -O2 -Wall ${CFLAGS} -c ./src/machine.c -o machine.o
+${CC:-cc} -std=gnu11 -O2 -Wall ${CFLAGS} -o runner ./src/runner.c machine.o platform_linux.o dmagic.o video.o mapfile.o autostart.o trap.o drive.o d81.o hostdir.o romset.o snapshot.o rewind.o input.o record.o diff.o symbols.o profile.o heatmap.o disasm.o trace.o watch.o sid.o cart.o reu.o runahead.o basload.o -lpthread -lm
+
+# CPU conformance suite, cpu.c on flat RAM, and the DMAgic model
+${CC:-cc} -std=gnu11 -O2 -Wall ${CFLAGS} -o conform ./src/conform.c mapfile.o dmagic.o
+
+# trace ring decoder, for -trace dumps
+${CC:-cc} -std=gnu11 -O2 -Wall ${CFLAGS} -o tracedump ./src/tracedump.c disasm.o
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "mapfile.h"
+#include "autostart.h"
+#include "record.h"
+#include "basload.h"
+
+// Autostart of .prg / .t64 files without going through the KERNAL: the file
+// is mapped read-only, and once the machine sits at READY. the payload is
+// copied to its load address in one go, the BASIC pointers are fixed up and
+// either RUN / SYS is typed into the keyboard buffer or the CPU jumps.
+// A .bas text listing is tokenised straight into RAM at $0801 instead.
+
+#define KEYBUF          0x0277  // 631, KERNAL keyboard buffer
+#define KEYBUF_LEN      0x00C6  // 198, number of keys in the buffer
+#define KEYBUF_MAX      10
+
+static struct mapped_file image;
+static const uint8_t *payload;
+static uint16_t load_addr;
+static uint16_t load_len;
+static uint32_t jump_addr = AUTOSTART_NO_JUMP;
+static uint8_t  pending   = 0;
+static uint8_t  listing   = 0;          // payload is BASIC text, see basload.c
+
+static uint16_t le16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int open_prg(void)
+{
+    if (image.size < 3)
+        return -1;
+    load_addr = le16(image.data);
+    payload   = image.data + 2;
+    load_len  = (uint16_t)(image.size - 2 > 0xFFFF ? 0xFFFF : image.size - 2);
+    return 0;
+}
+
+// First normal file in a T64 container; the end address in the directory
+// is often wrong, so the length is clamped to what is in the file.
+static int open_t64(void)
+{
+    uint16_t entries, i;
+
+    if (image.size < 0x40 || memcmp(image.data, "C64", 3) != 0)
+        return -1;
+
+    entries = le16(image.data + 0x22);
+    for (i = 0; i < entries && 0x40 + (size_t)(i + 1) * 32 <= image.size; i++) {
+        const uint8_t *e = image.data + 0x40 + i * 32;
+        uint32_t offset = e[8] | (e[9] << 8) | ((uint32_t)e[10] << 16) | ((uint32_t)e[11] << 24);
+        uint16_t start = le16(e + 2), end = le16(e + 4);
+        size_t avail;
+
+        if (e[0] != 1 || offset >= image.size)
+            continue;
+        avail = image.size - offset;
+        load_addr = start;
+        payload   = image.data + offset;
+        load_len  = (uint16_t)(end - start);
+        if (load_len == 0 || load_len > avail)
+            load_len = (uint16_t)(avail > 0xFFFF ? 0xFFFF : avail);
+        return 0;
+    }
+    return -1;
+}
+
+// Tokenised once here for the errors and the length, again at READY
+static int open_bas(void)
+{
+    int end = basload(image.data, image.size, 0x0801, 0);
+
+    if (end < 0)
+        return -1;
+    load_addr = 0x0801;
+    payload   = image.data;
+    load_len  = (uint16_t)(end - 0x0801);
+    return 0;
+}
+
+int autostart_open(const char *path, uint32_t jump)
+{
+    const char *ext = strrchr(path, '.');
+    int rc;
+
+    if (map_file(path, &image, 0) != 0) {
+        platform_msg("autostart: cannot open %s\n", path);
+        return -1;
+    }
+
+    listing = ext && (!strcmp(ext, ".bas") || !strcmp(ext, ".BAS"));
+    if (listing)
+        rc = open_bas();
+    else if (ext && (!strcmp(ext, ".t64") || !strcmp(ext, ".T64")))
+        rc = open_t64();
+    else
+        rc = open_prg();
+    if (rc != 0) {
+        platform_msg("autostart: %s is not a usable program file\n", path);
+        unmap_file(&image);
+        return -1;
+    }
+
+    if ((uint32_t)load_addr + load_len > 0x10000)
+        load_len = (uint16_t)(0x10000 - load_addr);
+
+    jump_addr = jump;
+    pending   = 1;
+    return 0;
+}
+
+// Set the pointers BASIC's LOAD would have left behind
+void autostart_set_basic_end(uint16_t end)
+{
+    uint8_t lo = end & 0xFF, hi = end >> 8;
+
+    ram[0x2D] = lo; ram[0x2E] = hi;     // VARTAB
+    ram[0x2F] = lo; ram[0x30] = hi;     // ARYTAB
+    ram[0x31] = lo; ram[0x32] = hi;     // STREND
+    ram[0xAE] = lo; ram[0xAF] = hi;     // KERNAL end-of-load address
+    emu_mark_dirty(0x0000, 0x0100);
+}
+
+// Fill the KERNAL keyboard buffer as if the keys had been typed
+void autostart_keys(const uint8_t *keys, uint8_t n)
+{
+    emu_ram_write(KEYBUF, keys, n);
+    ram[KEYBUF_LEN] = n;
+    emu_mark_dirty(KEYBUF_LEN, 1);
+}
+
+// Queue text into the KERNAL keyboard buffer, returns 0 if it didn't fit.
+// A replay already typed it from the recording.
+int autostart_type(const char *text)
+{
+    size_t n = strlen(text);
+    uint8_t ev[1 + KEYBUF_MAX];
+
+    if (n > KEYBUF_MAX)
+        return 0;
+    if (record_mode == REPLAYING)
+        return 1;
+    autostart_keys((const uint8_t *)text, (uint8_t)n);
+    ev[0] = (uint8_t)n;
+    memcpy(ev + 1, text, n);
+    record_input(REC_TEXT, ev, (uint8_t)(n + 1));
+    return 1;
+}
+
+// Called once per frame; fires the first time the KERNAL waits for a key
+void autostart_frame(void)
+{
+    char cmd[16];
+
+    if (!pending || !emu_at_ready())
+        return;
+    pending = 0;
+
+    if (listing)
+        basload(payload, image.size, load_addr, 1);
+    else
+        emu_ram_write(load_addr, payload, load_len);
+
+    if (jump_addr != AUTOSTART_NO_JUMP) {
+        // may be inside the jiffy IRQ: drop its stack frame and I flag
+        pc = (uint16_t)jump_addr;
+        sp = 0xFF;
+        status &= ~0x04;       // I
+        irq_triggered = 0;
+    } else if (load_addr == 0x0801) {
+        autostart_set_basic_end((uint16_t)(load_addr + load_len));
+        autostart_type("RUN\r");
+    } else {
+        sprintf(cmd, "SYS%u\r", load_addr);
+        autostart_type(cmd);
+    }
+    unmap_file(&image);
+
+    platform_msg("autostart: $%04X-$%04X running after %lu ms (%lu ms emulated)\n",
+                 load_addr, (unsigned)(load_addr + load_len),
+                 emu_host_ms(), (unsigned long)(clockticks6502 / (CPU_HZ / 1000u)));
+}
@@ -0,0 +1,14 @@
+#ifndef __AUTOSTART_H
+#define __AUTOSTART_H
+
+#include <stdint.h>
+
+#define AUTOSTART_NO_JUMP       0xFFFFFFFFu
+
+int  autostart_open(const char *path, uint32_t jump);
+void autostart_frame(void);
+void autostart_set_basic_end(uint16_t end);
+void autostart_keys(const uint8_t *keys, uint8_t n);
+int  autostart_type(const char *text);
+
+#endif
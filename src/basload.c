@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "emu.h"
+#include "basload.h"
+
+// One text line at a time: PETSCII first (case and escapes), then the
+// crunch.  Keywords are tried in token order and the first match wins,
+// so INPUT# beats INPUT and GOTO beats GO exactly as on the machine; a
+// shifted letter ends a keyword early, the C64's abbreviations.  Nothing
+// is tokenised in quotes, after REM, or in DATA up to the next colon.
+//
+// basload() runs twice over a listing: once when it is opened, to find
+// errors and the end address, and again at READY with store set, when
+// each line goes into guest RAM as soon as it is crunched.
+
+#define TOKEN_FIRST     0x80
+#define TOKEN_DATA      0x83
+#define TOKEN_REM       0x8F
+#define TOKEN_PRINT     0x99
+
+static const char *const keywords[] = {
+    "END", "FOR", "NEXT", "DATA", "INPUT#", "INPUT", "DIM", "READ", "LET", "GOTO",
+    "RUN", "IF", "RESTORE", "GOSUB", "RETURN", "REM", "STOP", "ON", "WAIT", "LOAD",
+    "SAVE", "VERIFY", "DEF", "POKE", "PRINT#", "PRINT", "CONT", "LIST", "CLR", "CMD",
+    "SYS", "OPEN", "CLOSE", "GET", "NEW", "TAB(", "TO", "FN", "SPC(", "THEN",
+    "NOT", "STEP", "+", "-", "*", "/", "^", "AND", "OR", ">",
+    "=", "<", "SGN", "INT", "ABS", "USR", "FRE", "POS", "SQR", "RND",
+    "LOG", "EXP", "COS", "SIN", "TAN", "ATN", "PEEK", "LEN", "STR$", "VAL",
+    "ASC", "CHR$", "LEFT$", "RIGHT$", "MID$", "GO", NULL
+};
+
+struct escape {
+    const char *name;
+    uint8_t code;
+};
+
+static const struct escape escapes[] = {
+    { "clr", 0x93 }, { "clear", 0x93 }, { "home", 0x13 },
+    { "down", 0x11 }, { "up", 0x91 }, { "left", 0x9D }, { "rght", 0x1D }, { "right", 0x1D },
+    { "rvon", 0x12 }, { "rvs on", 0x12 }, { "rvof", 0x92 }, { "rvs off", 0x92 },
+    { "del", 0x14 }, { "inst", 0x94 }, { "return", 0x0D }, { "space", 0x20 },
+    { "blk", 0x90 }, { "wht", 0x05 }, { "red", 0x1C }, { "cyn", 0x9F },
+    { "pur", 0x9C }, { "grn", 0x1E }, { "blu", 0x1F }, { "yel", 0x9E },
+    { "orng", 0x81 }, { "brn", 0x95 }, { "lred", 0x96 }, { "gry1", 0x97 },
+    { "gry2", 0x98 }, { "lgrn", 0x99 }, { "lblu", 0x9A }, { "gry3", 0x9B },
+    { "f1", 0x85 }, { "f3", 0x86 }, { "f5", 0x87 }, { "f7", 0x88 },
+    { "f2", 0x89 }, { "f4", 0x8A }, { "f6", 0x8B }, { "f8", 0x8C },
+    { "pi", 0xFF }, { NULL, 0 }
+};
+
+static unsigned line_no;                // in the text file, for messages
+
+// Text between the braces of an escape, count included; -1 if unknown
+static int escape(const char *s, size_t n, uint8_t *out, unsigned *count)
+{
+    char name[16];
+    const struct escape *e;
+    char *end;
+    unsigned long v;
+
+    *count = 1;
+    if (n && isdigit((unsigned char)s[0])) {
+        v = strtoul(s, &end, 10);
+        if ((size_t)(end - s) == n) {
+            if (v > 0xFF)
+                return -1;
+            *out = (uint8_t)v;          // {147}
+            return 0;
+        }
+        if (*end != ' ' || !v || v > BASLOAD_LINE_MAX)
+            return -1;
+        *count = (unsigned)v;           // {3 down}
+        n -= (size_t)(end + 1 - s);
+        s  = end + 1;
+    }
+    if (!n || n >= sizeof(name))
+        return -1;
+    if (s[0] == '$') {
+        v = strtoul(s + 1, &end, 16);
+        if ((size_t)(end - s) != n || n < 2 || v > 0xFF)
+            return -1;
+        *out = (uint8_t)v;
+        return 0;
+    }
+    for (v = 0; v < n; v++)
+        name[v] = (char)tolower((unsigned char)s[v]);
+    name[n] = 0;
+    for (e = escapes; e->name; e++) {
+        if (!strcmp(e->name, name)) {
+            *out = e->code;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// One text line to PETSCII, -1 on a bad escape or character
+static int petscii(const char *s, size_t n, int petcat_case, uint8_t *out, size_t *len)
+{
+    size_t i, o = 0;
+
+    for (i = 0; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        uint8_t code;
+        unsigned count;
+
+        if (c == '{') {
+            const char *close = memchr(s + i, '}', n - i);
+
+            if (!close || escape(s + i + 1, (size_t)(close - s) - i - 1, &code, &count) != 0) {
+                platform_msg("basload: line %u: bad escape\n", line_no);
+                return -1;
+            }
+            i = (size_t)(close - s);
+        } else if (c >= 'a' && c <= 'z') {
+            code = (uint8_t)(c - 'a' + 0x41);
+            count = 1;
+        } else if (c >= 'A' && c <= 'Z') {
+            code = (uint8_t)(petcat_case ? c - 'A' + 0xC1 : c);
+            count = 1;
+        } else if (c == '\\') {
+            code = 0x5C;                // pound
+            count = 1;
+        } else if (c == '\t') {
+            code = ' ';
+            count = 1;
+        } else if (c >= 0x20 && c <= 0x5F) {
+            code = c;
+            count = 1;
+        } else {
+            platform_msg("basload: line %u: character $%02X has no PETSCII\n", line_no, c);
+            return -1;
+        }
+        if (o + count > BASLOAD_LINE_MAX) {
+            platform_msg("basload: line %u is too long\n", line_no);
+            return -1;
+        }
+        while (count--)
+            out[o++] = code;
+    }
+    *len = o;
+    return 0;
+}
+
+// Length of the keyword at in[], 0 if none; the token in *token
+static size_t keyword(const uint8_t *in, size_t n, uint8_t *token)
+{
+    unsigned t;
+
+    for (t = 0; keywords[t]; t++) {
+        const char *k = keywords[t];
+        size_t j = 0;
+
+        while (k[j] && j < n && in[j] == (uint8_t)k[j])
+            j++;
+        if (!k[j]) {
+            *token = (uint8_t)(TOKEN_FIRST + t);
+            return j;
+        }
+        if (j && j < n && in[j] == ((uint8_t)k[j] | 0x80)) {
+            *token = (uint8_t)(TOKEN_FIRST + t);
+            return j + 1;               // shifted letter: abbreviation
+        }
+    }
+    return 0;
+}
+
+// The text after the line number to tokens
+static size_t crunch(const uint8_t *in, size_t n, uint8_t *out)
+{
+    size_t i = 0, o = 0;
+    int quote = 0, data = 0;
+
+    while (i < n && in[i] == ' ')
+        i++;
+    while (i < n) {
+        uint8_t c = in[i], token;
+        size_t k;
+
+        if (c == '"')
+            quote = !quote;
+        if (data && !quote && c == ':')
+            data = 0;
+        if (quote || data || c == '"' || (c >= '0' && c <= ';') || c == ' ') {
+            out[o++] = c;
+            i++;
+            continue;
+        }
+        if (c == '?') {
+            out[o++] = TOKEN_PRINT;
+            i++;
+            continue;
+        }
+        k = keyword(in + i, n - i, &token);
+        if (!k) {
+            out[o++] = c;
+            i++;
+            continue;
+        }
+        out[o++] = token;
+        i += k;
+        if (token == TOKEN_REM) {
+            while (i < n)
+                out[o++] = in[i++];
+        }
+        data = token == TOKEN_DATA;
+    }
+    return o;
+}
+
+// Returns the end of the program (where its variables start), or -1
+int basload(const uint8_t *text, size_t size, uint16_t start, int store)
+{
+    const char *s = (const char *)text, *end = s + size;
+    uint8_t pet[BASLOAD_LINE_MAX], line[4 + BASLOAD_LINE_MAX + 1];
+    uint32_t addr = start;
+    long last = -1;
+    int petcat_case = 0, brace = 0;
+    size_t i;
+
+    // lower case outside the escapes
+    for (i = 0; i < size && !petcat_case; i++) {
+        if (text[i] == '{' || text[i] == '}')
+            brace = text[i] == '{';
+        else if (!brace && text[i] >= 'a' && text[i] <= 'z')
+            petcat_case = 1;
+    }
+
+    line_no = 0;
+    while (s < end) {
+        const char *nl = memchr(s, '\n', (size_t)(end - s));
+        const char *eol = nl ? nl : end;
+        size_t n, len;
+        long number;
+        char *after;
+
+        line_no++;
+        while (eol > s && (eol[-1] == '\r' || eol[-1] == ' '))
+            eol--;
+        while (s < eol && (*s == ' ' || *s == '\t'))
+            s++;
+        if (s == eol) {
+            s = nl ? nl + 1 : end;
+            continue;
+        }
+
+        if (!isdigit((unsigned char)*s)) {
+            platform_msg("basload: line %u has no line number\n", line_no);
+            return -1;
+        }
+        number = strtol(s, &after, 10);
+        if (number > 63999 || number <= last) {
+            platform_msg("basload: line %u: line number %ld out of order or too big\n", line_no, number);
+            return -1;
+        }
+        last = number;
+
+        if (petscii(after, (size_t)(eol - after), petcat_case, pet, &n) != 0)
+            return -1;
+        len = crunch(pet, n, line + 4);
+        if (addr + 4 + len + 1 + 2 > BASLOAD_END) {
+            platform_msg("basload: line %u: program does not fit below $%04X\n", line_no, BASLOAD_END);
+            return -1;
+        }
+
+        // link to where the next line will go
+        line[0] = (uint8_t)(addr + 4 + len + 1);
+        line[1] = (uint8_t)((addr + 4 + len + 1) >> 8);
+        line[2] = (uint8_t)number;
+        line[3] = (uint8_t)(number >> 8);
+        line[4 + len] = 0;
+        if (store)
+            emu_ram_write((uint16_t)addr, line, 4 + len + 1);
+        addr += 4 + len + 1;
+        s = nl ? nl + 1 : end;
+    }
+
+    // end of program: a null link
+    line[0] = line[1] = 0;
+    if (store)
+        emu_ram_write((uint16_t)addr, line, 2);
+    return (int)(addr + 2);
+}
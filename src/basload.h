@@ -0,0 +1,21 @@
+#ifndef __BASLOAD_H
+#define __BASLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// BASIC V2 listings as plain text, tokenised and linked on the host the
+// way the ROM's cruncher would have done it line by line.  Strings may
+// hold PETSCII escapes in braces: {clr}, {down}, {rvon}, {red}, {f1},
+// {pi}, a code as {$93} or {147}, and a count in front, {3 down}.
+//
+// Letter case follows petcat: a listing with lower case in it has its
+// lower case unshifted and upper case shifted; an all upper case listing
+// is taken as typed in the default character set.
+
+#define BASLOAD_LINE_MAX        255     // tokenised bytes per line
+#define BASLOAD_END             0xA000  // BASIC RAM ends below the ROM
+
+int basload(const uint8_t *text, size_t size, uint16_t start, int store);
+
+#endif
@@ -0,0 +1,265 @@
+// Headless benchmark: boots the machine (or restores a snapshot) and times
+// a fixed set of workloads, then the DMAgic path on its own.  Built on the
+// Linux host only, see build.sh.
+//
+//   bench [-romdir dir] [-snapshot file] [-frames n] [-json file] [workload ...]
+
+#define EMU_NO_MAIN
+#include "emu.c"
+#include "dmagic.h"
+
+#define BENCH_FRAMES            500     // 10 s of emulated time per workload
+#define FRAME_CYCLES            (CYCLES_PER_LINE * VIC_RASTER_LINES)
+#define DMA_ROUNDS              2000
+
+struct workload {
+    const char *name;
+    const uint8_t *code;
+    uint16_t size;
+    uint16_t addr;              // $0801 = BASIC program, started with RUN
+};
+
+struct result {
+    const char *name;
+    uint32_t frames;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t host_ns;
+};
+
+// 10 FORI=1TO500:A=SQR(I)*SIN(I)/LOG(I+1):NEXT
+// 20 GOTO10
+static const uint8_t basic_crunch[] = {
+    0x23, 0x08, 0x0A, 0x00, 0x81, 0x49, 0xB2, 0x31, 0xA4, 0x35, 0x30, 0x30,
+    0x3A, 0x41, 0xB2, 0xBA, 0x28, 0x49, 0x29, 0xAC, 0xBF, 0x28, 0x49, 0x29,
+    0xAD, 0xBC, 0x28, 0x49, 0xAA, 0x31, 0x29, 0x3A, 0x82, 0x00, 0x2B, 0x08,
+    0x14, 0x00, 0x89, 0x31, 0x30, 0x00, 0x00, 0x00
+};
+
+// C000  LDX #$00
+// C002  LDA $C100,X
+// C005  STA $C200,X
+// C008  INX
+// C009  BNE $C002
+// C00B  JMP $C000
+static const uint8_t mc_loop[] = {
+    0xA2, 0x00, 0xBD, 0x00, 0xC1, 0x9D, 0x00, 0xC2, 0xE8, 0xD0, 0xF7,
+    0x4C, 0x00, 0xC0
+};
+
+// C000  LDA #$80
+// C002  CMP $D012      wait for raster line $80
+// C005  BNE $C002
+// C007  INC $D020
+// C00A  LDA $DC01      keyboard rows
+// C00D  LDA $D019
+// C010  JMP $C000
+static const uint8_t raster_poll[] = {
+    0xA9, 0x80, 0xCD, 0x12, 0xD0, 0xD0, 0xFB, 0xEE, 0x20, 0xD0, 0xAD, 0x01,
+    0xDC, 0xAD, 0x19, 0xD0, 0x4C, 0x00, 0xC0
+};
+
+// 10 PRINT"THE QUICK BROWN FOX JUMPS ";:GOTO10
+static const uint8_t text_scroll[] = {
+    0x28, 0x08, 0x0A, 0x00, 0x99, 0x22, 0x54, 0x48, 0x45, 0x20, 0x51, 0x55,
+    0x49, 0x43, 0x4B, 0x20, 0x42, 0x52, 0x4F, 0x57, 0x4E, 0x20, 0x46, 0x4F,
+    0x58, 0x20, 0x4A, 0x55, 0x4D, 0x50, 0x53, 0x20, 0x22, 0x3B, 0x3A, 0x89,
+    0x31, 0x30, 0x00, 0x00, 0x00
+};
+
+static const struct workload workloads[] = {
+    { "basic",  basic_crunch, sizeof(basic_crunch), 0x0801 },
+    { "mcloop", mc_loop,      sizeof(mc_loop),      0xC000 },
+    { "raster", raster_poll,  sizeof(raster_poll),  0xC000 },
+    { "scroll", text_scroll,  sizeof(text_scroll),  0x0801 },
+};
+#define WORKLOADS       (sizeof(workloads) / sizeof(workloads[0]))
+
+static struct emu_state ready_state;
+static uint8_t ready_ram[0x10000];
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void run_frames(uint32_t n)
+{
+    uint32_t end = frames_run + n;
+
+    while (frames_run < end)
+        step6502();
+}
+
+static void begin(struct result *r, const char *name)
+{
+    r->name         = name;
+    r->frames       = frames_run;
+    r->cycles       = clockticks6502;
+    r->instructions = instructions;
+    r->host_ns      = now_ns();
+}
+
+static void end(struct result *r)
+{
+    r->host_ns      = now_ns() - r->host_ns;
+    r->frames       = frames_run - r->frames;
+    r->cycles       = (uint32_t)(clockticks6502 - (uint32_t)r->cycles);
+    r->instructions = instructions - r->instructions;
+}
+
+// Cold start to READY., or a snapshot restore.  No renderer: a worker
+// thread drawing frames would share the host with the timed code.
+static void boot_workload(struct result *r, const char *snapshot)
+{
+    begin(r, snapshot ? "restore" : "boot");
+    if (init(0, snapshot) != 0)
+        exit(1);
+    while (!emu_at_ready())
+        run_frames(1);
+    end(r);
+    // most of the boot runs inside init(), before the tick hook that
+    // counts frames_run is installed
+    r->frames = (uint32_t)(r->cycles / FRAME_CYCLES);
+
+    emu_get_state(&ready_state);
+    emu_ram_read(ready_ram, 0, sizeof(ready_ram));
+}
+
+// From the READY. state, with the program in RAM and RUN/SYS typed
+static void run_workload(struct result *r, const struct workload *w, uint32_t frames)
+{
+    char cmd[16];
+
+    emu_set_state(&ready_state);
+    emu_ram_write(0, ready_ram, sizeof(ready_ram));
+    emu_ram_write(w->addr, w->code, w->size);
+    if (w->addr == 0x0801) {
+        autostart_set_basic_end((uint16_t)(w->addr + w->size));
+        strcpy(cmd, "RUN\r");
+    } else {
+        sprintf(cmd, "SYS%u\r", w->addr);
+    }
+    autostart_keys((const uint8_t *)cmd, (uint8_t)strlen(cmd));
+
+    begin(r, w->name);
+    run_frames(frames);
+    end(r);
+}
+
+// Host-side DMA, no guest code: per round one 64 KB lcopy of the C64's
+// RAM into bank 0, then a chained batch of four 8 KB copies and four
+// fills there.  In its row frames are rounds, cycles are bytes moved (so
+// MHz reads as MB/s) and insns are DMA jobs.
+static void dma_workload(struct result *r)
+{
+    struct dmagic_batch b;
+    uint32_t i, k;
+
+    dmagic_batch_begin(&b);
+    for (k = 0; k < 4; k++) {
+        dmagic_batch_copy(&b, k * 0x2000, 0x8000 + k * 0x2000, 0x2000);
+        dmagic_batch_fill(&b, k * 0x2000, (uint8_t)k, 0x2000);
+    }
+
+    r->name    = "dma";
+    r->host_ns = now_ns();
+    for (i = 0; i < DMA_ROUNDS; i++) {
+        lcopy(BANK_5_RAM, 0x00000, 0x10000);
+        dmagic_batch_run(&b);
+    }
+    r->host_ns      = now_ns() - r->host_ns;
+    r->frames       = DMA_ROUNDS;
+    r->cycles       = (uint64_t)DMA_ROUNDS * (0x10000 + 8 * 0x2000);
+    r->instructions = (uint64_t)DMA_ROUNDS * (1 + b.jobs);
+}
+
+static void report(FILE *f, const struct result *r, int json, int last)
+{
+    double us = r->host_ns / 1000.0;
+    double mhz = us > 0 ? r->cycles / us : 0;
+    double ns_insn = r->instructions ? (double)r->host_ns / r->instructions : 0;
+    double ns_frame = r->frames ? (double)r->host_ns / r->frames : 0;
+
+    if (json)
+        fprintf(f, "    { \"name\": \"%s\", \"frames\": %lu, \"cycles\": %llu, "
+                   "\"instructions\": %llu, \"host_ns\": %llu, \"mhz\": %.3f, "
+                   "\"ns_per_insn\": %.3f, \"ns_per_frame\": %.1f }%s\n",
+                r->name, (unsigned long)r->frames, (unsigned long long)r->cycles,
+                (unsigned long long)r->instructions, (unsigned long long)r->host_ns,
+                mhz, ns_insn, ns_frame, last ? "" : ",");
+    else
+        fprintf(f, "%-8s %6lu %12llu %12llu %10.3f %8.2f %10.3f %12.1f\n",
+                r->name, (unsigned long)r->frames, (unsigned long long)r->cycles,
+                (unsigned long long)r->instructions, r->host_ns / 1e6,
+                mhz, ns_insn, ns_frame);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *romdir = "roms";
+    const char *snapshot = NULL;
+    const char *json = NULL;
+    const char *only[WORKLOADS + 1];
+    struct result results[1 + WORKLOADS + 1];
+    uint32_t frames = BENCH_FRAMES;
+    unsigned n = 0, nonly = 0, i, j;
+    FILE *f;
+
+    for (i = 1; i < (unsigned)argc; i++) {
+        if (!strcmp(argv[i], "-romdir") && i + 1 < (unsigned)argc)
+            romdir = argv[++i];
+        else if (!strcmp(argv[i], "-snapshot") && i + 1 < (unsigned)argc)
+            snapshot = argv[++i];
+        else if (!strcmp(argv[i], "-frames") && i + 1 < (unsigned)argc)
+            frames = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-json") && i + 1 < (unsigned)argc)
+            json = argv[++i];
+        else if (nonly < WORKLOADS + 1)
+            only[nonly++] = argv[i];
+    }
+
+    // the guest must not see whatever is on our stdin
+    if (!freopen("/dev/null", "r", stdin))
+        return 1;
+
+    bind_memory();
+    if (romset_load(romdir, 0) != 0)
+        return 1;
+
+    boot_workload(&results[n++], snapshot);
+    for (i = 0; i < WORKLOADS; i++) {
+        for (j = 0; j < nonly && strcmp(only[j], workloads[i].name); j++)
+            ;
+        if (nonly && j == nonly)
+            continue;
+        run_workload(&results[n++], &workloads[i], frames);
+    }
+    for (j = 0; j < nonly && strcmp(only[j], "dma"); j++)
+        ;
+    if (!nonly || j < nonly)
+        dma_workload(&results[n++]);
+
+    printf("%-8s %6s %12s %12s %10s %8s %10s %12s\n",
+           "workload", "frames", "cycles", "insns", "host ms", "MHz", "ns/insn", "ns/frame");
+    for (i = 0; i < n; i++)
+        report(stdout, &results[i], 0, 0);
+
+    if (json) {
+        f = fopen(json, "w");
+        if (!f) {
+            printf("bench: cannot create %s\n", json);
+            return 1;
+        }
+        fprintf(f, "{\n  \"frames_per_workload\": %lu,\n  \"kernal_crc\": \"%08lX\",\n  \"workloads\": [\n",
+                (unsigned long)frames, (unsigned long)romset.kernal_crc);
+        for (i = 0; i < n; i++)
+            report(f, &results[i], 1, i == n - 1);
+        fputs("  ]\n}\n", f);
+        fclose(f);
+    }
+    return 0;
+}
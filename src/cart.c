@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "platform.h"
+#include "mapfile.h"
+#include "cart.h"
+
+// .crt loading.  The file is a 64-byte header (hardware type, GAME and
+// EXROM lines) followed by CHIP packets, each one 8K or 16K ROM bank with
+// its load address.  The packets are never copied: lo[] and hi[] point at
+// every bank's ROML and ROMH data in the mapping, and selecting a bank
+// copies two pointers.
+//
+// Bank switching by type:
+//   Ocean          write $DE00: bank in bits 0-5, same bank at ROML and ROMH
+//   C64GS/System 3 write $DE00+n: bank n, any read of I/O1: bank 0
+//   Dinamic        read $DE00+n: bank n
+//   Magic Desk     write $DE00: bank in bits 0-6, bit 7 switches the cart off
+//   Simons' BASIC  read I/O1: 8K mode, write I/O1: 16K mode
+
+#define CRT_HEADER      0x40
+#define CHIP_HEADER     0x10
+
+uint8_t cart_present;
+EMU_TLS uint8_t cart_mode;
+EMU_TLS const uint8_t *cart_roml;
+EMU_TLS const uint8_t *cart_romh;
+
+static struct mapped_file image;
+static uint16_t type;
+static uint8_t  boot_mode;
+static uint8_t  bank_mask;
+static const uint8_t *lo[CART_BANKS];
+static const uint8_t *hi[CART_BANKS];
+
+static uint16_t be16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void select_bank(uint8_t bank)
+{
+    bank &= bank_mask;
+    if (type == CRT_OCEAN) {
+        // the upper half of a 256K Ocean image is loaded at $A000
+        cart_roml = lo[bank] ? lo[bank] : hi[bank];
+        cart_romh = cart_roml;
+    } else {
+        cart_roml = lo[bank];
+        cart_romh = hi[bank];
+    }
+}
+
+static int load_chips(void)
+{
+    size_t offset = be32(image.data + 0x10);
+    unsigned last = 0, chips = 0;
+
+    if (offset < CRT_HEADER)
+        offset = CRT_HEADER;
+    while (offset + CHIP_HEADER <= image.size && !memcmp(image.data + offset, "CHIP", 4)) {
+        const uint8_t *chip = image.data + offset;
+        uint32_t length = be32(chip + 4);
+        uint16_t bank = be16(chip + 10), load = be16(chip + 12), size = be16(chip + 14);
+
+        if (length < CHIP_HEADER || offset + CHIP_HEADER + size > image.size || bank >= CART_BANKS ||
+            (size != 0x2000 && size != 0x4000)) {
+            platform_msg("cart: bad CHIP packet at %lX\n", (unsigned long)offset);
+            return -1;
+        }
+        if (load == 0x8000) {
+            lo[bank] = chip + CHIP_HEADER;
+            if (size == 0x4000)
+                hi[bank] = chip + CHIP_HEADER + 0x2000;
+        } else if (load == 0xA000 || load == 0xE000) {
+            hi[bank] = chip + CHIP_HEADER;
+        }
+        if (bank > last)
+            last = bank;
+        chips++;
+        offset += length;
+    }
+    if (!chips) {
+        platform_msg("cart: no ROM in the image\n");
+        return -1;
+    }
+    for (bank_mask = 0; bank_mask < last; bank_mask = (uint8_t)((bank_mask << 1) | 1))
+        ;
+    return 0;
+}
+
+int cart_open(const char *path)
+{
+    uint8_t exrom, game;
+
+#ifndef __linux__
+    // even an 8K image is larger than the heap map_file() reads into
+    platform_msg("cart: %s: cartridge images need a Linux host\n", path);
+    return -1;
+#endif
+    if (map_file(path, &image, 0) != 0) {
+        platform_msg("cart: cannot open %s\n", path);
+        return -1;
+    }
+    if (image.size < CRT_HEADER || memcmp(image.data, "C64 CARTRIDGE   ", 16) != 0) {
+        platform_msg("cart: %s is not a .crt image\n", path);
+        unmap_file(&image);
+        return -1;
+    }
+
+    type  = be16(image.data + 0x16);
+    exrom = image.data[0x18];
+    game  = image.data[0x19];
+    switch (type) {
+        case CRT_NORMAL:
+        case CRT_OCEAN:
+            boot_mode = !exrom ? (game ? CART_8K : CART_16K) : (game ? CART_OFF : CART_ULTIMAX);
+            break;
+        case CRT_SIMONS_BASIC:
+        case CRT_C64GS:
+        case CRT_DINAMIC:
+        case CRT_MAGIC_DESK:
+            boot_mode = CART_8K;
+            break;
+        default:
+            platform_msg("cart: hardware type %u is not supported\n", type);
+            unmap_file(&image);
+            return -1;
+    }
+    if (load_chips() != 0) {
+        unmap_file(&image);
+        return -1;
+    }
+
+    platform_msg("cart: %.32s, type %u\n", (const char *)image.data + 0x20, type);
+    cart_present = 1;
+    cart_mode = boot_mode;
+    select_bank(0);
+    return 0;
+}
+
+// $DE00-$DFFF
+uint8_t cart_io_read(uint16_t address)
+{
+    if (address < 0xDF00) {
+        switch (type) {
+            case CRT_C64GS:
+                select_bank(0);
+                break;
+            case CRT_DINAMIC:
+                select_bank((uint8_t)address);
+                break;
+            case CRT_SIMONS_BASIC:
+                cart_mode = CART_8K;
+                break;
+        }
+    }
+    return ram[address];
+}
+
+void cart_io_write(uint16_t address, uint8_t value)
+{
+    if (address >= 0xDF00)
+        return;
+    switch (type) {
+        case CRT_OCEAN:
+            select_bank(value & 0x3F);
+            break;
+        case CRT_C64GS:
+            select_bank((uint8_t)address);
+            break;
+        case CRT_MAGIC_DESK:
+            select_bank(value & 0x7F);
+            cart_mode = value & 0x80 ? CART_OFF : CART_8K;
+            break;
+        case CRT_SIMONS_BASIC:
+            cart_mode = CART_16K;
+            break;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef __CART_H
+#define __CART_H
+
+#include <stdint.h>
+
+#include "platform.h"
+
+// Expansion port cartridges from .crt images.  The image stays mapped and
+// the ROML ($8000) and ROMH ($A000, or $E000 in Ultimax mode) windows are
+// pointers into it; read6502 looks at them together with the 6510 port,
+// and a bank switch only moves the pointers.
+
+#define CART_OFF                0       // GAME and EXROM high, no ROM visible
+#define CART_8K                 1       // EXROM low: ROML
+#define CART_16K                2       // GAME and EXROM low: ROML and ROMH
+#define CART_ULTIMAX            3       // GAME low: ROML, ROMH at $E000
+
+// .crt hardware types handled
+#define CRT_NORMAL              0
+#define CRT_SIMONS_BASIC        4
+#define CRT_OCEAN               5
+#define CRT_C64GS               15
+#define CRT_DINAMIC             17
+#define CRT_MAGIC_DESK          19
+
+#define CART_BANKS              128
+
+extern uint8_t cart_present;                    // I/O1/I/O2 go to the cartridge
+extern EMU_TLS uint8_t cart_mode;
+extern EMU_TLS const uint8_t *cart_roml;        // NULL: nothing in this bank
+extern EMU_TLS const uint8_t *cart_romh;
+
+int     cart_open(const char *path);
+uint8_t cart_io_read(uint16_t address);
+void    cart_io_write(uint16_t address, uint8_t value);
+
+#endif
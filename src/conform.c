@@ -0,0 +1,638 @@
+// CPU conformance suite for the Fake6502 core.  cpu.c runs here on a flat
+// 64K of RAM, without the C64 memory map or traps, so every result is the
+// core's own.  The DMAgic job encoding is checked the same way, through
+// dmagic.c's software model over a flat buffer.  Built on the Linux host
+// only, see build.sh.
+//
+//   conform [-functional file[@success]] [-decimal file[@error]] [test ...]
+//
+// The Klaus Dormann images are not part of the tree: the functional test
+// is the 64K binary (started at $0400, passes when it loops at the success
+// address), the decimal test is loaded and started at $0200 and passes
+// when its ERROR byte reads 0 after it stops.  Without the files both are
+// reported as skipped.
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "platform.h"
+#include "mapfile.h"
+#include "dmagic.h"
+
+#define FUNCTIONAL_SUCCESS      0x3469  // 6502_functional_test.bin as published
+#define DECIMAL_ERROR           0x000B
+#define TEST_INSNS              200000000u
+#define DETAIL_MAX              4       // failures spelled out per test
+#define DMA_SIZE                0x30000 // three banks, room for jobs over 64K
+
+static uint8_t mem[0x10000];
+static uint8_t dma[DMA_SIZE];
+static unsigned writes;
+
+EMU_TLS uint8_t irq_triggered;
+
+uint8_t read6502(uint16_t address) {
+    return mem[address];
+}
+
+void write6502(uint16_t address, uint8_t value) {
+    mem[address] = value;
+    writes++;
+}
+
+#undef PROFILE                          // the suite times the bare core
+#undef HEATMAP
+#include "cpu.c"
+
+// NMOS 6502 cycle counts, page crossings and taken branches not included
+static const uint8_t nmos_cycles[256] = {
+/*        0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F */
+/* 0 */   7, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+/* 1 */   2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/* 2 */   6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+/* 3 */   2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/* 4 */   6, 6, 0, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+/* 5 */   2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/* 6 */   6, 6, 0, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+/* 7 */   2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/* 8 */   2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+/* 9 */   2, 6, 0, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+/* A */   2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+/* B */   2, 5, 0, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+/* C */   2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+/* D */   2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+/* E */   2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+/* F */   2, 5, 0, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7
+};                                      // 0 = JAM, not timed
+
+// Reads that take one more cycle when the indexed address crosses a page
+static const uint8_t page_penalty[] = {
+    0x11, 0x31, 0x51, 0x71, 0xB1, 0xD1, 0xF1, 0xB3,             // (zp),Y
+    0x19, 0x39, 0x59, 0x79, 0xB9, 0xD9, 0xF9, 0xBB, 0xBE, 0xBF, // abs,Y
+    0x1D, 0x3D, 0x5D, 0x7D, 0xBD, 0xDD, 0xFD, 0xBC,             // abs,X
+    0x1C, 0x3C, 0x5C, 0x7C, 0xDC, 0xFC
+};
+
+// Plain stores: one bus write each
+static const uint8_t stores[] = {
+    0x81, 0x84, 0x85, 0x86, 0x8C, 0x8D, 0x8E, 0x91, 0x94, 0x95, 0x96, 0x99, 0x9D,
+    0x83, 0x87, 0x8F, 0x97                                      // SAX
+};
+
+struct test {
+    const char *name;
+    int (*run)(void);           // failures, -1 = skipped
+};
+
+static const char *functional_path, *decimal_path;
+static uint16_t functional_success = FUNCTIONAL_SUCCESS;
+static uint16_t decimal_error = DECIMAL_ERROR;
+static char detail[DETAIL_MAX][96];
+static unsigned details;
+
+static void fail(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Note a failure; the first few are printed under the result line
+static void fail(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (details >= DETAIL_MAX)
+        return;
+    va_start(ap, fmt);
+    vsnprintf(detail[details++], sizeof(detail[0]), fmt, ap);
+    va_end(ap);
+}
+
+static int in_list(const uint8_t *list, size_t n, uint8_t op)
+{
+    while (n--) {
+        if (list[n] == op)
+            return 1;
+    }
+    return 0;
+}
+
+static void cpu_at(uint16_t address)
+{
+    pc = address;
+    sp = 0xFF;
+    a = x = y = 0;
+    status = FLAG_CONSTANT;
+    irq_triggered = 0;
+    clockticks6502 = clockgoal6502 = 0;
+    writes = 0;
+}
+
+static uint32_t timed_step(void)
+{
+    uint32_t start = clockticks6502;
+
+    step6502();
+    return clockticks6502 - start;
+}
+
+// Run until the program jumps or branches to itself, the way the Dormann
+// tests stop.  Returns the address it stopped at, or -1 on budget.
+static long run_to_trap(void)
+{
+    uint32_t n;
+    uint16_t at;
+
+    for (n = 0; n < TEST_INSNS; n++) {
+        at = pc;
+        step6502();
+        if (pc == at)
+            return at;
+    }
+    return -1;
+}
+
+static int load_image(const char *path, uint16_t address)
+{
+    struct mapped_file f;
+
+    if (map_file(path, &f, 0) != 0)
+        return -1;
+    memset(mem, 0, sizeof(mem));
+    memcpy(mem + address, f.data, f.size > 0x10000u - address ? 0x10000u - address : f.size);
+    unmap_file(&f);
+    return 0;
+}
+
+// ── Klaus Dormann's functional and decimal tests ───────────────────
+
+static int test_functional(void)
+{
+    long at;
+
+    if (!functional_path)
+        return -1;
+    if (load_image(functional_path, 0x0000) != 0)
+        return 1;
+    cpu_at(0x0400);
+    at = run_to_trap();
+    if (at == functional_success)
+        return 0;
+    if (at < 0)
+        fail("no result after %u instructions", TEST_INSNS);
+    else
+        fail("trapped at $%04lX, test case $%02X", (unsigned long)at, mem[0x0200]);
+    return 1;
+}
+
+static int test_decimal(void)
+{
+    long at;
+
+    if (!decimal_path)
+        return -1;
+    if (load_image(decimal_path, 0x0200) != 0)
+        return 1;
+    // BRK ends up in a loop of its own, in case the image stops with one
+    mem[0xFFF0] = 0x4C; mem[0xFFF1] = 0xF0; mem[0xFFF2] = 0xFF;
+    mem[0xFFFE] = 0xF0; mem[0xFFFF] = 0xFF;
+    cpu_at(0x0200);
+    at = run_to_trap();
+    if (at >= 0 && mem[decimal_error] == 0)
+        return 0;
+    if (at < 0)
+        fail("no result after %u instructions", TEST_INSNS);
+    else
+        fail("stopped at $%04lX with ERROR = %u", (unsigned long)at, mem[decimal_error]);
+    return 1;
+}
+
+// ── BCD arithmetic against the NMOS rules, all valid BCD operands ──
+
+static uint8_t to_bcd(unsigned n)
+{
+    return (uint8_t)(((n / 10) << 4) | (n % 10));
+}
+
+static int test_bcd(void)
+{
+    unsigned i, j, c, want_a, want_c, failures = 0;
+    int lo, sum;
+
+    for (c = 0; c < 2; c++) {
+        for (i = 0; i < 100; i++) {
+            for (j = 0; j < 100; j++) {
+                uint8_t av = to_bcd(i), m = to_bcd(j);
+
+                // SED / ADC #m
+                mem[0x0300] = 0x69; mem[0x0301] = m;
+                cpu_at(0x0300);
+                a = av;
+                status |= FLAG_DECIMAL | (c ? FLAG_CARRY : 0);
+                step6502();
+                lo = (av & 0x0F) + (m & 0x0F) + (int)c;
+                if (lo >= 0x0A)
+                    lo = ((lo + 0x06) & 0x0F) + 0x10;
+                sum = (av & 0xF0) + (m & 0xF0) + lo;
+                if (sum >= 0xA0)
+                    sum += 0x60;
+                want_a = (unsigned)sum & 0xFF;
+                want_c = sum >= 0x100;
+                if (a != want_a || (status & FLAG_CARRY) != want_c) {
+                    failures++;
+                    fail("ADC $%02X + $%02X + %u = $%02X C=%u, want $%02X C=%u",
+                         av, m, c, a, status & FLAG_CARRY, want_a, want_c);
+                }
+
+                // SED / SBC #m
+                mem[0x0300] = 0xE9;
+                cpu_at(0x0300);
+                a = av;
+                status |= FLAG_DECIMAL | (c ? FLAG_CARRY : 0);
+                step6502();
+                lo = (av & 0x0F) - (m & 0x0F) + (int)c - 1;
+                if (lo < 0)
+                    lo = ((lo - 0x06) & 0x0F) - 0x10;
+                sum = (av & 0xF0) - (m & 0xF0) + lo;
+                if (sum < 0)
+                    sum -= 0x60;
+                want_a = (unsigned)sum & 0xFF;
+                want_c = (int)av - (int)m - (int)(1 - c) >= 0;
+                if (a != want_a || (status & FLAG_CARRY) != want_c) {
+                    failures++;
+                    fail("SBC $%02X - $%02X - %u = $%02X C=%u, want $%02X C=%u",
+                         av, m, 1 - c, a, status & FLAG_CARRY, want_a, want_c);
+                }
+            }
+        }
+    }
+    return (int)failures;
+}
+
+// ── Per-opcode cycle counts, page crossings and branches ───────────
+
+// Instruction at $0300 whose operand points at $1080, or $10FF + 1 to
+// cross into the next page; X = Y = 1
+static void setup_operand(uint8_t op, int cross)
+{
+    uint16_t base = cross ? 0x10FF : 0x1080;
+
+    memset(mem, 0, sizeof(mem));
+    mem[0xFFFE] = 0x00; mem[0xFFFF] = 0x04;
+    mem[0x0300] = op;
+    if (addrtable[op] == zp || addrtable[op] == zpx || addrtable[op] == zpy ||
+        addrtable[op] == indx || addrtable[op] == indy || addrtable[op] == imm) {
+        mem[0x0301] = 0x80;
+    } else {
+        mem[0x0301] = base & 0xFF;
+        mem[0x0302] = base >> 8;
+    }
+    if (addrtable[op] == indy) {
+        mem[0x0080] = base & 0xFF;                              // ($80),Y
+        mem[0x0081] = base >> 8;
+    } else {
+        mem[0x0081] = base & 0xFF;                              // ($80,X)
+        mem[0x0082] = base >> 8;
+    }
+    mem[0x1080] = 0x00; mem[0x1081] = 0x05;                     // JMP ($1080)
+    cpu_at(0x0300);
+    x = y = 1;
+}
+
+static int test_cycles(void)
+{
+    unsigned op, failures = 0, cross, got, want;
+    int taken;
+
+    for (op = 0; op < 256; op++) {
+        if (!nmos_cycles[op])
+            continue;
+
+        if (addrtable[op] == rel) {
+            // not taken, taken, taken into the next page
+            static const uint8_t flag[4] = { FLAG_SIGN, FLAG_OVERFLOW, FLAG_CARRY, FLAG_ZERO };
+            for (taken = 0; taken < 3; taken++) {
+                uint16_t at = taken == 2 ? 0x02FD : 0x0300;
+
+                memset(mem, 0, sizeof(mem));
+                mem[at] = (uint8_t)op;
+                mem[at + 1] = 0x02;
+                cpu_at(at);
+                if (((op >> 5) & 1) == (taken != 0))
+                    status |= flag[op >> 6];
+                got  = timed_step();
+                want = 2u + (taken != 0) + (taken == 2);
+                if (got != want) {
+                    failures++;
+                    fail("$%02X %s: %u cycles, want %u", op,
+                         taken == 0 ? "not taken" : taken == 1 ? "taken" : "taken across a page",
+                         got, want);
+                }
+            }
+            continue;
+        }
+
+        for (cross = 0; cross < 2; cross++) {
+            if (cross && addrtable[op] != absx && addrtable[op] != absy && addrtable[op] != indy)
+                break;
+            setup_operand((uint8_t)op, (int)cross);
+            got  = timed_step();
+            want = nmos_cycles[op] + (cross && in_list(page_penalty, sizeof(page_penalty), (uint8_t)op));
+            if (got != want) {
+                failures++;
+                fail("$%02X%s: %u cycles, want %u", op, cross ? " across a page" : "", got, want);
+            }
+        }
+    }
+
+    // decimal mode costs no extra cycle on the NMOS part
+    for (op = 0x69; op <= 0xE9; op += 0x80) {
+        setup_operand((uint8_t)op, 0);
+        status |= FLAG_DECIMAL;
+        got = timed_step();
+        if (got != 2) {
+            failures++;
+            fail("$%02X with D set: %u cycles, want 2", op, got);
+        }
+    }
+    return (int)failures;
+}
+
+// Every store is exactly one bus write of the right value
+static int test_stores(void)
+{
+    unsigned i, failures = 0;
+
+    for (i = 0; i < sizeof(stores); i++) {
+        uint8_t op = stores[i], want;
+
+        setup_operand(op, 0);
+        a = 0xF0; x = 0x3C; y = 0x5A;
+        switch (op & 0x03) {
+            case 0:  want = y;     break;
+            case 1:  want = a;     break;
+            case 2:  want = x;     break;
+            default: want = a & x; break;
+        }
+        step6502();
+        if (writes != 1 || mem[ea] != want) {
+            failures++;
+            fail("$%02X: %u writes, $%04X = $%02X, want 1 write of $%02X",
+                 op, writes, ea, mem[ea], want);
+        }
+    }
+    return (int)failures;
+}
+
+// ── BRK, IRQ, NMI and RTI ──────────────────────────────────────────
+
+static int check(int ok, const char *what, unsigned got, unsigned want)
+{
+    if (ok)
+        return 0;
+    fail("%s: $%02X, want $%02X", what, got, want);
+    return 1;
+}
+
+static void vectors(void)
+{
+    memset(mem, 0, sizeof(mem));
+    mem[0xFFFA] = 0x00; mem[0xFFFB] = 0x05;     // NMI -> $0500
+    mem[0xFFFE] = 0x00; mem[0xFFFF] = 0x04;     // IRQ/BRK -> $0400
+    mem[0x0400] = 0x40;                         // RTI
+    mem[0x0500] = 0x40;
+}
+
+static int test_interrupts(void)
+{
+    int failures = 0;
+    uint32_t got;
+
+    // BRK: pushes PC + 2 and P with B set, then takes the IRQ vector
+    vectors();
+    mem[0x0300] = 0x00;
+    cpu_at(0x0300);
+    status |= FLAG_CARRY;
+    got = timed_step();
+    failures += check(pc == 0x0400, "BRK vector", pc, 0x0400);
+    failures += check(mem[0x01FF] == 0x03 && mem[0x01FE] == 0x02, "BRK return address",
+                      (unsigned)(mem[0x01FF] << 8 | mem[0x01FE]), 0x0302);
+    failures += check(mem[0x01FD] == 0x31, "BRK pushed P", mem[0x01FD], 0x31);
+    failures += check(status & FLAG_INTERRUPT, "BRK sets I", status, status | FLAG_INTERRUPT);
+    failures += check(got == 7, "BRK cycles", got, 7);
+
+    // RTI: B and the unused bit are not real flags
+    got = timed_step();
+    failures += check(pc == 0x0302, "RTI address", pc, 0x0302);
+    failures += check(status == 0x21, "RTI P", status, 0x21);
+    failures += check(sp == 0xFF, "RTI SP", sp, 0xFF);
+    failures += check(got == 6, "RTI cycles", got, 6);
+
+    // IRQ: pushes the current PC and P with B clear
+    vectors();
+    cpu_at(0x0300);
+    got = clockticks6502;
+    irq6502();
+    got = clockticks6502 - got;
+    failures += check(pc == 0x0400, "IRQ vector", pc, 0x0400);
+    failures += check(mem[0x01FF] == 0x03 && mem[0x01FE] == 0x00, "IRQ return address",
+                      (unsigned)(mem[0x01FF] << 8 | mem[0x01FE]), 0x0300);
+    failures += check(mem[0x01FD] == 0x20, "IRQ pushed P", mem[0x01FD], 0x20);
+    failures += check(status & FLAG_INTERRUPT, "IRQ sets I", status, status | FLAG_INTERRUPT);
+    failures += check(got == 7, "IRQ cycles", got, 7);
+    irq_triggered = 1;
+    step6502();
+    failures += check(pc == 0x0300 && !irq_triggered, "RTI re-arms IRQ", irq_triggered, 0);
+
+    // NMI: its own vector, taken even with I set
+    vectors();
+    cpu_at(0x0300);
+    status |= FLAG_INTERRUPT;
+    got = clockticks6502;
+    nmi6502();
+    got = clockticks6502 - got;
+    failures += check(pc == 0x0500, "NMI vector", pc, 0x0500);
+    failures += check(mem[0x01FD] == 0x24, "NMI pushed P", mem[0x01FD], 0x24);
+    failures += check(got == 7, "NMI cycles", got, 7);
+    return failures;
+}
+
+// ── DMAgic jobs ─────────────────────────────────────────────────────
+
+// The model's memory: dma[] from address 0
+static uint8_t *flat(uint32_t address, size_t count)
+{
+    if (address > DMA_SIZE || count > DMA_SIZE - address)
+        return NULL;
+    return dma + address;
+}
+
+// What lcopy/lfill and the batches trigger
+void dmagic_trigger(const uint8_t *list)
+{
+    if (dmagic_model_run(list, flat) < 0)
+        fail("dmagic: list refused");
+}
+
+static void dma_pattern(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < DMA_SIZE; i++)
+        dma[i] = (uint8_t)(i * 7 + (i >> 8));
+}
+
+// Bytes [from, to) against what the job should have left; one failure
+// per range
+static int dma_range(const char *what, uint32_t from, uint32_t to, uint8_t (*want)(uint32_t))
+{
+    uint32_t i;
+
+    for (i = from; i < to; i++) {
+        if (dma[i] != want(i)) {
+            fail("%s: $%05lX = $%02X, want $%02X", what, (unsigned long)i, dma[i], want(i));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static uint8_t pattern_at(uint32_t i)   { return (uint8_t)(i * 7 + (i >> 8)); }
+static uint8_t chain_copy(uint32_t i)   { return pattern_at(i - 0x1000 + 0x0100); }
+static uint8_t chain_fill(uint32_t i)   { (void)i; return 0xA5; }
+static uint8_t smear(uint32_t i)        { (void)i; return pattern_at(0x2000); }
+static uint8_t reversed(uint32_t i)     { return pattern_at(0x30FF - (i - 0x3200)); }
+static uint8_t held(uint32_t i)         { (void)i; return pattern_at(0x4000); }
+static uint8_t skipped(uint32_t i)      { return i & 1 ? pattern_at(i) : 0x5A; }
+static uint8_t long_copy(uint32_t i)    { return pattern_at(i - 0x18000); }
+static uint8_t long_fill(uint32_t i)    { (void)i; return 0x3C; }
+
+static int test_dmagic(void)
+{
+    static uint8_t job[DMAGIC_JOB_SIZE] = DMAGIC_JOB(DMAGIC_COPY);
+    struct dmagic_batch b;
+    int failures = 0, jobs;
+
+    // copy then fill, chained, one trigger
+    dma_pattern();
+    dmagic_batch_begin(&b);
+    dmagic_batch_copy(&b, 0x0100, 0x1000, 0x80);
+    dmagic_batch_fill(&b, 0x1080, 0xA5, 0x80);
+    jobs = dmagic_model_run(b.list, flat);
+    failures += check(jobs == 2, "chain jobs", (unsigned)jobs, 2);
+    failures += dma_range("chain copy", 0x1000, 0x1080, chain_copy);
+    failures += dma_range("chain fill", 0x1080, 0x1100, chain_fill);
+    failures += dma_range("chain end", 0x1100, 0x1200, pattern_at);
+
+    // overlapping copy one byte up smears the first byte, as the hardware does
+    dma_pattern();
+    lcopy(0x2000, 0x2001, 0xFF);
+    failures += dma_range("overlap", 0x2000, 0x2100, smear);
+
+    // source counting down
+    dma_pattern();
+    dmagic_set_source(job, 0x30FF);
+    dmagic_set_dest(job, 0x3200);
+    dmagic_set_count(job, 0x100);
+    job[DMAGIC_SRC_BANK] |= DMAGIC_DEC;
+    dmagic_trigger(job);
+    failures += dma_range("decrement", 0x3200, 0x3300, reversed);
+
+    // source held on one byte
+    dma_pattern();
+    dmagic_set_source(job, 0x4000);
+    dmagic_set_dest(job, 0x4100);
+    job[DMAGIC_SRC_BANK] |= DMAGIC_HOLD;
+    dmagic_trigger(job);
+    failures += dma_range("hold", 0x4100, 0x4200, held);
+
+    // destination skip 2, over 64K bytes so it takes two jobs
+    dma_pattern();
+    lfill_skip(0x0000, 0x5A, 0x10002, 2);
+    failures += dma_range("skip", 0x0000, 0x20004, skipped);
+    failures += dma_range("skip end", 0x20004, 0x20100, pattern_at);
+
+    // exactly 64K is one job of count 0; more is split, not cut
+    dma_pattern();
+    lcopy(0x00000, 0x18000, 0x10123);
+    failures += dma_range("long copy", 0x18000, 0x28123, long_copy);
+    failures += dma_range("long copy end", 0x28123, 0x28200, pattern_at);
+    dma_pattern();
+    lfill(0x10000, 0x3C, 0x10000);
+    failures += dma_range("64K fill start", 0x0FF00, 0x10000, pattern_at);
+    failures += dma_range("64K fill", 0x10000, 0x20000, long_fill);
+    failures += dma_range("64K fill end", 0x20000, 0x20100, pattern_at);
+    return failures;
+}
+
+static const struct test tests[] = {
+    { "functional", test_functional },
+    { "decimal",    test_decimal    },
+    { "bcd",        test_bcd        },
+    { "cycles",     test_cycles     },
+    { "stores",     test_stores     },
+    { "interrupts", test_interrupts },
+    { "dmagic",     test_dmagic     },
+};
+#define TESTS           (sizeof(tests) / sizeof(tests[0]))
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// "file@hex" sets *address from the suffix
+static const char *path_at(char *arg, uint16_t *address)
+{
+    char *at = strrchr(arg, '@');
+
+    if (at) {
+        *at = 0;
+        *address = (uint16_t)strtoul(at + 1, NULL, 16);
+    }
+    return arg;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *only[TESTS];
+    unsigned nonly = 0, failed = 0, i, j;
+    uint64_t start;
+    int r;
+
+    for (i = 1; i < (unsigned)argc; i++) {
+        if (!strcmp(argv[i], "-functional") && i + 1 < (unsigned)argc)
+            functional_path = path_at(argv[++i], &functional_success);
+        else if (!strcmp(argv[i], "-decimal") && i + 1 < (unsigned)argc)
+            decimal_path = path_at(argv[++i], &decimal_error);
+        else if (nonly < TESTS)
+            only[nonly++] = argv[i];
+    }
+
+    for (i = 0; i < TESTS; i++) {
+        for (j = 0; j < nonly && strcmp(only[j], tests[i].name); j++)
+            ;
+        if (nonly && j == nonly)
+            continue;
+
+        details = 0;
+        start = now_ns();
+        r = tests[i].run();
+        if (r < 0) {
+            printf("%-12s skip\n", tests[i].name);
+            continue;
+        }
+        printf("%-12s %s %10.3f ms", tests[i].name, r ? "FAIL" : "pass", (now_ns() - start) / 1e6);
+        if (r)
+            printf("  (%d failures)", r);
+        putchar('\n');
+        for (j = 0; j < details; j++)
+            printf("    %s\n", detail[j]);
+        if (r)
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
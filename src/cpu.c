@@ -5,10 +5,17 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#ifdef PROFILE
+#include "profile.h"
+#endif
+#ifdef HEATMAP
+#include "heatmap.h"
+#endif
+
 //externally supplied functions
 extern uint8_t read6502(uint16_t address);
 extern void write6502(uint16_t address, uint8_t value);
-extern uint8_t irq_triggered;  // Flag to avoid multiple IRQs
+extern EMU_TLS uint8_t irq_triggered;  // Flag to avoid multiple IRQs
 
 //6502 defines
 #define UNDOCUMENTED //when this is defined, undocumented opcodes are handled.
@@ -71,16 +78,16 @@ extern uint8_t irq_triggered;  // Flag to avoid multiple IRQs
 
 
 //6502 CPU registers
-uint16_t pc;
-uint16_t oldpc;
-uint8_t sp, a, x, y, status = FLAG_CONSTANT;
+EMU_TLS uint16_t pc;
+EMU_TLS uint16_t oldpc;
+EMU_TLS uint8_t sp, a, x, y, status = FLAG_CONSTANT;
 
 
 //helper variables
-uint64_t instructions = 0; //keep track of total instructions executed
-uint32_t clockticks6502 = 0, clockgoal6502 = 0;
-uint16_t oldpc, ea, reladdr, value, result;
-uint8_t opcode, oldstatus;
+EMU_TLS uint64_t instructions = 0; //keep track of total instructions executed
+EMU_TLS uint32_t clockticks6502 = 0, clockgoal6502 = 0;
+EMU_TLS uint16_t oldpc, ea, reladdr, value, result;
+EMU_TLS uint8_t opcode, oldstatus;
 
 //a few general functions used by various other functions
 static inline void push16(uint16_t pushval) {
@@ -127,7 +134,7 @@ void reset6502_fast() {
 
 static void (*addrtable[256])();
 static void (*optable[256])();
-uint8_t penaltyop, penaltyaddr;
+EMU_TLS uint8_t penaltyop, penaltyaddr;
 
 //addressing mode functions, calculates effective addresses
 static inline void imp() { //implied
@@ -694,6 +701,22 @@ static void tya() {
     signcalc(a);
 }
 
+//host traps: opcode $02 (JAM) is planted at trap addresses in the ROM image.
+//the hook returns -1 when the host handled the call, otherwise the opcode
+//that was replaced, which is then executed in its place.
+int (*traphook6502)(uint16_t address) = NULL;
+
+static void jam() {
+    int op;
+
+    if (traphook6502 == NULL) return; //no traps: behaves as the NOP it always was
+    op = (*traphook6502)(pc - 1);
+    if (op < 0) return;
+    opcode = (uint8_t)op;
+    (*addrtable[opcode])();
+    (*optable[opcode])();
+}
+
 //undocumented instructions
 #ifdef UNDOCUMENTED
     static void lax() {
@@ -777,7 +800,7 @@ static void (*addrtable[256])() = {
 
 static void (*optable[256])() = {
 /*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |      */
-/* 0 */      brk,  ora,  nop,  slo,  nop,  ora,  asl,  slo,  php,  ora,  asl,  nop,  nop,  ora,  asl,  slo, /* 0 */
+/* 0 */      brk,  ora,  jam,  slo,  nop,  ora,  asl,  slo,  php,  ora,  asl,  nop,  nop,  ora,  asl,  slo, /* 0 */
 /* 1 */      bpl,  ora,  nop,  slo,  nop,  ora,  asl,  slo,  clc,  ora,  nop,  slo,  nop,  ora,  asl,  slo, /* 1 */
 /* 2 */      jsr,  and,  nop,  rla,  bit,  and,  rol,  rla,  plp,  and,  rol,  nop,  bit,  and,  rol,  rla, /* 2 */
 /* 3 */      bmi,  and,  nop,  rla,  nop,  and,  rol,  rla,  sec,  and,  nop,  rla,  nop,  and,  rol,  rla, /* 3 */
@@ -821,6 +844,9 @@ void nmi6502() {
     push8(status);
     status |= FLAG_INTERRUPT;
     pc = (uint16_t)read6502(0xFFFA) | ((uint16_t)read6502(0xFFFB) << 8);
+#ifdef PROFILE
+    if (profile_on) profile_interrupt();
+#endif
 }
 
 void irq6502() {
@@ -829,16 +855,25 @@ void irq6502() {
     //status |= FLAG_INTERRUPT;
     setinterrupt();
     pc = (uint16_t)read6502(0xFFFE) | ((uint16_t)read6502(0xFFFF) << 8);
+#ifdef PROFILE
+    if (profile_on) profile_interrupt();
+#endif
 }
 
-uint8_t callexternal = 0;
-void (*loopexternal)();
+EMU_TLS uint8_t callexternal = 0;
+EMU_TLS void (*loopexternal)();
 
 void exec6502(uint32_t tickcount) {
     clockgoal6502 += tickcount;
 
     while (clockticks6502 < clockgoal6502) {
+#ifdef HEATMAP
+        heat_kind = HEAT_FETCH;
         opcode = read6502(pc++);
+        heat_kind = HEAT_READ;
+#else
+        opcode = read6502(pc++);
+#endif
 
         penaltyop = 0;
         penaltyaddr = 0;
@@ -856,8 +891,17 @@ void exec6502(uint32_t tickcount) {
 }
 
 void step6502() {
+#ifdef PROFILE
+    uint32_t start = clockticks6502;
+#endif
     oldpc = pc;
+#ifdef HEATMAP
+    heat_kind = HEAT_FETCH;
+    opcode = read6502(pc++);
+    heat_kind = HEAT_READ;
+#else
     opcode = read6502(pc++);
+#endif
 
     penaltyop = 0;
     penaltyaddr = 0;
@@ -870,6 +914,14 @@ void step6502() {
 
     instructions++;
 
+#ifdef PROFILE
+    if (profile_on) {
+        profile_left -= (int32_t)(clockticks6502 - start);
+        if (profile_left <= 0 || profile_stack_ops[opcode])
+            profile_step(oldpc, opcode, clockticks6502 - start);
+    }
+#endif
+
     if (callexternal) (*loopexternal)();
 }
 
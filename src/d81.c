@@ -0,0 +1,438 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "mapfile.h"
+#include "drive.h"
+#include "d81.h"
+
+// 1581 disk image backend.  The image is mapped read-only; at mount time
+// the directory is parsed and every file's sector chain is resolved into a
+// flat list, so reads copy sector payloads straight out of the mapping
+// without walking track/sector links.  Written sectors live in a
+// write-back cache and go to the file on flush.
+
+#define HANDLES         16
+#define LINK_MAX        D81_BLOCKS
+
+struct d81_file {
+    uint16_t dir_lba;           // directory sector holding the entry
+    uint8_t  dir_slot;
+    uint32_t chain;             // first index into chain_pool
+    uint16_t length;            // sectors in the chain
+};
+
+struct d81_handle {
+    uint8_t  used;
+    uint8_t  write;
+    uint16_t file;              // index into files[] when reading
+    uint16_t link;              // position in the chain
+    uint16_t offset;            // bytes consumed in the current sector
+    // writing
+    char     name[DRIVE_NAME_MAX + 1];
+    uint8_t  type;
+    uint16_t first_lba, cur_lba, blocks;
+};
+
+static struct {
+    struct mapped_file map;
+    const char *path;
+    uint8_t *cache[D81_BLOCKS];     // written sectors, NULL = mapping
+    uint8_t  modified[D81_BLOCKS];
+    uint16_t chain_pool[LINK_MAX];
+    uint32_t pool_used;
+    struct d81_file files[DRIVE_DIR_MAX];
+    struct drive_dirent entries[DRIVE_DIR_MAX];
+    struct drive_dir dir;
+    struct d81_handle handles[HANDLES];
+} disk;
+
+static uint16_t lba(uint8_t track, uint8_t sector)
+{
+    return (uint16_t)((track - 1) * D81_SECTORS + sector);
+}
+
+static int valid(uint8_t track, uint8_t sector)
+{
+    return track >= 1 && track <= D81_TRACKS && sector < D81_SECTORS;
+}
+
+static const uint8_t *sector(uint16_t n)
+{
+    return disk.cache[n] ? disk.cache[n] : disk.map.data + (long)n * 256;
+}
+
+static uint8_t *sector_w(uint16_t n)
+{
+    if (!disk.cache[n]) {
+        disk.cache[n] = malloc(256);
+        if (!disk.cache[n])
+            return NULL;
+        memcpy(disk.cache[n], disk.map.data + (long)n * 256, 256);
+    }
+    disk.modified[n] = 1;
+    return disk.cache[n];
+}
+
+// 0xA0-padded PETSCII field to a C string
+static void unpad(char *out, const uint8_t *in, int len)
+{
+    int n = 0;
+
+    while (n < len && in[n] != 0xA0) {
+        out[n] = (char)in[n];
+        n++;
+    }
+    out[n] = 0;
+}
+
+// ── BAM: 40/1 covers tracks 1-40, 40/2 tracks 41-80 ─────────────
+static uint8_t *bam_entry(uint8_t track, int write)
+{
+    uint16_t n = lba(D81_DIR_TRACK, track <= 40 ? 1 : 2);
+    uint16_t off = 0x10 + ((track - 1) % 40) * 6;
+
+    return write ? sector_w(n) + off : (uint8_t *)sector(n) + off;
+}
+
+static int bam_is_free(uint8_t track, uint8_t s)
+{
+    return (bam_entry(track, 0)[1 + s / 8] >> (s % 8)) & 1;
+}
+
+static void bam_set(uint8_t track, uint8_t s, int free)
+{
+    uint8_t *e = bam_entry(track, 1);
+    uint8_t bit = (uint8_t)(1 << (s % 8));
+
+    if (free && !(e[1 + s / 8] & bit)) {
+        e[1 + s / 8] |= bit;
+        e[0]++;
+    } else if (!free && (e[1 + s / 8] & bit)) {
+        e[1 + s / 8] &= (uint8_t)~bit;
+        e[0]--;
+    }
+}
+
+// Like the 1581, fill outward from the directory track
+static int bam_alloc(uint16_t *out)
+{
+    int d, s;
+
+    for (d = 1; d < D81_TRACKS; d++) {
+        int tracks[2] = { D81_DIR_TRACK - d, D81_DIR_TRACK + d };
+        int i;
+
+        for (i = 0; i < 2; i++) {
+            uint8_t t = (uint8_t)tracks[i];
+            if (t < 1 || t > D81_TRACKS || bam_entry(t, 0)[0] == 0)
+                continue;
+            for (s = 0; s < D81_SECTORS; s++) {
+                if (bam_is_free(t, (uint8_t)s)) {
+                    bam_set(t, (uint8_t)s, 0);
+                    *out = lba(t, (uint8_t)s);
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+// ── index of directory and sector chains, rebuilt after writes ─
+static void build_index(void)
+{
+    const uint8_t *hdr = sector(lba(D81_DIR_TRACK, 0));
+    uint8_t t = hdr[0], s = hdr[1];
+    uint16_t dir_sectors = 0, i;
+
+    unpad(disk.dir.title, hdr + 0x04, 16);
+    memcpy(disk.dir.id, hdr + 0x16, 5);
+    for (i = 0; i < 5; i++) {
+        if ((uint8_t)disk.dir.id[i] == 0xA0)
+            disk.dir.id[i] = ' ';
+    }
+    disk.dir.id[5] = 0;
+    disk.dir.entries = disk.entries;
+    disk.dir.count = 0;
+    disk.pool_used = 0;
+
+    while (valid(t, s) && dir_sectors++ < D81_SECTORS && disk.dir.count < DRIVE_DIR_MAX) {
+        uint16_t n = lba(t, s);
+        const uint8_t *d = sector(n);
+        uint8_t slot;
+
+        for (slot = 0; slot < 8 && disk.dir.count < DRIVE_DIR_MAX; slot++) {
+            const uint8_t *e = d + slot * 32;
+            struct drive_dirent *de = &disk.entries[disk.dir.count];
+            struct d81_file *f = &disk.files[disk.dir.count];
+            uint8_t ft = e[3], fs = e[4];
+
+            if (e[2] == 0)
+                continue;
+            unpad(de->name, e + 5, 16);
+            de->type   = (e[2] & 0x07) | 0x80;
+            de->blocks = e[30] | (e[31] << 8);
+            f->dir_lba  = n;
+            f->dir_slot = slot;
+            f->chain    = disk.pool_used;
+            f->length   = 0;
+            while (valid(ft, fs) && disk.pool_used < LINK_MAX && f->length < D81_BLOCKS) {
+                const uint8_t *p = sector(lba(ft, fs));
+                disk.chain_pool[disk.pool_used++] = lba(ft, fs);
+                f->length++;
+                if (p[0] == 0)
+                    break;
+                ft = p[0];
+                fs = p[1];
+            }
+            disk.dir.count++;
+        }
+        t = d[0];
+        s = d[1];
+    }
+
+    disk.dir.blocks_free = 0;
+    for (t = 1; t <= D81_TRACKS; t++) {
+        if (t != D81_DIR_TRACK)
+            disk.dir.blocks_free += bam_entry(t, 0)[0];
+    }
+}
+
+// Mark a file's sectors free again and clear its directory slot
+static void scratch(uint16_t index)
+{
+    struct d81_file *f = &disk.files[index];
+    uint16_t i;
+
+    for (i = 0; i < f->length; i++) {
+        uint16_t n = disk.chain_pool[f->chain + i];
+        bam_set((uint8_t)(n / D81_SECTORS + 1), (uint8_t)(n % D81_SECTORS), 1);
+    }
+    sector_w(f->dir_lba)[f->dir_slot * 32 + 2] = 0;
+}
+
+// Free directory slot, extending the directory on track 40 if needed
+static uint8_t *dir_slot(void)
+{
+    const uint8_t *hdr = sector(lba(D81_DIR_TRACK, 0));
+    uint8_t t = hdr[0], s = hdr[1], slot;
+    uint16_t last = 0;
+    uint8_t ns;
+
+    while (valid(t, s)) {
+        const uint8_t *d = sector(lba(t, s));
+        for (slot = 0; slot < 8; slot++) {
+            if (d[slot * 32 + 2] == 0)
+                return sector_w(lba(t, s)) + slot * 32;
+        }
+        last = lba(t, s);
+        t = d[0];
+        s = d[1];
+    }
+
+    for (ns = 3; ns < D81_SECTORS; ns++) {
+        if (bam_is_free(D81_DIR_TRACK, ns)) {
+            uint8_t *d = sector_w(lba(D81_DIR_TRACK, ns));
+            uint8_t *prev = sector_w(last);
+
+            bam_set(D81_DIR_TRACK, ns, 0);
+            memset(d, 0, 256);
+            d[1] = 0xFF;
+            prev[0] = D81_DIR_TRACK;
+            prev[1] = ns;
+            return d;
+        }
+    }
+    return NULL;
+}
+
+// ── drive_ops ───────────────────────────────────────────────────
+static int d81_dir(void *ctx, const struct drive_dir **dir)
+{
+    (void)ctx;
+    *dir = &disk.dir;
+    return 0;
+}
+
+static int d81_open(void *ctx, const char *name, uint8_t type, int write)
+{
+    struct d81_handle *h = NULL;
+    uint16_t i;
+    int n;
+
+    (void)ctx;
+    for (n = 0; n < HANDLES; n++) {
+        if (!disk.handles[n].used) {
+            h = &disk.handles[n];
+            break;
+        }
+    }
+    if (!h)
+        return -1;
+    memset(h, 0, sizeof(*h));
+
+    for (i = 0; i < disk.dir.count; i++) {
+        if (disk.entries[i].type != DRIVE_DEL && !strcmp(disk.entries[i].name, name))
+            break;
+    }
+
+    if (!write) {
+        if (i == disk.dir.count)
+            return -1;
+        h->file = i;
+    } else {
+        if (i < disk.dir.count) {
+            scratch(i);                 // "@0:", drive.c refuses it otherwise
+            build_index();
+        }
+        strcpy(h->name, name);
+        h->type = type;
+    }
+    h->used  = 1;
+    h->write = (uint8_t)write;
+    return n;
+}
+
+static long d81_read(void *ctx, int handle, uint8_t *dst, long len)
+{
+    struct d81_handle *h = &disk.handles[handle];
+    struct d81_file *f = &disk.files[h->file];
+    long done = 0;
+
+    (void)ctx;
+    while (done < len && h->link < f->length) {
+        const uint8_t *p = sector(disk.chain_pool[f->chain + h->link]);
+        uint16_t avail = (p[0] == 0 ? (p[1] >= 1 ? p[1] - 1 : 0) : 254) - h->offset;
+        uint16_t n = (long)avail > len - done ? (uint16_t)(len - done) : avail;
+
+        memcpy(dst + done, p + 2 + h->offset, n);
+        done += n;
+        h->offset += n;
+        if (n == avail) {
+            h->link++;
+            h->offset = 0;
+        }
+    }
+    return done;
+}
+
+static long d81_write(void *ctx, int handle, const uint8_t *src, long len)
+{
+    struct d81_handle *h = &disk.handles[handle];
+    long done = 0;
+
+    (void)ctx;
+    while (done < len) {
+        uint8_t *p;
+        uint16_t n;
+
+        if (h->blocks == 0 || h->offset == 254) {
+            uint16_t next;
+            if (bam_alloc(&next) != 0)
+                return done;
+            p = sector_w(next);
+            memset(p, 0, 256);
+            p[1] = 1;
+            if (h->blocks == 0) {
+                h->first_lba = next;
+            } else {
+                uint8_t *prev = sector_w(h->cur_lba);
+                prev[0] = (uint8_t)(next / D81_SECTORS + 1);
+                prev[1] = (uint8_t)(next % D81_SECTORS);
+            }
+            h->cur_lba = next;
+            h->offset  = 0;
+            h->blocks++;
+        }
+        p = sector_w(h->cur_lba);
+        n = 254 - h->offset;
+        if ((long)n > len - done)
+            n = (uint16_t)(len - done);
+        memcpy(p + 2 + h->offset, src + done, n);
+        h->offset += n;
+        p[1] = (uint8_t)(h->offset + 1);
+        done += n;
+    }
+    return done;
+}
+
+static void d81_close(void *ctx, int handle)
+{
+    struct d81_handle *h = &disk.handles[handle];
+    uint8_t *e;
+
+    (void)ctx;
+    if (h->write) {
+        // an empty file still gets one sector holding no data
+        if (h->blocks == 0 && bam_alloc(&h->first_lba) == 0) {
+            uint8_t *p = sector_w(h->first_lba);
+            memset(p, 0, 256);
+            p[1] = 1;
+            h->blocks = 1;
+        }
+        e = dir_slot();
+        if (e && h->blocks) {
+            e[2] = h->type | 0x80;      // closed
+            e[3] = (uint8_t)(h->first_lba / D81_SECTORS + 1);
+            e[4] = (uint8_t)(h->first_lba % D81_SECTORS);
+            memset(e + 5, 0xA0, 16);
+            memcpy(e + 5, h->name, strlen(h->name));
+            memset(e + 21, 0, 9);
+            e[30] = h->blocks & 0xFF;
+            e[31] = h->blocks >> 8;
+        }
+        build_index();
+    }
+    h->used = 0;
+}
+
+void d81_flush(void)
+{
+    FILE *f = NULL;
+    uint16_t n;
+
+    for (n = 0; n < D81_BLOCKS; n++) {
+        if (!disk.modified[n])
+            continue;
+        if (!f && (f = fopen(disk.path, "r+b")) == NULL) {
+            platform_msg("d81: cannot write %s\n", disk.path);
+            return;
+        }
+        fseek(f, (long)n * 256, SEEK_SET);
+        fwrite(disk.cache[n], 1, 256, f);
+        disk.modified[n] = 0;
+    }
+    if (f)
+        fclose(f);
+}
+
+static void d81_flush_op(void *ctx)
+{
+    (void)ctx;
+    d81_flush();
+}
+
+static const struct drive_ops d81_ops = {
+    d81_dir, d81_open, d81_read, d81_write, d81_close, d81_flush_op
+};
+
+int d81_mount(uint8_t device, const char *path)
+{
+#ifndef __linux__
+    // 800 KB never fits the heap map_file() reads into
+    (void)device;
+    platform_msg("d81: %s: D81 images need a Linux host\n", path);
+    return -1;
+#endif
+    if (map_file(path, &disk.map, 0) != 0 || disk.map.size < (size_t)D81_SIZE) {
+        platform_msg("d81: %s is not a D81 image\n", path);
+        unmap_file(&disk.map);
+        return -1;
+    }
+    disk.path = path;
+    build_index();
+    return drive_attach(device, &d81_ops, NULL);
+}
@@ -0,0 +1,15 @@
+#ifndef __D81_H
+#define __D81_H
+
+#include <stdint.h>
+
+#define D81_TRACKS              80
+#define D81_SECTORS             40
+#define D81_BLOCKS              (D81_TRACKS * D81_SECTORS)
+#define D81_SIZE                ((long)D81_BLOCKS * 256)
+#define D81_DIR_TRACK           40
+
+int  d81_mount(uint8_t device, const char *path);
+void d81_flush(void);
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "trap.h"
+#include "diff.h"
+#include "trace.h"
+
+// Each instruction runs twice.  The candidate engine goes first with its
+// RAM writes logged; then the writes are undone, the CPU and chip state
+// is put back and the reference step6502() runs the same instruction.
+// Registers, flags, cycles, chip state and the writes (address, value,
+// order) must agree.  The per-instruction tick (raster, CIAs, IRQs) is
+// machine behaviour, not the engine's: it is held off for both runs and
+// called once afterwards, as step6502() would have.
+//
+// Trap opcodes only run on the reference, their handlers do host I/O.
+
+extern EMU_TLS uint8_t callexternal;
+extern EMU_TLS void (*loopexternal)();
+uint8_t read6502(uint16_t address);
+void step6502(void);
+void exec6502(uint32_t tickcount);
+
+struct side {
+    struct emu_state s;
+    uint8_t  nwrites;           // may exceed DIFF_WRITES_MAX, then undo fails
+    uint16_t addr[DIFF_WRITES_MAX];
+    uint8_t  value[DIFF_WRITES_MAX];
+    uint8_t  old[DIFF_WRITES_MAX];
+};
+
+struct engine {
+    const char *name;
+    void (*run)(void);          // exactly one instruction, no external tick
+};
+
+struct step {
+    uint16_t pc;
+    uint8_t  opcode, a, x, y, sp, status;
+    uint32_t clockticks;
+};
+
+// exec6502() runs until the clock goal, which emu_set_state() leaves at
+// clockticks6502: one cycle ahead means one instruction
+static void run_exec(void)
+{
+    exec6502(1);
+}
+
+static const struct engine engines[] = {
+    { "exec", run_exec },
+};
+#define ENGINES         (sizeof(engines) / sizeof(engines[0]))
+
+uint8_t diff_logging = 0;
+
+static const struct engine *candidate;
+static struct side cand, ref, *logging_to;
+static struct emu_state before;
+static uint8_t vic_page[256];           // read6502 clears $D019 without a write
+static struct step history[DIFF_HISTORY];
+static uint32_t history_n;
+static uint64_t checked;
+
+int diff_start(const char *engine)
+{
+    unsigned i;
+
+    for (i = 0; i < ENGINES; i++) {
+        if (!strcmp(engines[i].name, engine)) {
+            candidate = &engines[i];
+            return 0;
+        }
+    }
+    platform_msg("diff: unknown engine %s, have:", engine);
+    for (i = 0; i < ENGINES; i++)
+        platform_msg(" %s", engines[i].name);
+    platform_msg("\n");
+    return -1;
+}
+
+// Called by write6502 before the store, so ram[] still holds the old value
+void diff_log_write(uint16_t address, uint8_t value)
+{
+    struct side *d = logging_to;
+
+    if (d->nwrites < DIFF_WRITES_MAX) {
+        d->addr[d->nwrites]  = address;
+        d->value[d->nwrites] = value;
+        d->old[d->nwrites]   = ram[address];
+    }
+    d->nwrites++;
+}
+
+static void undo(const struct side *d)
+{
+    int i;
+
+    for (i = (int)d->nwrites - 1; i >= 0; i--)
+        ram[d->addr[i]] = d->old[i];
+}
+
+static void get_state(struct emu_state *s)
+{
+    memset(s, 0, sizeof(*s));           // padding too, the states are memcmp'd
+    emu_get_state(s);
+}
+
+static void show_regs(const char *name, const struct emu_state *s, uint8_t nwrites)
+{
+    platform_msg("%-8s %04X  %02X %02X %02X  %02X  %02X  %10lu  %u\n", name, s->pc, s->a, s->x,
+                 s->y, s->sp, s->status, (unsigned long)s->clockticks, nwrites);
+}
+
+static void show_writes(const char *name, const struct side *d)
+{
+    unsigned i;
+
+    platform_msg("%-8s", name);
+    for (i = 0; i < d->nwrites && i < DIFF_WRITES_MAX; i++)
+        platform_msg(" $%04X=$%02X", d->addr[i], d->value[i]);
+    platform_msg("%s\n", d->nwrites ? "" : " no writes");
+}
+
+static void mismatch(const char *why)
+{
+    uint32_t i, n = history_n < DIFF_HISTORY ? history_n : DIFF_HISTORY;
+
+    platform_msg("diff: %s after %llu instructions (%s vs step)\n", why,
+                 (unsigned long long)checked, candidate->name);
+    platform_msg("%-8s %-4s  A  X  Y   SP  P       cycles  writes\n", "", "PC");
+    show_regs("before", &before, 0);
+    show_regs(candidate->name, &cand.s, cand.nwrites);
+    show_regs("step", &ref.s, ref.nwrites);
+    show_writes(candidate->name, &cand);
+    show_writes("step", &ref);
+    if (memcmp(cand.s.vic, ref.s.vic, sizeof(ref.s.vic)) ||
+        cand.s.cia1_ifr != ref.s.cia1_ifr || cand.s.cia1_timer != ref.s.cia1_timer ||
+        cand.s.irq_triggered != ref.s.irq_triggered)
+        platform_msg("chip state differs (VIC, CIA or IRQ latch)\n");
+
+    platform_msg("history, oldest first:\n");
+    for (i = history_n - n; i < history_n; i++) {
+        const struct step *h = &history[i % DIFF_HISTORY];
+        platform_msg("  %04X  %02X   A=%02X X=%02X Y=%02X SP=%02X P=%02X  %lu\n", h->pc, h->opcode,
+                     h->a, h->x, h->y, h->sp, h->status, (unsigned long)h->clockticks);
+    }
+    if (trace_on)
+        trace_dump();
+    exit(2);
+}
+
+void diff_step(void)
+{
+    uint8_t hook = callexternal;
+    uint8_t opcode = emu_peek(pc);      // no watchpoints, heat or I/O reads
+    struct step *h;
+
+    if (opcode == TRAP_OPCODE) {
+        step6502();
+        return;
+    }
+
+    h = &history[history_n++ % DIFF_HISTORY];
+    h->pc = pc; h->opcode = opcode;
+    h->a = a; h->x = x; h->y = y; h->sp = sp; h->status = status;
+    h->clockticks = clockticks6502;
+
+    get_state(&before);
+    emu_ram_read(vic_page, 0xD000, sizeof(vic_page));
+    callexternal = 0;
+    diff_logging = 1;
+
+    cand.nwrites = 0;
+    logging_to = &cand;
+    candidate->run();
+    get_state(&cand.s);
+
+    if (cand.nwrites > DIFF_WRITES_MAX)
+        mismatch("too many writes to undo");
+    undo(&cand);
+    emu_ram_write(0xD000, vic_page, sizeof(vic_page));
+    emu_set_state(&before);
+
+    ref.nwrites = 0;
+    logging_to = &ref;
+    step6502();
+    get_state(&ref.s);
+
+    diff_logging = 0;
+    callexternal = hook;
+
+    if (memcmp(&cand.s, &ref.s, sizeof(ref.s)) != 0)
+        mismatch("state differs");
+    if (cand.nwrites != ref.nwrites ||
+        memcmp(cand.addr, ref.addr, ref.nwrites * sizeof(ref.addr[0])) ||
+        memcmp(cand.value, ref.value, ref.nwrites))
+        mismatch("writes differ");
+    checked++;
+
+    if (callexternal)
+        (*loopexternal)();
+}
@@ -0,0 +1,19 @@
+#ifndef __DIFF_H
+#define __DIFF_H
+
+#include <stdint.h>
+
+// Lockstep differential execution: every instruction runs on a candidate
+// engine and on the reference step6502() from the same state, and the
+// emulator stops at the first difference.
+
+#define DIFF_HISTORY            32      // instructions shown on a mismatch
+#define DIFF_WRITES_MAX         8       // per instruction, BRK pushes 3
+
+extern uint8_t diff_logging;            // write6502 reports to diff_log_write()
+
+int  diff_start(const char *engine);
+void diff_log_write(uint16_t address, uint8_t value);
+void diff_step(void);
+
+#endif
@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "disasm.h"
+
+enum { IMP, ACC, IMM, ZP, ZPX, ZPY, REL, ABS, ABX, ABY, IND, IZX, IZY };
+
+static const uint8_t lengths[] = {
+    1, 1, 2, 2, 2, 2, 2, 3, 3, 3, 3, 2, 2,
+};
+
+static const char mnemonic[256][4] = {
+/*          |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |      */
+/* 0 */     "brk", "ora", "jam", "slo", "nop", "ora", "asl", "slo", "php", "ora", "asl", "anc", "nop", "ora", "asl", "slo", /* 0 */
+/* 1 */     "bpl", "ora", "jam", "slo", "nop", "ora", "asl", "slo", "clc", "ora", "nop", "slo", "nop", "ora", "asl", "slo", /* 1 */
+/* 2 */     "jsr", "and", "jam", "rla", "bit", "and", "rol", "rla", "plp", "and", "rol", "anc", "bit", "and", "rol", "rla", /* 2 */
+/* 3 */     "bmi", "and", "jam", "rla", "nop", "and", "rol", "rla", "sec", "and", "nop", "rla", "nop", "and", "rol", "rla", /* 3 */
+/* 4 */     "rti", "eor", "jam", "sre", "nop", "eor", "lsr", "sre", "pha", "eor", "lsr", "alr", "jmp", "eor", "lsr", "sre", /* 4 */
+/* 5 */     "bvc", "eor", "jam", "sre", "nop", "eor", "lsr", "sre", "cli", "eor", "nop", "sre", "nop", "eor", "lsr", "sre", /* 5 */
+/* 6 */     "rts", "adc", "jam", "rra", "nop", "adc", "ror", "rra", "pla", "adc", "ror", "arr", "jmp", "adc", "ror", "rra", /* 6 */
+/* 7 */     "bvs", "adc", "jam", "rra", "nop", "adc", "ror", "rra", "sei", "adc", "nop", "rra", "nop", "adc", "ror", "rra", /* 7 */
+/* 8 */     "nop", "sta", "nop", "sax", "sty", "sta", "stx", "sax", "dey", "nop", "txa", "xaa", "sty", "sta", "stx", "sax", /* 8 */
+/* 9 */     "bcc", "sta", "jam", "sha", "sty", "sta", "stx", "sax", "tya", "sta", "txs", "tas", "shy", "sta", "shx", "sha", /* 9 */
+/* A */     "ldy", "lda", "ldx", "lax", "ldy", "lda", "ldx", "lax", "tay", "lda", "tax", "lxa", "ldy", "lda", "ldx", "lax", /* A */
+/* B */     "bcs", "lda", "jam", "lax", "ldy", "lda", "ldx", "lax", "clv", "lda", "tsx", "las", "ldy", "lda", "ldx", "lax", /* B */
+/* C */     "cpy", "cmp", "nop", "dcp", "cpy", "cmp", "dec", "dcp", "iny", "cmp", "dex", "axs", "cpy", "cmp", "dec", "dcp", /* C */
+/* D */     "bne", "cmp", "jam", "dcp", "nop", "cmp", "dec", "dcp", "cld", "cmp", "nop", "dcp", "nop", "cmp", "dec", "dcp", /* D */
+/* E */     "cpx", "sbc", "nop", "isb", "cpx", "sbc", "inc", "isb", "inx", "sbc", "nop", "sbc", "cpx", "sbc", "inc", "isb", /* E */
+/* F */     "beq", "sbc", "jam", "isb", "nop", "sbc", "inc", "isb", "sed", "sbc", "nop", "isb", "nop", "sbc", "inc", "isb"  /* F */
+};
+
+static const uint8_t mode[256] = {
+/*        |  0  |  1  |  2  |  3  |  4  |  5  |  6  |  7  |  8  |  9  |  A  |  B  |  C  |  D  |  E  |  F  |      */
+/* 0 */      IMP,  IZX,  IMP,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  ACC,  IMM,  ABS,  ABS,  ABS,  ABS, /* 0 */
+/* 1 */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPX,  ZPX,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABX,  ABX, /* 1 */
+/* 2 */      ABS,  IZX,  IMP,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  ACC,  IMM,  ABS,  ABS,  ABS,  ABS, /* 2 */
+/* 3 */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPX,  ZPX,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABX,  ABX, /* 3 */
+/* 4 */      IMP,  IZX,  IMP,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  ACC,  IMM,  ABS,  ABS,  ABS,  ABS, /* 4 */
+/* 5 */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPX,  ZPX,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABX,  ABX, /* 5 */
+/* 6 */      IMP,  IZX,  IMP,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  ACC,  IMM,  IND,  ABS,  ABS,  ABS, /* 6 */
+/* 7 */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPX,  ZPX,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABX,  ABX, /* 7 */
+/* 8 */      IMM,  IZX,  IMM,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  IMP,  IMM,  ABS,  ABS,  ABS,  ABS, /* 8 */
+/* 9 */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPY,  ZPY,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABY,  ABY, /* 9 */
+/* A */      IMM,  IZX,  IMM,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  IMP,  IMM,  ABS,  ABS,  ABS,  ABS, /* A */
+/* B */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPY,  ZPY,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABY,  ABY, /* B */
+/* C */      IMM,  IZX,  IMM,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  IMP,  IMM,  ABS,  ABS,  ABS,  ABS, /* C */
+/* D */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPX,  ZPX,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABX,  ABX, /* D */
+/* E */      IMM,  IZX,  IMM,  IZX,   ZP,   ZP,   ZP,   ZP,  IMP,  IMM,  IMP,  IMM,  ABS,  ABS,  ABS,  ABS, /* E */
+/* F */      REL,  IZY,  IMP,  IZY,  ZPX,  ZPX,  ZPX,  ZPX,  IMP,  ABY,  IMP,  ABY,  ABX,  ABX,  ABX,  ABX  /* F */
+};
+
+uint8_t disasm_length(uint8_t opcode)
+{
+    return lengths[mode[opcode]];
+}
+
+// bytes holds three bytes from address, only the instruction's are used
+void disasm(char *out, uint16_t address, const uint8_t *bytes)
+{
+    const char *m = mnemonic[bytes[0]];
+    uint8_t  lo   = bytes[1];
+    uint16_t word = bytes[1] | (bytes[2] << 8);
+
+    switch (mode[bytes[0]]) {
+        case IMP: sprintf(out, "%s", m);                      break;
+        case ACC: sprintf(out, "%s a", m);                    break;
+        case IMM: sprintf(out, "%s #$%02X", m, lo);           break;
+        case ZP:  sprintf(out, "%s $%02X", m, lo);            break;
+        case ZPX: sprintf(out, "%s $%02X,x", m, lo);          break;
+        case ZPY: sprintf(out, "%s $%02X,y", m, lo);          break;
+        case REL: sprintf(out, "%s $%04X", m, (uint16_t)(address + 2 + (int8_t)lo)); break;
+        case ABS: sprintf(out, "%s $%04X", m, word);          break;
+        case ABX: sprintf(out, "%s $%04X,x", m, word);        break;
+        case ABY: sprintf(out, "%s $%04X,y", m, word);        break;
+        case IND: sprintf(out, "%s ($%04X)", m, word);        break;
+        case IZX: sprintf(out, "%s ($%02X,x)", m, lo);        break;
+        case IZY: sprintf(out, "%s ($%02X),y", m, lo);        break;
+    }
+}
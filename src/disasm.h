@@ -0,0 +1,14 @@
+#ifndef __DISASM_H
+#define __DISASM_H
+
+#include <stdint.h>
+
+// One-line 6502 disassembler, opcodes named the way cpu.c executes them
+// (undocumented ones it treats as NOP show as nop).
+
+#define DISASM_MAX              16      // "lda ($12),y" and the like
+
+uint8_t disasm_length(uint8_t opcode);
+void    disasm(char *out, uint16_t address, const uint8_t *bytes);
+
+#endif
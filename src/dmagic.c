@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "platform.h"
+#include "dmagic.h"
+
+// lcopy/lfill keep one prepared job each and only patch addresses and
+// count, the option list and command never change.  A job moves at most
+// 64 KB (count 0), so longer ranges go as several jobs, one after the
+// other; a count of 0 does nothing.
+
+#define JOB_MAX                 0x10000UL
+
+static uint8_t copy_job[DMAGIC_JOB_SIZE] = DMAGIC_JOB(DMAGIC_COPY);
+static uint8_t fill_job[DMAGIC_JOB_SIZE] = DMAGIC_JOB(DMAGIC_FILL);
+static uint8_t skip_job[DMAGIC_JOB_SIZE] = DMAGIC_JOB(DMAGIC_FILL);
+
+void lcopy(uint32_t source_address, uint32_t destination_address, size_t count)
+{
+    size_t n;
+
+    // User should provide 28-bit address for IO
+    // (otherwise we can't DMA to/from RAM under IO)
+    while (count) {
+        n = count < JOB_MAX ? count : JOB_MAX;
+        dmagic_set_source(copy_job, source_address);
+        dmagic_set_dest(copy_job, destination_address);
+        dmagic_set_count(copy_job, (uint16_t)n);       // 64 KB is 0
+        dmagic_trigger(copy_job);
+        source_address += n;
+        destination_address += n;
+        count -= n;
+    }
+}
+
+void lfill(uint32_t destination_address, uint8_t value, size_t count)
+{
+    size_t n;
+
+    fill_job[DMAGIC_SRC] = value;
+    while (count) {
+        n = count < JOB_MAX ? count : JOB_MAX;
+        dmagic_set_dest(fill_job, destination_address);
+        dmagic_set_count(fill_job, (uint16_t)n);
+        dmagic_trigger(fill_job);
+        destination_address += n;
+        count -= n;
+    }
+}
+
+void lfill_skip(uint32_t destination_address, uint8_t value, size_t count, uint8_t skip)
+{
+    size_t n;
+
+    skip_job[DMAGIC_SRC] = value;
+    skip_job[DMAGIC_DST_SKIP] = skip;
+    while (count) {
+        n = count < JOB_MAX ? count : JOB_MAX;
+        dmagic_set_dest(skip_job, destination_address);
+        dmagic_set_count(skip_job, (uint16_t)n);
+        dmagic_trigger(skip_job);
+        destination_address += (uint32_t)n * skip;
+        count -= n;
+    }
+}
+
+// ── batches ─────────────────────────────────────────
+
+void dmagic_batch_begin(struct dmagic_batch *b)
+{
+    b->jobs = 0;
+}
+
+static uint8_t *batch_add(struct dmagic_batch *b, uint8_t command)
+{
+    static const uint8_t blank[DMAGIC_JOB_SIZE] = DMAGIC_JOB(0);
+    uint8_t *job;
+
+    if (b->jobs == DMAGIC_BATCH_MAX)
+        return NULL;
+    if (b->jobs)
+        dmagic_batch_job(b, b->jobs - 1)[DMAGIC_CMD] |= DMAGIC_CHAIN;
+    job = dmagic_batch_job(b, b->jobs++);
+    memcpy(job, blank, DMAGIC_JOB_SIZE);
+    job[DMAGIC_CMD] = command;
+    return job;
+}
+
+// -1 once the batch is full
+int dmagic_batch_copy(struct dmagic_batch *b, uint32_t source, uint32_t dest, uint16_t count)
+{
+    uint8_t *job = batch_add(b, DMAGIC_COPY);
+
+    if (!job)
+        return -1;
+    dmagic_set_source(job, source);
+    dmagic_set_dest(job, dest);
+    dmagic_set_count(job, count);
+    return 0;
+}
+
+int dmagic_batch_fill(struct dmagic_batch *b, uint32_t dest, uint8_t value, uint16_t count)
+{
+    uint8_t *job = batch_add(b, DMAGIC_FILL);
+
+    if (!job)
+        return -1;
+    job[DMAGIC_SRC] = value;
+    dmagic_set_dest(job, dest);
+    dmagic_set_count(job, count);
+    return 0;
+}
+
+// The batch stays as it is, it can be patched and run again
+void dmagic_batch_run(struct dmagic_batch *b)
+{
+    if (b->jobs)
+        dmagic_trigger(b->list);
+}
+
+// ── software model ──────────────────────────────────
+
+#ifdef __linux__
+
+// Enhanced-mode F018B jobs, copy and fill, with source and destination
+// skip, hold and decrement.  Bytes move one at a time in job order, so
+// an overlapping copy smears the way the hardware's does; the memcpy and
+// memset paths only take the cases where that makes no difference.
+
+// Host pointer and per-byte step for one side of a job
+static int side(dmagic_memory memory, uint32_t address, uint8_t bank, uint8_t skip,
+                uint32_t count, uint8_t **p, long *step)
+{
+    uint32_t span, low;
+    uint8_t *base;
+
+    if (bank & DMAGIC_HOLD)
+        *step = 0;
+    else
+        *step = bank & DMAGIC_DEC ? -(long)skip : (long)skip;
+    span = *step ? (count - 1) * skip + 1 : 1;
+    low  = *step < 0 ? address - (span - 1) : address;
+    base = memory(low, span);
+    if (!base)
+        return -1;
+    *p = base + (address - low);
+    return 0;
+}
+
+// Runs a list to its last job; the number of jobs, -1 on a job the model
+// does not do
+int dmagic_model_run(const uint8_t *list, dmagic_memory memory)
+{
+    int jobs = 0;
+
+    for (;;) {
+        uint8_t src_mb = 0, dst_mb = 0, src_skip = 1, dst_skip = 1;
+        uint8_t opt, command, *s, *d;
+        uint32_t count, source, dest, i;
+        long ss, ds;
+
+        while ((opt = *list++) != 0x00) {
+            if (opt == 0x0A) {
+                platform_msg("dmagic: F018A jobs are not modelled\n");
+                return -1;
+            }
+            if (opt < 0x80)
+                continue;               // no argument
+            switch (opt) {
+                case 0x80: src_mb   = *list; break;
+                case 0x81: dst_mb   = *list; break;
+                case 0x83: src_skip = *list; break;
+                case 0x85: dst_skip = *list; break;
+            }
+            list++;
+        }
+
+        command = list[0];
+        count   = list[1] | (list[2] << 8);
+        if (!count)
+            count = 0x10000;
+        source  = ((uint32_t)src_mb << 20) | ((uint32_t)(list[5] & 0x0F) << 16) | list[3] | (list[4] << 8);
+        dest    = ((uint32_t)dst_mb << 20) | ((uint32_t)(list[8] & 0x0F) << 16) | list[6] | (list[7] << 8);
+        if ((list[5] | list[8]) & DMAGIC_MOD) {
+            platform_msg("dmagic: modulo jobs are not modelled\n");
+            return -1;
+        }
+
+        if (side(memory, dest, list[8], dst_skip, count, &d, &ds) != 0)
+            return -1;
+        switch (command & 0x03) {
+            case DMAGIC_COPY:
+                if (side(memory, source, list[5], src_skip, count, &s, &ss) != 0)
+                    return -1;
+                if (ss == 1 && ds == 1 && (d + count <= s || s + count <= d)) {
+                    memcpy(d, s, count);
+                } else {
+                    for (i = 0; i < count; i++, s += ss, d += ds)
+                        *d = *s;
+                }
+                break;
+            case DMAGIC_FILL:
+                if (ds == 1) {
+                    memset(d, list[3], count);
+                } else {
+                    for (i = 0; i < count; i++, d += ds)
+                        *d = list[3];
+                }
+                break;
+            default:
+                platform_msg("dmagic: command %02X is not modelled\n", command);
+                return -1;
+        }
+        jobs++;
+        list += 12;
+        if (!(command & DMAGIC_CHAIN))
+            return jobs;
+    }
+}
+
+#endif
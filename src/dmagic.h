@@ -0,0 +1,96 @@
+#ifndef __DMAGIC_H
+#define __DMAGIC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// DMAgic job lists as bytes, so the same encoding drives the MEGA65's
+// DMA controller and, on Linux, the software model in dmagic.c.
+//
+// A job is an enhanced option list followed by an F018B request:
+//
+//   0B  80 src-MB  81 dst-MB  85 dst-skip  00
+//   cmd  count.w  src.w src-bank  dst.w dst-bank  subcmd  modulo.w
+//
+// Every job carries its own options, so jobs chain by simply following
+// each other with DMAGIC_CHAIN set in all but the last command.
+
+#define DMAGIC_JOB_SIZE         20
+
+// offsets in a job
+#define DMAGIC_SRC_MB           2
+#define DMAGIC_DST_MB           4
+#define DMAGIC_DST_SKIP         6
+#define DMAGIC_CMD              8
+#define DMAGIC_COUNT            9
+#define DMAGIC_SRC              11
+#define DMAGIC_SRC_BANK         13
+#define DMAGIC_DST              14
+#define DMAGIC_DST_BANK         16
+
+// command byte
+#define DMAGIC_COPY             0x00
+#define DMAGIC_FILL             0x03
+#define DMAGIC_CHAIN            0x04
+
+// bank byte flags
+#define DMAGIC_DEC              0x10
+#define DMAGIC_MOD              0x20
+#define DMAGIC_HOLD             0x40
+
+#define DMAGIC_JOB(command) { 0x0B, 0x80, 0, 0x81, 0, 0x85, 1, 0x00, (command), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }
+
+#define DMAGIC_BATCH_MAX        8
+
+// Several copies and fills run as one chained list, one DMA trigger
+struct dmagic_batch {
+    uint8_t jobs;
+    uint8_t list[DMAGIC_BATCH_MAX * DMAGIC_JOB_SIZE];
+};
+
+// Patch a prepared job; everything else in it stays as it was
+static inline void dmagic_set_source(uint8_t *job, uint32_t address)
+{
+    job[DMAGIC_SRC_MB]   = (uint8_t)(address >> 20);
+    job[DMAGIC_SRC]      = (uint8_t)address;
+    job[DMAGIC_SRC + 1]  = (uint8_t)(address >> 8);
+    job[DMAGIC_SRC_BANK] = (uint8_t)(address >> 16) & 0x0F;
+}
+
+static inline void dmagic_set_dest(uint8_t *job, uint32_t address)
+{
+    job[DMAGIC_DST_MB]   = (uint8_t)(address >> 20);
+    job[DMAGIC_DST]      = (uint8_t)address;
+    job[DMAGIC_DST + 1]  = (uint8_t)(address >> 8);
+    job[DMAGIC_DST_BANK] = (uint8_t)(address >> 16) & 0x0F;
+}
+
+// 0 is 64 KB
+static inline void dmagic_set_count(uint8_t *job, uint16_t count)
+{
+    job[DMAGIC_COUNT]     = (uint8_t)count;
+    job[DMAGIC_COUNT + 1] = (uint8_t)(count >> 8);
+}
+
+static inline uint8_t *dmagic_batch_job(struct dmagic_batch *b, uint8_t n)
+{
+    return b->list + n * DMAGIC_JOB_SIZE;
+}
+
+void dmagic_batch_begin(struct dmagic_batch *b);
+int  dmagic_batch_copy(struct dmagic_batch *b, uint32_t source, uint32_t dest, uint16_t count);
+int  dmagic_batch_fill(struct dmagic_batch *b, uint32_t dest, uint8_t value, uint16_t count);
+void dmagic_batch_run(struct dmagic_batch *b);
+
+// Starts the list and returns once it is done: the DMA controller on the
+// MEGA65 (m65.c), dmagic_model_run() on Linux (platform_linux.c)
+void dmagic_trigger(const uint8_t *list);
+
+#ifdef __linux__
+// Host memory for a 28-bit address range, NULL if there is none
+typedef uint8_t *(*dmagic_memory)(uint32_t address, size_t count);
+
+int dmagic_model_run(const uint8_t *list, dmagic_memory memory);
+#endif
+
+#endif
@@ -0,0 +1,663 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "trap.h"
+#include "romset.h"
+#include "drive.h"
+
+// KERNAL zero page used by LOAD/SAVE/OPEN (901227-03)
+#define ZP_STATUS       0x90
+#define ZP_VERIFY       0x93
+#define ZP_ENDLO        0xAE
+#define ZP_FNLEN        0xB7
+#define ZP_SA           0xB9
+#define ZP_DEVICE       0xBA
+#define ZP_FNADR        0xBB
+#define ZP_SAVESTART    0xC1
+#define ZP_LOADADDR     0xC3
+
+#define ST_TIMEOUT_READ 0x02
+#define ST_VERIFY       0x10
+#define ST_EOI          0x40
+
+// KERNAL error numbers returned in A with carry set
+#define ERR_NOT_FOUND   4
+#define ERR_NO_NAME     8
+
+#define CHANNELS        16
+#define CMD_CHANNEL     15
+#define CHUNK           256
+
+struct channel {
+    uint8_t  open;
+    uint8_t  write;
+    int      handle;            // backend handle, -1 when served from mem
+    uint8_t *mem;               // directory listing or status text
+    long     mem_len;
+    long     mem_pos;
+    uint8_t  buf[CHUNK];
+    uint16_t len;
+    uint16_t pos;
+};
+
+struct drive {
+    const struct drive_ops *ops;
+    void *ctx;
+    struct channel ch[CHANNELS];
+    char status[48];
+};
+
+static struct drive drives[DRIVE_LAST - DRIVE_FIRST + 1];
+
+// serial bus state between LISTEN/TALK and UNLSN/UNTLK
+static uint8_t listener = 0;    // our device being listened to, 0 = none
+static uint8_t talker   = 0;    // our device talking, 0 = none
+static uint8_t bus_cmd;         // SECOND: $F0 open, $E0 close, $60 data
+static uint8_t bus_ch;
+static char    bus_name[42];
+static uint8_t bus_name_len;
+
+#ifdef __linux__
+#include <signal.h>
+static volatile sig_atomic_t flush_requested = 0;
+static void (*usr1_next)(int);          // SIGUSR1 is shared with trace.c
+
+static void request_flush(int sig)
+{
+    flush_requested = 1;
+    if (usr1_next != SIG_DFL && usr1_next != SIG_IGN && usr1_next != SIG_ERR)
+        usr1_next(sig);
+}
+#endif
+
+static struct drive *get_drive(uint8_t device)
+{
+    if (device < DRIVE_FIRST || device > DRIVE_LAST)
+        return NULL;
+    return drives[device - DRIVE_FIRST].ops ? &drives[device - DRIVE_FIRST] : NULL;
+}
+
+static void set_status(struct drive *d, int code, const char *text)
+{
+    sprintf(d->status, "%02d,%s,00,00\r", code, text);
+}
+
+// CBM DOS pattern match: '*' matches the rest, '?' any one character
+int drive_match(const char *pattern, const char *name)
+{
+    for (; *pattern; pattern++, name++) {
+        if (*pattern == '*')
+            return 1;
+        if (!*name || (*pattern != '?' && *pattern != *name))
+            return 0;
+    }
+    return *name == 0;
+}
+
+// Split "@0:NAME,S,W" into name, file type and write mode
+static void parse_name(const char *spec, char *name, uint8_t *type, int *write, int *replace)
+{
+    const char *colon = strchr(spec, ':');
+    size_t n = 0;
+
+    *replace = colon && spec[0] == '@';     // "@0:NAME" saves over NAME
+    if (colon)
+        spec = colon + 1;
+    while (*spec && *spec != ',' && n < DRIVE_NAME_MAX)
+        name[n++] = *spec++;
+    name[n] = 0;
+
+    while (*spec == ',') {
+        spec++;
+        switch (*spec) {
+            case 'S': *type = DRIVE_SEQ; break;
+            case 'P': *type = DRIVE_PRG; break;
+            case 'U': *type = DRIVE_USR; break;
+            case 'W': *write = 1; break;
+            case 'R': *write = 0; break;
+        }
+        while (*spec && *spec != ',')
+            spec++;
+    }
+}
+
+static const struct drive_dirent *find(struct drive *d, const char *pattern)
+{
+    const struct drive_dir *dir;
+    uint16_t i;
+
+    if (d->ops->dir(d->ctx, &dir) != 0)
+        return NULL;
+    for (i = 0; i < dir->count; i++) {
+        if (dir->entries[i].type != DRIVE_DEL && drive_match(pattern, dir->entries[i].name))
+            return &dir->entries[i];
+    }
+    return NULL;
+}
+
+// ── directory listing as a BASIC program at $0401 ───────────────
+static uint8_t *put_line(uint8_t *p, uint16_t number)
+{
+    *p++ = 0x01; *p++ = 0x01;   // dummy link, BASIC relinks after LOAD
+    *p++ = number & 0xFF;
+    *p++ = number >> 8;
+    return p;
+}
+
+static long build_listing(struct drive *d, const char *pattern, uint8_t **out)
+{
+    const struct drive_dir *dir;
+    uint8_t *buf, *p;
+    uint16_t i;
+    int n;
+
+    if (d->ops->dir(d->ctx, &dir) != 0)
+        return -1;
+    buf = malloc(96 + (size_t)dir->count * 32);
+    if (!buf)
+        return -1;
+
+    p = buf;
+    *p++ = 0x01; *p++ = 0x04;
+    p = put_line(p, 0);
+    p += sprintf((char *)p, "\x12\"%-16s\" %-5s", dir->title, dir->id) + 1;
+
+    for (i = 0; i < dir->count; i++) {
+        const struct drive_dirent *e = &dir->entries[i];
+        static const char *types[] = { "DEL", "SEQ", "PRG", "USR", "REL" };
+
+        if (e->type == DRIVE_DEL || (*pattern && !drive_match(pattern, e->name)))
+            continue;
+        p = put_line(p, e->blocks);
+        n = e->blocks < 10 ? 3 : e->blocks < 100 ? 2 : 1;
+        while (n--)
+            *p++ = ' ';
+        n = sprintf((char *)p, "\"%s\"", e->name);
+        p += n;
+        n = 19 - n;
+        while (n-- > 0)
+            *p++ = ' ';
+        p += sprintf((char *)p, "%s  ", types[(e->type & 0x07) > 4 ? 0 : (e->type & 0x07)]) + 1;
+    }
+
+    p = put_line(p, dir->blocks_free);
+    p += sprintf((char *)p, "BLOCKS FREE.             ") + 1;
+    *p++ = 0;
+    *p++ = 0;
+
+    *out = buf;
+    return (long)(p - buf);
+}
+
+// ── channels ────────────────────────────────────────────────────
+static void channel_close(struct drive *d, uint8_t n)
+{
+    struct channel *c = &d->ch[n];
+
+    if (c->open && c->handle >= 0) {
+        if (c->write && c->len)
+            d->ops->write(d->ctx, c->handle, c->buf, c->len);
+        d->ops->close(d->ctx, c->handle);
+    }
+    if (c->mem && n != CMD_CHANNEL)
+        free(c->mem);
+    memset(c, 0, sizeof(*c));
+    c->handle = -1;
+}
+
+static int channel_open(struct drive *d, uint8_t n, const char *spec, int load)
+{
+    struct channel *c = &d->ch[n];
+    const struct drive_dirent *e;
+    char name[DRIVE_NAME_MAX + 1];
+    uint8_t type = DRIVE_PRG;
+    int write = (!load && n == 1);      // secondary address 1 saves
+    int replace;
+
+    channel_close(d, n);
+
+    if (spec[0] == '$') {
+        c->mem_len = build_listing(d, spec[1] == ':' ? spec + 2 : spec + 1, &c->mem);
+        if (c->mem_len < 0)
+            return -1;
+        c->open = 1;
+        set_status(d, 0, " OK");
+        return 0;
+    }
+
+    if (!load && n != 0 && n != 1)
+        type = DRIVE_SEQ;
+    parse_name(spec, name, &type, &write, &replace);
+    if (write && !replace && find(d, name)) {
+        set_status(d, 63, "FILE EXISTS");
+        return -1;
+    }
+    if (!write) {
+        e = find(d, name);
+        if (!e) {
+            set_status(d, 62, "FILE NOT FOUND");
+            return -1;
+        }
+        strcpy(name, e->name);
+        type = e->type;
+    }
+
+    c->handle = d->ops->open(d->ctx, name, type, write);
+    if (c->handle == DRIVE_BAD_NAME) {
+        c->handle = -1;
+        set_status(d, 33, "SYNTAX ERROR");
+        return -1;
+    }
+    if (c->handle < 0) {
+        set_status(d, write ? 72 : 62, write ? "DISK FULL" : "FILE NOT FOUND");
+        return -1;
+    }
+    c->open  = 1;
+    c->write = (uint8_t)write;
+    set_status(d, 0, " OK");
+    return 0;
+}
+
+// Next byte from a read channel; *eoi is set on the last one
+static uint8_t channel_get(struct drive *d, uint8_t n, int *eoi)
+{
+    struct channel *c = &d->ch[n];
+    uint8_t v;
+
+    if (n == CMD_CHANNEL) {
+        const char *s = d->status;
+        v = (uint8_t)s[c->mem_pos++];
+        *eoi = (s[c->mem_pos] == 0);
+        if (*eoi) {
+            c->mem_pos = 0;
+            set_status(d, 0, " OK");
+        }
+        return v;
+    }
+    if (c->mem) {
+        if (c->mem_pos >= c->mem_len) {
+            *eoi = 1;
+            return 0x0D;
+        }
+        v = c->mem[c->mem_pos++];
+        *eoi = (c->mem_pos >= c->mem_len);
+        return v;
+    }
+    if (c->pos >= c->len) {
+        long got = d->ops->read(d->ctx, c->handle, c->buf, CHUNK);
+        c->len = (uint16_t)(got > 0 ? got : 0);
+        c->pos = 0;
+        if (c->len == 0) {
+            *eoi = 1;
+            return 0x0D;
+        }
+    }
+    v = c->buf[c->pos++];
+    if (c->pos >= c->len) {
+        long got = d->ops->read(d->ctx, c->handle, c->buf, CHUNK);
+        c->len = (uint16_t)(got > 0 ? got : 0);
+        c->pos = 0;
+    }
+    *eoi = (c->len == 0);
+    return v;
+}
+
+static void channel_put(struct drive *d, uint8_t n, uint8_t v)
+{
+    struct channel *c = &d->ch[n];
+
+    c->buf[c->len++] = v;
+    if (c->len == CHUNK) {
+        d->ops->write(d->ctx, c->handle, c->buf, CHUNK);
+        c->len = 0;
+    }
+}
+
+static void command(struct drive *d, const char *cmd)
+{
+    if (cmd[0] == 'I' || cmd[0] == 0)
+        set_status(d, 0, " OK");
+    else
+        set_status(d, 31, "SYNTAX ERROR");
+}
+
+static void read_filename(char *out)
+{
+    uint16_t addr = ram[ZP_FNADR] | (ram[ZP_FNADR + 1] << 8);
+    uint8_t len = ram[ZP_FNLEN], i;
+
+    if (len > 40)
+        len = 40;
+    for (i = 0; i < len; i++)
+        out[i] = (char)ram[(uint16_t)(addr + i)];
+    out[len] = 0;
+}
+
+static int kernal_error(uint8_t code)
+{
+    a = code;
+    trap_carry(1);
+    trap_rts();
+    return 1;
+}
+
+// ── LOAD ($F4A5, after the ILOAD vector) ────────────────────────
+static int trap_load(void)
+{
+    struct drive *d = get_drive(ram[ZP_DEVICE]);
+    struct channel *c;
+    char spec[42];
+    uint8_t hdr[2];
+    uint16_t addr, end;
+    int verify = (a != 0);
+    int eoi = 0;
+
+    if (!d)
+        return 0;
+    if (ram[ZP_FNLEN] == 0)
+        return kernal_error(ERR_NO_NAME);
+
+    read_filename(spec);
+    if (channel_open(d, 0, spec, 1) != 0)
+        return kernal_error(ERR_NOT_FOUND);
+    c = &d->ch[0];
+
+    hdr[0] = channel_get(d, 0, &eoi);
+    hdr[1] = eoi ? 0 : channel_get(d, 0, &eoi);
+    addr = ram[ZP_SA] ? (uint16_t)(hdr[0] | (hdr[1] << 8))
+                      : (uint16_t)(ram[ZP_LOADADDR] | (ram[ZP_LOADADDR + 1] << 8));
+    end = addr;
+    ram[ZP_STATUS] = 0;
+
+    // whatever channel_get() buffered goes first, the rest in bulk
+    while (!eoi && c->pos < c->len && end != 0) {
+        uint8_t v = c->buf[c->pos++];
+        if (verify) {
+            if (ram[end] != v)
+                ram[ZP_STATUS] |= ST_VERIFY;
+        } else {
+            ram[end] = v;
+        }
+        end++;
+    }
+    if (c->mem) {
+        long n = c->mem_len - c->mem_pos;
+        if (n > 0x10000 - (long)end)
+            n = 0x10000 - (long)end;
+        if (!verify)
+            emu_ram_write(end, c->mem + c->mem_pos, (size_t)n);
+        end += (uint16_t)n;
+    } else if (!eoi && end != 0) {
+#ifdef __linux__
+        if (!verify) {
+            long n = d->ops->read(d->ctx, c->handle, ram + end, 0x10000 - (long)end);
+            end += (uint16_t)(n > 0 ? n : 0);
+        } else
+#endif
+        for (;;) {
+            long n = d->ops->read(d->ctx, c->handle, c->buf, CHUNK), i;
+            if (n <= 0)
+                break;
+            if (n > 0x10000 - (long)end)
+                n = 0x10000 - (long)end;
+            for (i = 0; verify && i < n; i++) {
+                if (ram[(uint16_t)(end + i)] != c->buf[i])
+                    ram[ZP_STATUS] |= ST_VERIFY;
+            }
+            if (!verify)
+                emu_ram_write(end, c->buf, (size_t)n);
+            end += (uint16_t)n;
+            if (end == 0)
+                break;
+        }
+    }
+    channel_close(d, 0);
+    if (!verify)
+        emu_mark_dirty(addr, (end ? end : 0x10000UL) - addr);
+
+    ram[ZP_STATUS] |= ST_EOI;
+    ram[ZP_ENDLO]     = end & 0xFF;
+    ram[ZP_ENDLO + 1] = end >> 8;
+    x = end & 0xFF;
+    y = end >> 8;
+    trap_carry(0);
+    trap_rts();
+    return 1;
+}
+
+// ── SAVE ($F5ED, after the ISAVE vector) ────────────────────────
+static int trap_save(void)
+{
+    struct drive *d = get_drive(ram[ZP_DEVICE]);
+    struct channel *c;
+    char spec[42];
+    uint16_t start, end;
+    uint8_t hdr[2];
+
+    if (!d)
+        return 0;
+    if (ram[ZP_FNLEN] == 0)
+        return kernal_error(ERR_NO_NAME);
+
+    // As on a real drive, a file that cannot be written (exists, bad
+    // name, disk full) does not fail the SAVE: the KERNAL finishes
+    // normally and the error waits on channel 15.
+    read_filename(spec);
+    if (channel_open(d, 1, spec, 0) == 0) {
+        c = &d->ch[1];
+        start = ram[ZP_SAVESTART] | (ram[ZP_SAVESTART + 1] << 8);
+        end   = ram[ZP_ENDLO] | (ram[ZP_ENDLO + 1] << 8);
+        hdr[0] = start & 0xFF;
+        hdr[1] = start >> 8;
+        d->ops->write(d->ctx, c->handle, hdr, 2);
+        if (end > start) {
+#ifdef __linux__
+            d->ops->write(d->ctx, c->handle, ram + start, end - start);
+#else
+            uint16_t p;
+            for (p = start; p != end; p++)
+                channel_put(d, 1, ram[p]);
+#endif
+        }
+        channel_close(d, 1);
+    }
+
+    ram[ZP_STATUS] = 0;
+    trap_carry(0);
+    trap_rts();
+    return 1;
+}
+
+// ── serial bus entry points ─────────────────────────────────────
+static int trap_listen(void)
+{
+    if (!get_drive(a)) {
+        listener = 0;
+        return 0;
+    }
+    listener = a;
+    bus_cmd  = 0;
+    ram[ZP_STATUS] = 0;
+    trap_rts();
+    return 1;
+}
+
+static int trap_talk(void)
+{
+    if (!get_drive(a)) {
+        talker = 0;
+        return 0;
+    }
+    talker = a;
+    ram[ZP_STATUS] = 0;
+    trap_rts();
+    return 1;
+}
+
+static int trap_second(void)
+{
+    struct drive *d;
+
+    if (!listener)
+        return 0;
+    d = get_drive(listener);
+    bus_cmd = a & 0xF0;
+    bus_ch  = a & 0x0F;
+    bus_name_len = 0;
+    if (bus_cmd == 0xE0)
+        channel_close(d, bus_ch);
+    trap_rts();
+    return 1;
+}
+
+static int trap_tksa(void)
+{
+    if (!talker)
+        return 0;
+    bus_ch = a & 0x0F;
+    trap_rts();
+    return 1;
+}
+
+static int trap_ciout(void)
+{
+    struct drive *d;
+
+    if (!listener)
+        return 0;
+    d = get_drive(listener);
+    if (bus_cmd == 0xF0 || (bus_cmd == 0x60 && bus_ch == CMD_CHANNEL)) {
+        if (bus_name_len < sizeof(bus_name) - 1)
+            bus_name[bus_name_len++] = (char)a;
+    } else if (bus_cmd == 0x60 && d->ch[bus_ch].open && d->ch[bus_ch].write) {
+        channel_put(d, bus_ch, a);
+    }
+    trap_carry(0);
+    trap_rts();
+    return 1;
+}
+
+static int trap_unlisten(void)
+{
+    struct drive *d;
+
+    if (!listener)
+        return 0;
+    d = get_drive(listener);
+    bus_name[bus_name_len] = 0;
+    if (bus_ch == CMD_CHANNEL && (bus_cmd == 0xF0 || bus_cmd == 0x60))
+        command(d, bus_name);
+    else if (bus_cmd == 0xF0)
+        channel_open(d, bus_ch, bus_name, 0);
+    bus_cmd = 0;
+    listener = 0;
+    trap_rts();
+    return 1;
+}
+
+static int trap_acptr(void)
+{
+    struct drive *d;
+    int eoi = 1;
+
+    if (!talker)
+        return 0;
+    d = get_drive(talker);
+    if (bus_ch == CMD_CHANNEL || d->ch[bus_ch].open) {
+        a = channel_get(d, bus_ch, &eoi);
+        if (eoi)
+            ram[ZP_STATUS] |= ST_EOI;
+    } else {
+        a = 0x0D;
+        ram[ZP_STATUS] |= ST_EOI | ST_TIMEOUT_READ;
+    }
+    trap_carry(0);
+    trap_rts();
+    return 1;
+}
+
+static int trap_untalk(void)
+{
+    if (!talker)
+        return 0;
+    talker = 0;
+    trap_rts();
+    return 1;
+}
+
+int drive_attach(uint8_t device, const struct drive_ops *ops, void *ctx)
+{
+    struct drive *d;
+    uint8_t i;
+
+    if (device < DRIVE_FIRST || device > DRIVE_LAST)
+        return -1;
+    d = &drives[device - DRIVE_FIRST];
+    memset(d, 0, sizeof(*d));
+    for (i = 0; i < CHANNELS; i++)
+        d->ch[i].handle = -1;
+    d->ops = ops;
+    d->ctx = ctx;
+    set_status(d, 73, "MEGA64 VIRTUAL DRIVE");
+    return 0;
+}
+
+// KERNAL 901227-03 entry points and the first byte of each routine
+int drive_install_traps(void)
+{
+    static uint8_t installed = 0;
+    int rc = 0;
+
+    if (installed)
+        return 0;
+    if (romset.kernal_crc != CRC_KERNAL_901227_03) {
+        platform_msg("drive: traps need KERNAL 901227-03, drives disabled\n");
+        return -1;
+    }
+    rc |= trap_install(0xF4A5, 0x85, trap_load);
+    rc |= trap_install(0xF5ED, 0xA5, trap_save);
+    rc |= trap_install(0xED09, 0x09, trap_talk);
+    rc |= trap_install(0xED0C, 0x09, trap_listen);
+    rc |= trap_install(0xEDB9, 0x85, trap_second);
+    rc |= trap_install(0xEDC7, 0x85, trap_tksa);
+    rc |= trap_install(0xEDDD, 0x24, trap_ciout);
+    rc |= trap_install(0xEDEF, 0x78, trap_untalk);
+    rc |= trap_install(0xEDFE, 0xA9, trap_unlisten);
+    rc |= trap_install(0xEE13, 0x78, trap_acptr);
+    if (rc != 0) {
+        trap_remove_all();
+        platform_msg("drive: KERNAL image does not match, traps not installed\n");
+        return -1;
+    }
+    installed = 1;
+    atexit(drive_flush_all);
+#ifdef __linux__
+    if ((usr1_next = signal(SIGUSR1, request_flush)) == request_flush)
+        usr1_next = SIG_DFL;
+#endif
+    return 0;
+}
+
+void drive_flush_all(void)
+{
+    uint8_t i;
+
+    for (i = 0; i <= DRIVE_LAST - DRIVE_FIRST; i++) {
+        if (drives[i].ops && drives[i].ops->flush)
+            drives[i].ops->flush(drives[i].ctx);
+    }
+}
+
+// Once per frame: a flush asked for with SIGUSR1 is done here, not in the handler
+void drive_frame(void)
+{
+#ifdef __linux__
+    if (flush_requested) {
+        flush_requested = 0;
+        drive_flush_all();
+    }
+#endif
+}
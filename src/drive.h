@@ -0,0 +1,56 @@
+#ifndef __DRIVE_H
+#define __DRIVE_H
+
+#include <stdint.h>
+
+// Virtual drives served from KERNAL traps instead of an emulated IEC bus.
+// A backend (disk image, host directory, ...) provides the file operations;
+// drive.c does the KERNAL side: LOAD/SAVE and the serial LISTEN/TALK/
+// SECOND/CIOUT/ACPTR entry points used by OPEN, CHKIN, CHRIN and CLOSE.
+
+#define DRIVE_FIRST             8
+#define DRIVE_LAST              15
+#define DRIVE_NAME_MAX          16
+#define DRIVE_DIR_MAX           296     // files in a D81 directory
+
+#define DRIVE_DEL               0x80
+#define DRIVE_SEQ               0x81
+#define DRIVE_PRG               0x82
+#define DRIVE_USR               0x83
+#define DRIVE_REL               0x84
+
+#define DRIVE_BAD_NAME          (-33)   // ops->open: 33,SYNTAX ERROR
+
+struct drive_dirent {
+    char     name[DRIVE_NAME_MAX + 1];  // PETSCII, no padding
+    uint8_t  type;                      // DRIVE_PRG, DRIVE_SEQ, ...
+    uint16_t blocks;
+};
+
+struct drive_dir {
+    char     title[DRIVE_NAME_MAX + 1];
+    char     id[6];
+    uint16_t blocks_free;
+    uint16_t count;
+    struct drive_dirent *entries;
+};
+
+struct drive_ops {
+    // Directory snapshot; the drive may keep it cached until the next call
+    int  (*dir)(void *ctx, const struct drive_dir **dir);
+    // Open a file by name (wildcards already matched), returns handle, -1,
+    // or DRIVE_BAD_NAME for a name the backend cannot store
+    int  (*open)(void *ctx, const char *name, uint8_t type, int write);
+    long (*read)(void *ctx, int handle, uint8_t *dst, long len);
+    long (*write)(void *ctx, int handle, const uint8_t *src, long len);
+    void (*close)(void *ctx, int handle);
+    void (*flush)(void *ctx);
+};
+
+int  drive_attach(uint8_t device, const struct drive_ops *ops, void *ctx);
+int  drive_install_traps(void);
+void drive_flush_all(void);
+void drive_frame(void);
+int  drive_match(const char *pattern, const char *name);
+
+#endif
@@ -2,50 +2,77 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
 
 #include "emu.h"
-#include "m65.h"
+#include "platform.h"
+#include "video.h"
+#include "autostart.h"
+#include "drive.h"
+#include "d81.h"
+#include "hostdir.h"
+#include "romset.h"
+#include "snapshot.h"
+#include "rewind.h"
+#include "input.h"
+#include "record.h"
+#include "diff.h"
+#include "symbols.h"
+#include "profile.h"
+#include "heatmap.h"
+#include "trace.h"
+#include "watch.h"
+#include "sid.h"
+#include "cart.h"
+#include "reu.h"
+#include "runahead.h"
 #include "cpu.c"
 
+// Skip the KERNAL reset and jump into BASIC with a guessed machine state.
+// A Linux host is fast enough to run the real reset.
+#ifndef __linux__
 #define FASTBOOT
+#endif
 
-#define BANK_4_ROM              0x40000
-#define BANK_5_RAM              0x50000
-
-#define CPU_HZ                  985248u   
 #define IRQ_RATE                50u
 #define VIC_RASTER_LINES        312u     // PAL C-64 has 312 visible lines per frame
 #define CYCLES_PER_LINE         (CPU_HZ / (VIC_RASTER_LINES * IRQ_RATE))
 
+EMU_TLS uint8_t irq_triggered = 0;  // Flag to avoid multiple IRQs
+EMU_TLS uint8_t page_dirty[256];
+
 // how many 6502 cycles per IRQ
 static const uint32_t cycles_per_irq = CPU_HZ / IRQ_RATE;
-static uint32_t cycle_acc       = 0;
-static uint32_t frame_ticks     = 0;
-static uint16_t raster_line     = 0;
+static EMU_TLS uint32_t cycle_acc       = 0;
+static EMU_TLS uint32_t frame_ticks     = 0;
+static EMU_TLS uint16_t raster_line     = 0;
+static EMU_TLS uint32_t stall_cycles    = 0;    // DMA stalls during this instruction
 
 
 // CIA 1 Timer A state
-static uint16_t cia1_timer      = 0;
-static uint8_t cia1_talo        = 0;    // last-written low byte
-static uint8_t cia1_tahi        = 0;    // last-written high byte
-static uint8_t cia1_ctrl        = 0;    // $DC0E: control register
-static uint8_t cia1_icr_mask    = 0;
-static uint8_t cia1_ifr         = 0;     // $DC0D: interrupt flag register
-static uint8_t cia1_crb         = 0;    // $DC0F control register B
-
-static uint16_t cia2_timer;
-static uint8_t  cia2_talo, cia2_tahi, cia2_ctrl, cia2_ifr;
-
-uint8_t __huge *m65io   = (uint8_t __huge *)0x0ffd3000;
-uint8_t __huge *ram     = (uint8_t __huge *)BANK_5_RAM;
-uint8_t __huge *rom     = (uint8_t __huge *)BANK_4_ROM;
-uint8_t __huge *basic   = (uint8_t __huge *)BANK_4_ROM + 0xa000;  // BASIC at $a000-$bfff
-uint8_t __huge *chars   = (uint8_t __huge *)BANK_4_ROM + 0xd000;  // KERNAL at $d000–$dFFF
-uint8_t __huge *kernal  = (uint8_t __huge *)BANK_4_ROM + 0xe000;  // KERNAL at $e000–$FFFF
+static EMU_TLS uint16_t cia1_timer      = 0;
+static EMU_TLS uint8_t cia1_talo        = 0;    // last-written low byte
+static EMU_TLS uint8_t cia1_tahi        = 0;    // last-written high byte
+static EMU_TLS uint8_t cia1_ctrl        = 0;    // $DC0E: control register
+static EMU_TLS uint8_t cia1_icr_mask    = 0;
+static EMU_TLS uint8_t cia1_ifr         = 0;     // $DC0D: interrupt flag register
+static EMU_TLS uint8_t cia1_crb         = 0;    // $DC0F control register B
+
+static EMU_TLS uint16_t cia2_timer;
+static EMU_TLS uint8_t  cia2_talo, cia2_tahi, cia2_ctrl, cia2_ifr;
+
+// Guest memory, pointed into the platform's banks by main()
+EMU_TLS uint8_t EMU_HUGE *ram;      // bank 5, or the machine this thread runs
+uint8_t EMU_HUGE *rom;      // bank 4
+uint8_t EMU_HUGE *basic;    // BASIC at $a000-$bfff
+uint8_t EMU_HUGE *chars;    // CHARGEN at $d000–$dFFF
+uint8_t EMU_HUGE *kernal;   // KERNAL at $e000–$FFFF
 
 static uint8_t raster = 0;
 
-void keyboard_handler();
+#ifdef __linux__
+static struct timespec host_start;
+#endif
 
 void dump_regs(void) {
     fputs("PC:", stdout); print_hex16(pc);  fputc(' ', stdout);
@@ -69,13 +96,26 @@ uint8_t read6502(uint16_t address) {
 
     uint8_t port = ram[0x0001];
 
-    // RAM
+    if ((watch_page[address >> 8] & WATCH_READ) && !watch_busy)
+        return watch_read(address);
+
+#ifdef HEATMAP
+    if (!runahead_active)               // speculative frames are not counted
+        heat_page[heat_kind][address >> 8]++;
+#endif
+
+    // RAM, or cartridge ROML at $8000
     if (address < 0xA000) {
+        if (address >= 0x8000 && cart_mode && cart_roml &&
+            (cart_mode == CART_ULTIMAX || (port & 0x03) == 0x03))
+            return cart_roml[address - 0x8000];
         return ram[address];
     }
 
-    // BASIC ROM or RAM
+    // BASIC ROM, cartridge ROMH or RAM
     if (address >= 0xA000 && address <= 0xBFFF) {
+        if (cart_mode == CART_16K && cart_romh && (port & 0x02))
+            return cart_romh[address - 0xA000];
         if(port & 0x01)
             return basic[address - 0xA000];
         else
@@ -88,6 +128,11 @@ uint8_t read6502(uint16_t address) {
         if (!(port & 0x04))
             return chars[address - 0xD000];
 
+#ifdef HEATMAP
+        if (!runahead_active)
+            heat_io[HEAT_READ][address - HEAT_IO_BASE]++;
+#endif
+
         // VIC-II raster counter
         if (address == 0xD012)
         {
@@ -102,17 +147,24 @@ uint8_t read6502(uint16_t address) {
             if (irq_triggered && (value & 0x01)) {
                 irq_triggered = 0;
                 ram[address] &= ~0x01;  // Clear bit 0 (raster interrupt)
+                page_dirty[0xD0] = 0xFF;
             }
             return value;
         }
 
         // VIC screen border and back colors
         if (address == 0xD020 || address == 0xD021)
-            return PEEK(address);
+            return video_reg(address) & 0x0F;
+
+        // SID, mirrored every 32 bytes
+        if (address >= 0xD400 && address <= 0xD7FF)
+            return sid_read(address);
 
-        // Keyboard column input - return value as if no keys are pressed
-        if (address == 0xDC01) {
-            return 0xFF;
+        // Keyboard matrix and joysticks, inputs (DDR bit clear) float high
+        if (address == 0xDC00 || address == 0xDC01) {
+            uint8_t pa = ram[0xDC00] | ~ram[0xDC02];
+            uint8_t pb = ram[0xDC01] | ~ram[0xDC03];
+            return address == 0xDC00 ? input_port_a(pa, pb) : input_port_b(pa, pb);
         }
 
         // CIA #1 timer for keyboard
@@ -137,7 +189,13 @@ uint8_t read6502(uint16_t address) {
             return 0x80;   // bit 7 set
         }
 
-        // CARTRIDGE port
+        // REU registers in I/O2
+        if (address >= 0xDF00 && reu_size)
+            return reu_read(address);
+
+        // CARTRIDGE port, I/O1 and I/O2
+        if (address >= 0xDE00 && cart_present)
+            return cart_io_read(address);
         if (address >= 0xDE00 && address <= 0xDE03) {
             // on real hardware these bits come from the user port lines
             // but if you return 0x00, the cart-init will immediately exit.
@@ -147,8 +205,10 @@ uint8_t read6502(uint16_t address) {
         return ram[address];
     }
 
-    // KERNAL ROM
+    // KERNAL ROM, cartridge ROMH in Ultimax mode
     if (address >= 0xE000) {
+        if (cart_mode == CART_ULTIMAX && cart_romh)
+            return cart_romh[address - 0xE000];
         if(port & 0x02)
             return kernal[address - 0xe000];
         else
@@ -163,18 +223,28 @@ void write6502(uint16_t address, uint8_t value) {
 
     uint8_t port = ram[0x0001];
 
-    // ── 1) Screen text RAM (host console) ───────────────────────
-    if(address >= 0x0400 && address <= 0x07e8)
-    {
-        // screen text ram
-        POKE(2048+(address-0x400), value);
-    }
+    page_dirty[address >> 8] = 0xFF;
+    if (diff_logging)
+        diff_log_write(address, value);
+    if (watch_page[address >> 8] & WATCH_WRITE)
+        watch_write(address, value);
+#ifdef HEATMAP
+    if (!runahead_active)
+        heat_page[HEAT_WRITE][address >> 8]++;
+#endif
+
+    // Screen text RAM is picked up once per frame by video_end_frame()
 
-    // ── 2) IO Region ───────────────────────
+    // ── IO Region ───────────────────────
     if(address >= 0xD000 && address <= 0xDFFF)
     {
+#ifdef HEATMAP
+        if (!runahead_active)
+            heat_io[HEAT_WRITE][address - HEAT_IO_BASE]++;
+#endif
          //VIC-II I/O at $D000–$D02E ────────────────────────────
         if(address <= 0xD02E) {
+            video_log_write(address, value);
             switch (address) {
                 case 0xD012:
                     // raster register is read-only
@@ -189,7 +259,7 @@ void write6502(uint16_t address, uint8_t value) {
                     return;
                 case 0xD020:  // border color
                 case 0xD021:  // background color
-                    POKE(address, value & 0x0F);
+                    // shown by the renderer from the VIC write log
                     return;
                 default:
                     // any other VIC register we just remember the last write
@@ -198,10 +268,15 @@ void write6502(uint16_t address, uint8_t value) {
             }
         }
         
+        // SID, synthesised from the write log once a frame
+        if(address >= 0xD400 && address <= 0xD7FF) {
+            sid_write(address, value);
+            ram[address] = value;
+            return;
+        }
+
         // color ram
         if(address >= 0xD800 && address <= 0xDBFF) {
-            
-            POKE(address, value & 0x0f);
             ram[address] = value;
             return;
         }
@@ -265,20 +340,184 @@ void write6502(uint16_t address, uint8_t value) {
                 return;
             }
         }
+
+        // REU registers
+        if(address >= 0xDF00 && reu_size) {
+            reu_write(address, value);
+            ram[address] = value;
+            return;
+        }
+
+        // cartridge bank switching
+        if(address >= 0xDE00 && cart_present)
+            cart_io_write(address, value);
     }
 
     ram[address] = value;
 
+    // REU command waiting for $FF00
+    if (address == 0xFF00 && reu_armed)
+        reu_execute();
+
 }
 
 
+// For host code that stores into ram[] directly
+void emu_mark_dirty(uint16_t address, size_t count) {
+    uint16_t page;
+
+    if (!count)
+        return;
+    if ((uint32_t)address + count > 0x10000)
+        count = 0x10000 - address;
+    for (page = address >> 8; page <= (address + count - 1) >> 8; page++)
+        page_dirty[page] = 0xFF;
+}
+
+// Bulk copy into guest RAM, underneath any ROM or I/O
+void emu_ram_write(uint16_t address, const uint8_t *src, size_t count) {
+
+    if ((uint32_t)address + count > 0x10000)
+        count = 0x10000 - address;
+#ifdef __linux__
+    memcpy(ram + address, src, count);
+#else
+    lcopy((uint32_t)src, (uint32_t)ram + address, count);
+#endif
+    emu_mark_dirty(address, count);
+}
+
+void emu_ram_read(uint8_t *dst, uint16_t address, size_t count) {
+
+    if ((uint32_t)address + count > 0x10000)
+        count = 0x10000 - address;
+#ifdef __linux__
+    memcpy(dst, ram + address, count);
+#else
+    lcopy((uint32_t)ram + address, (uint32_t)dst, count);
+#endif
+}
+
+// Cycles the CPU loses to DMA, counted by the chips after this instruction
+void emu_stall(uint32_t cycles) {
+    clockticks6502 += cycles;
+    stall_cycles   += cycles;
+}
+
+// What read6502 would return, without its side effects (the $D019 clear,
+// the CIA and keyboard reads); I/O comes from its shadow in ram[]
+uint8_t emu_peek(uint16_t address) {
+
+    uint8_t port = ram[0x0001];
+
+    if (address >= 0x8000 && address <= 0x9FFF && cart_mode && cart_roml &&
+        (cart_mode == CART_ULTIMAX || (port & 0x03) == 0x03))
+        return cart_roml[address - 0x8000];
+    if (address >= 0xA000 && address <= 0xBFFF && cart_mode == CART_16K && cart_romh && (port & 0x02))
+        return cart_romh[address - 0xA000];
+    if (address >= 0xE000 && cart_mode == CART_ULTIMAX && cart_romh)
+        return cart_romh[address - 0xE000];
+    if (address >= 0xA000 && address <= 0xBFFF && (port & 0x01))
+        return basic[address - 0xA000];
+    if (address >= 0xD000 && address <= 0xDFFF && !(port & 0x04))
+        return chars[address - 0xD000];
+    if (address >= 0xE000 && (port & 0x02))
+        return kernal[address - 0xE000];
+    return ram[address];
+}
+
+void emu_get_state(struct emu_state *s) {
+    s->pc = pc; s->sp = sp; s->a = a; s->x = x; s->y = y; s->status = status;
+    s->irq_triggered = irq_triggered;
+    s->clockticks    = clockticks6502;
+    s->instructions  = instructions;
+    s->cycle_acc     = cycle_acc;
+    s->frame_ticks   = frame_ticks;
+    s->raster_line   = raster_line;
+    s->cia1_timer = cia1_timer; s->cia1_talo = cia1_talo; s->cia1_tahi = cia1_tahi;
+    s->cia1_ctrl  = cia1_ctrl;  s->cia1_icr_mask = cia1_icr_mask;
+    s->cia1_ifr   = cia1_ifr;   s->cia1_crb = cia1_crb;
+    s->cia2_timer = cia2_timer; s->cia2_talo = cia2_talo; s->cia2_tahi = cia2_tahi;
+    s->cia2_ctrl  = cia2_ctrl;  s->cia2_ifr = cia2_ifr;
+    video_get_regs(s->vic);
+}
+
+void emu_set_state(const struct emu_state *s) {
+    pc = s->pc; sp = s->sp; a = s->a; x = s->x; y = s->y; status = s->status;
+    irq_triggered  = s->irq_triggered;
+    clockticks6502 = s->clockticks;
+    clockgoal6502  = s->clockticks;
+    instructions   = s->instructions;
+    cycle_acc      = s->cycle_acc;
+    frame_ticks    = s->frame_ticks;
+    raster_line    = s->raster_line;
+    cia1_timer = s->cia1_timer; cia1_talo = s->cia1_talo; cia1_tahi = s->cia1_tahi;
+    cia1_ctrl  = s->cia1_ctrl;  cia1_icr_mask = s->cia1_icr_mask;
+    cia1_ifr   = s->cia1_ifr;   cia1_crb = s->cia1_crb;
+    cia2_timer = s->cia2_timer; cia2_talo = s->cia2_talo; cia2_tahi = s->cia2_tahi;
+    cia2_ctrl  = s->cia2_ctrl;  cia2_ifr = s->cia2_ifr;
+    video_set_regs(s->vic);
+    sid_resync();
+}
+
+// True while BASIC waits for a direct-mode line in the KERNAL editor's
+// wait-for-key loop ($E5CD-$E5D4).  Frame ends tend to land in the jiffy
+// IRQ, so rather than the PC this looks at what the loop leaves behind:
+// cursor blink on ($CC = 0), no keys queued ($C6) and direct mode ($9D).
+int emu_at_ready(void) {
+    return (ram[0x0001] & 0x02) && ram[0xCC] == 0 && ram[0xC6] == 0 && (ram[0x9D] & 0x80);
+}
+
+unsigned long emu_host_ms(void) {
+#ifdef __linux__
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)((now.tv_sec - host_start.tv_sec) * 1000 +
+                           (now.tv_nsec - host_start.tv_nsec) / 1000000);
+#else
+    return (unsigned long)(clock() / (CLOCKS_PER_SEC / 1000));
+#endif
+}
+
+// -frames: stop after this many, 0 = run forever
+static uint32_t frame_limit;
+static EMU_TLS uint32_t frames_run;
+
+// Once per frame, at raster line 0
+static void end_frame(void) {
+    if (runahead_active) {
+        runahead_end_frame();
+        return;
+    }
+    if (++frames_run > frame_limit && frame_limit)
+        exit(0);
+    record_frame();
+    video_end_frame();
+    snapshot_frame();
+    input_frame();
+    autostart_frame();
+    drive_frame();
+    rewind_frame();
+    sid_frame();
+    runahead_frame();
+#ifdef HEATMAP
+    heatmap_frame();
+#endif
+}
+
 void tick_50hz(void) {
 
+    uint32_t spent = ticktable[opcode] + stall_cycles;
+
+    stall_cycles = 0;
+
     // ── 1) VIC raster ────────────────────────────────────────────
-    cycle_acc += ticktable[opcode];
+    cycle_acc += spent;
     while (cycle_acc >= CYCLES_PER_LINE) {
         cycle_acc -= CYCLES_PER_LINE;
         raster_line = (raster_line + 1) % VIC_RASTER_LINES;
+        if (raster_line == 0)
+            end_frame();
         
         // Check if we're hitting the programmed raster line
         uint8_t trigger_line = ram[0xD012];
@@ -287,14 +526,14 @@ void tick_50hz(void) {
         
         if (raster_line == compare_line) {
             ram[0xD019] |= 0x01;  // Set VIC raster interrupt flag
+            page_dirty[0xD0] = 0xFF;
         }
     }
 
     // ── 2) CIA-1 Timer A (cursor blink and keyboard scan) ────────
     if (cia1_ctrl & 0x01) {  // Only decrement if timer is running
-        uint32_t s = ticktable[opcode];
-        if (cia1_timer > s) {
-            cia1_timer -= s;
+        if (cia1_timer > spent) {
+            cia1_timer -= spent;
         } else {
             // Timer underflow - reload from latch & raise interrupt
             cia1_timer = ((uint16_t)cia1_tahi << 8) | cia1_talo;
@@ -304,7 +543,7 @@ void tick_50hz(void) {
 
     // ── 3) Jiffy-clock 60 Hz counter ─────────────────────────────
     if(cia1_crb & 0x01) {
-        frame_ticks += ticktable[opcode];
+        frame_ticks += spent;
         if (frame_ticks >= cycles_per_irq) {
             frame_ticks -= cycles_per_irq;
             // set CIA-1 IFR bit 1 for the jiffy clock (Timer B on real hardware)
@@ -333,6 +572,10 @@ void tick_50hz(void) {
         else if ((ram[0xD019] & ram[0xD01A] & 0x01) != 0) {
             do_irq = 1;
         }
+        // REU end of block or verify error, until $DF00 is read
+        else if (reu_status & REU_IRQ_PENDING) {
+            do_irq = 1;
+        }
 
         if (do_irq == 1) {
             irq_triggered = 1;
@@ -340,34 +583,32 @@ void tick_50hz(void) {
             
             // clear the source flag so you don’t immediately fire again:
             if      (cia1_ifr & cia1_icr_mask & 0x01) cia1_ifr &= ~0x01;
-            else if (ram[0xD019] & ram[0xD01A] & 0x01) ram[0xD019] &= ~0x01;
+            else if (ram[0xD019] & ram[0xD01A] & 0x01) {
+                ram[0xD019] &= ~0x01;
+                page_dirty[0xD0] = 0xFF;
+            }
             else if (cia1_ifr & cia1_icr_mask & 0x02) cia1_ifr &= ~0x02;
         }
     }
 }
 
-// Initialize emulator
-void init(void) {
-
-    POKE(0xD020, 0);  // Set border color to black
-    POKE(0xD021, 0);  // Set background color to black
-
-    putchar(0x93);     // Clear screen
-    putchar(0x98);     // white text
-    putchar(0X1B);     // esc-x - 40 col screen
-    putchar(0x58);
+// Run the machine from power-on to the point FASTBOOT picks up at
+static void boot(void) {
 
     // Clear RAM
 #ifndef FASTBOOT
-    lfill(0x50000, 0x00, 65535);
+    lfill(BANK_5_RAM, 0x00, 65535);
 #endif
 
     // Setup RAM with proper startup values
     ram[0x00] = 0xFF; 
     ram[0x01] = 0x17;
- 
-    POKE(0xD020, 14);  // Light blue border
-    POKE(0xD021, 6);   // Blue background
+
+    // a cartridge takes over at reset and sets the machine up itself
+    if (cart_present) {
+        reset6502();
+        return;
+    }
 
     #ifndef FASTBOOT
         reset6502();
@@ -387,6 +628,11 @@ void init(void) {
         cia1_ifr   = 0;
         cia1_crb = 8;
         cia1_ctrl = 17;
+
+        // keyboard ports as IOINIT leaves them: A drives columns, B reads rows
+        ram[0xDC00] = 0x7F;
+        ram[0xDC02] = 0xFF;
+        ram[0xDC03] = 0x00;
     #endif
     
     // allow CPU to execute startup code without irq interference
@@ -395,7 +641,7 @@ void init(void) {
     }
 
     // — enable VIC raster interrupts —
-    write6502(0xD01A, PEEK(0xD01A) | 0x01);
+    write6502(0xD01A, ram[0xD01A] | 0x01);
 
     // also want CIA-1 Timer A/B IRQs:
     write6502(0xDC0D, 0x81);  // set mask bit 0 ⇒ Timer A
@@ -405,27 +651,244 @@ void init(void) {
     write6502(0xDC0E, 0x81);    // bit7|bit0 ⇒ mask A and start A
 
     irq_triggered = 0;
-    hookexternal(tick_50hz);
 }
 
-void keyboard_handler() {
+// Initialize emulator, from a snapshot when one is given
+int init(unsigned video_ring_depth, const char *snapshot) {
 
-    if(PEEK32(0xffd3619) != 255)
-    {
-        uint8_t key = PEEK32(0xffd3619);
-        POKE32(0xffd3619, 0);
+    platform_console_init();
 
-        write6502(631,key);
-        write6502(198,1);
+    if (snapshot) {
+        if (snapshot_load(snapshot) != 0)
+            return -1;
+    } else {
+        boot();
     }
+
+    // -ring 0: no renderer at all
+    if (video_ring_depth && video_init(video_ring_depth, CYCLES_PER_LINE) != 0)
+        platform_msg("video: cannot start renderer\n");
+    atexit(video_shutdown);
+
+    hookexternal(tick_50hz);
+    return 0;
+}
+
+// Point the guest memory into the platform's banks
+static void bind_memory(void) {
+    platform_init();
+    rom    = platform_bank(4);
+    ram    = platform_bank(5);
+    basic  = rom + 0xa000;
+    chars  = rom + 0xd000;
+    kernal = rom + 0xe000;
 }
 
-int main() {
+#ifndef EMU_NO_MAIN
+
+int main(int argc, char *argv[]) {
     
     uint8_t show_regs = 0;
     uint8_t do_step = 0;
+    unsigned ring_depth = VIDEO_RING_DEPTH;
+    const char *autostart = NULL;
+    const char *disk = NULL;
+    const char *romdir = "roms";
+    const char *snapshot = NULL;
+    const char *record = NULL;
+    const char *replay = NULL;
+    int romforce = 0;
+    unsigned rewind_mb = 0;
+    uint8_t drives = 0;
+    uint32_t jump = AUTOSTART_NO_JUMP;
+    uint8_t diff = 0;
+    const char *trace = NULL;
+    uint32_t trace_millions = 0;
+    const char *watch = NULL;
+    const char *cart = NULL;
+    unsigned reu_kb = 0;
+    unsigned runahead = 0, run_budget = 100;
+    FILE *ppm_out = NULL;
+    FILE *audio = NULL;
+    int audio_wav = 0;
+    int sid_model = SID_6581;
+#ifdef PROFILE
+    const char *profile = NULL;
+    uint32_t sample = 0;
+#endif
+#ifdef HEATMAP
+    const char *heatmap = NULL;
+    int heat_frames = 0;
+#endif
+    int i;
 
-    init();
+#ifdef __linux__
+    clock_gettime(CLOCK_MONOTONIC, &host_start);
+#endif
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-ring") && i + 1 < argc) {
+            ring_depth = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-ppm") && i + 1 < argc) {
+            // raw PPM frame stream, e.g. piped into an encoder
+            ppm_out = !strcmp(argv[++i], "-") ? stdout : fopen(argv[i], "wb");
+            if (!ppm_out) {
+                platform_msg("cannot open %s\n", argv[i]);
+                return 1;
+            }
+            video_set_output(ppm_out);
+        } else if (!strcmp(argv[i], "-autostart") && i + 1 < argc) {
+            autostart = argv[++i];
+        } else if (!strcmp(argv[i], "-cart") && i + 1 < argc) {
+            cart = argv[++i];
+        } else if (!strcmp(argv[i], "-reu") && i + 1 < argc) {
+            reu_kb = (unsigned)atoi(argv[++i]);     // size in KB, 128 to 16384
+        } else if (!strcmp(argv[i], "-runahead") && i + 1 < argc) {
+            runahead = (unsigned)atoi(argv[++i]);   // frames
+        } else if (!strcmp(argv[i], "-runbudget") && i + 1 < argc) {
+            run_budget = (unsigned)atoi(argv[++i]); // percent of a frame's host time, 0 = no limit
+        } else if (!strcmp(argv[i], "-d81") && i + 1 < argc) {
+            disk = argv[++i];
+        } else if (!strcmp(argv[i], "-hostdir") && i + 2 < argc) {
+            // mounted straight away, init() leaves the drives alone
+            if (hostdir_mount((uint8_t)atoi(argv[i + 1]), argv[i + 2]) != 0)
+                return 1;
+            drives++;
+            i += 2;
+        } else if (!strcmp(argv[i], "-romdir") && i + 1 < argc) {
+            romdir = argv[++i];
+        } else if (!strcmp(argv[i], "-snapshot") && i + 1 < argc) {
+            snapshot = argv[++i];
+        } else if (!strcmp(argv[i], "-savesnap") && i + 1 < argc) {
+            snapshot_save_at_ready(argv[++i]);
+        } else if (!strcmp(argv[i], "-rewind") && i + 1 < argc) {
+            rewind_mb = (unsigned)atoi(argv[++i]);     // history budget in MB
+        } else if (!strcmp(argv[i], "-record") && i + 1 < argc) {
+            record = argv[++i];
+        } else if (!strcmp(argv[i], "-replay") && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (!strcmp(argv[i], "-frames") && i + 1 < argc) {
+            frame_limit = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-diff") && i + 1 < argc) {
+            // lockstep against step6502, stops at the first difference
+            if (diff_start(argv[++i]) != 0)
+                return 1;
+            diff = 1;
+        } else if (!strcmp(argv[i], "-trace") && i + 2 < argc) {
+            // last n million instructions, dumped to file on SIGUSR1 or a crash
+            trace_millions = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+            trace = argv[i + 2];
+            i += 2;
+        } else if (!strcmp(argv[i], "-watch") && i + 1 < argc) {
+            // breakpoint and watchpoint script, see watch.c
+            watch = argv[++i];
+        } else if ((!strcmp(argv[i], "-wav") || !strcmp(argv[i], "-pcm")) && i + 1 < argc) {
+            // WAV file, or raw 16-bit PCM, e.g. piped into a player
+            audio_wav = !strcmp(argv[i++], "-wav");
+            audio = !audio_wav && !strcmp(argv[i], "-") ? stdout : fopen(argv[i], "wb");
+            if (!audio) {
+                platform_msg("cannot open %s\n", argv[i]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-sid") && i + 1 < argc) {
+            sid_model = atoi(argv[++i]) == 8580 ? SID_8580 : SID_6581;
+        } else if (!strcmp(argv[i], "-labels") && i + 1 < argc) {
+            if (symbols_load(argv[++i]) != 0)
+                return 1;
+#ifdef PROFILE
+        } else if (!strcmp(argv[i], "-profile") && i + 1 < argc) {
+            // collapsed call stacks, written at exit
+            profile = argv[++i];
+        } else if (!strcmp(argv[i], "-sample") && i + 1 < argc) {
+            sample = (uint32_t)strtoul(argv[++i], NULL, 0);
+#endif
+#ifdef HEATMAP
+        } else if (!strcmp(argv[i], "-heatmap") && i + 1 < argc) {
+            // CSV, or binary for a .bin name
+            heatmap = argv[++i];
+        } else if (!strcmp(argv[i], "-heatframes")) {
+            heat_frames = 1;
+#endif
+        } else if (!strcmp(argv[i], "-romforce")) {
+            romforce = 1;
+        } else if (!strcmp(argv[i], "-jump") && i + 1 < argc) {
+            const char *arg = argv[++i];
+            jump = (uint32_t)strtoul(arg[0] == '$' ? arg + 1 : arg, NULL, arg[0] == '$' ? 16 : 0) & 0xFFFF;
+        }
+    }
+
+    // two streams in one pipe could not be told apart
+    if (ppm_out == stdout && audio == stdout) {
+        platform_msg("-ppm - and -pcm - cannot both use stdout\n");
+        return 1;
+    }
+
+    bind_memory();
+
+    // fail fast, before any ROM code runs
+    if (romset_load(romdir, romforce) != 0)
+        return 1;
+
+    // a transfer in the candidate run cannot be undone: REU registers and
+    // memory are outside struct emu_state, and bulk copies skip write6502
+    if (reu_kb && diff) {
+        platform_msg("reu: not with -diff\n");
+        return 1;
+    }
+    if (reu_kb && reu_open(reu_kb) != 0)
+        return 1;
+
+    // plugged in before power-on, the reset looks for it
+    if (cart && cart_open(cart) != 0)
+        return 1;
+
+    if (init(ring_depth, snapshot) != 0)
+        return 1;
+
+    if (rewind_mb && rewind_init((size_t)rewind_mb << 20) != 0)
+        return 1;
+
+    // speculative frames would put the diff core out of step
+    if (runahead && diff) {
+        platform_msg("runahead: not with -diff\n");
+        return 1;
+    }
+    if (runahead && runahead_init(runahead, run_budget) != 0)
+        return 1;
+
+    if (disk) {
+        if (d81_mount(8, disk) != 0)
+            return 1;
+        drives++;
+    }
+    if (drives)
+        drive_install_traps();
+
+    if (autostart && autostart_open(autostart, jump) != 0)
+        return 1;
+
+    // replay needs the same ROMs, snapshot, drives and autostart as the recording
+    if (replay && replay_start(replay) != 0)
+        return 1;
+    if (!replay && record && record_start(record) != 0)
+        return 1;
+
+#ifdef PROFILE
+    if (profile && profile_start(profile, sample) != 0)
+        return 1;
+#endif
+#ifdef HEATMAP
+    if (heatmap && heatmap_start(heatmap, heat_frames) != 0)
+        return 1;
+#endif
+
+    if (audio && sid_start(audio, audio_wav, sid_model) != 0)
+        return 1;
+
+    if (trace && trace_start(trace, trace_millions) != 0)
+        return 1;
+    if (watch && watch_script(watch) != 0)
+        return 1;
 
     while(1) {
         
@@ -435,10 +898,23 @@ int main() {
         if(do_step == 1) 
             getchar();
         
-        step6502();
-        keyboard_handler();
+        if (runahead_pending)
+            runahead_run();
+
+        if (watch_armed)
+            watch_step();
+
+        if (trace_on)
+            trace_step();
+
+        if (diff)
+            diff_step();
+        else
+            step6502();
 
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+#endif
@@ -6,15 +6,62 @@
 #include <stdlib.h>
 #include <stdint.h>
 
-static uint8_t irq_triggered = 0;  // Flag to avoid multiple IRQs
+#include "platform.h"
+
+extern EMU_TLS uint8_t irq_triggered;  // Flag to avoid multiple IRQs
 static const char hex_chars[] = "0123456789ABCDEF";
 
-static void print_hex8(uint8_t v) {
+#define CPU_HZ                  985248u
+
+// Machine state shared with the other modules (emu.c / cpu.c)
+extern EMU_TLS uint8_t EMU_HUGE *ram;
+extern uint8_t EMU_HUGE *basic;
+extern uint8_t EMU_HUGE *chars;
+extern uint8_t EMU_HUGE *kernal;
+extern EMU_TLS uint16_t pc;
+extern EMU_TLS uint8_t sp, a, x, y, status;
+extern EMU_TLS uint32_t clockticks6502;
+extern EMU_TLS uint64_t instructions;
+
+// CPU and chip state outside of RAM, for snapshots
+struct emu_state {
+    uint16_t pc;
+    uint8_t  sp, a, x, y, status, irq_triggered;
+    uint32_t clockticks;
+    uint64_t instructions;
+    uint32_t cycle_acc, frame_ticks;
+    uint16_t raster_line;
+    uint16_t cia1_timer;
+    uint8_t  cia1_talo, cia1_tahi, cia1_ctrl, cia1_icr_mask, cia1_ifr, cia1_crb;
+    uint16_t cia2_timer;
+    uint8_t  cia2_talo, cia2_tahi, cia2_ctrl, cia2_ifr;
+    uint8_t  vic[0x2F];
+};
+
+// One byte per 256-byte RAM page, set to 0xFF on every write.  Each consumer
+// owns one bit and clears it once it has seen the page.
+#define DIRTY_REWIND    0x01
+#define DIRTY_FORK      0x02
+#define DIRTY_RUNAHEAD  0x04
+
+extern EMU_TLS uint8_t page_dirty[256];
+
+void emu_mark_dirty(uint16_t address, size_t count);
+void emu_get_state(struct emu_state *s);
+void emu_set_state(const struct emu_state *s);
+void emu_ram_write(uint16_t address, const uint8_t *src, size_t count);
+void emu_ram_read(uint8_t *dst, uint16_t address, size_t count);
+uint8_t emu_peek(uint16_t address);
+void emu_stall(uint32_t cycles);
+int  emu_at_ready(void);
+unsigned long emu_host_ms(void);
+
+static inline void print_hex8(uint8_t v) {
     putchar(hex_chars[(v >> 4) & 0xF]);
     putchar(hex_chars[v & 0xF]);
 }
 
-static void print_hex16(uint16_t v) {
+static inline void print_hex16(uint16_t v) {
     putchar(hex_chars[(v >> 12) & 0xF]);
     putchar(hex_chars[(v >>  8) & 0xF]);
     putchar(hex_chars[(v >>  4) & 0xF]);
@@ -23,4 +70,4 @@ static void print_hex16(uint16_t v) {
 
 
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "platform.h"
+#include "heatmap.h"
+
+// A dump is either CSV or binary, picked by the file name (".bin" is
+// binary).  CSV has one line per page or I/O address that was touched:
+//
+//   frame,area,address,reads,writes,fetches
+//   12,page,$0400,0,40,0
+//   12,io,$D012,311,0,0
+//
+// Binary is one fixed-size record per dump, host byte order:
+//
+//   "HEAT" u32 frame  u64 page[3][256] (read, write, fetch)
+//   u64 io[2][4096] (read, write)
+//
+// With per_frame every frame is dumped and the counters start again;
+// otherwise there is one dump of the whole run at exit.  The frame of the
+// exit dump is the number of frames run.
+
+#ifdef HEATMAP
+
+uint8_t  heat_kind = HEAT_READ;
+uint64_t heat_page[HEAT_KINDS][256];
+uint64_t heat_io[2][HEAT_IO_SIZE];
+
+static FILE *out;
+static uint8_t binary, every_frame;
+static uint32_t frame;
+
+static void dump(void)
+{
+    unsigned i;
+
+    if (binary) {
+        fwrite("HEAT", 1, 4, out);
+        fwrite(&frame, sizeof(frame), 1, out);
+        fwrite(heat_page, sizeof(heat_page), 1, out);
+        fwrite(heat_io, sizeof(heat_io), 1, out);
+        return;
+    }
+    for (i = 0; i < 256; i++) {
+        if (heat_page[HEAT_READ][i] | heat_page[HEAT_WRITE][i] | heat_page[HEAT_FETCH][i])
+            fprintf(out, "%lu,page,$%02X00,%llu,%llu,%llu\n", (unsigned long)frame, i,
+                    (unsigned long long)heat_page[HEAT_READ][i],
+                    (unsigned long long)heat_page[HEAT_WRITE][i],
+                    (unsigned long long)heat_page[HEAT_FETCH][i]);
+    }
+    for (i = 0; i < HEAT_IO_SIZE; i++) {
+        if (heat_io[HEAT_READ][i] | heat_io[HEAT_WRITE][i])
+            fprintf(out, "%lu,io,$%04X,%llu,%llu,0\n", (unsigned long)frame,
+                    HEAT_IO_BASE + i,
+                    (unsigned long long)heat_io[HEAT_READ][i],
+                    (unsigned long long)heat_io[HEAT_WRITE][i]);
+    }
+}
+
+// Once per frame, from end_frame()
+void heatmap_frame(void)
+{
+    if (!out)
+        return;
+    if (every_frame) {
+        dump();
+        memset(heat_page, 0, sizeof(heat_page));
+        memset(heat_io, 0, sizeof(heat_io));
+    }
+    frame++;
+}
+
+static void heatmap_write(void)
+{
+    dump();
+    fclose(out);
+}
+
+int heatmap_start(const char *path, int per_frame)
+{
+    size_t len = strlen(path);
+
+    out = fopen(path, "wb");
+    if (!out) {
+        platform_msg("heatmap: cannot create %s\n", path);
+        return -1;
+    }
+    binary      = len > 4 && !strcmp(path + len - 4, ".bin");
+    every_frame = per_frame != 0;
+    if (!binary)
+        fputs("frame,area,address,reads,writes,fetches\n", out);
+    atexit(heatmap_write);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __HEATMAP_H
+#define __HEATMAP_H
+
+#include <stdint.h>
+
+// Memory access heatmap, compiled in with -DHEATMAP (CFLAGS=-DHEATMAP
+// ./build.sh).  read6502/write6502 count reads, writes and opcode fetches
+// per 256-byte page, and reads and writes per I/O address in $D000-$DFFF.
+// Without HEATMAP none of the counting is compiled in.
+
+#define HEAT_READ               0
+#define HEAT_WRITE              1
+#define HEAT_FETCH              2       // opcode bytes, operands are reads
+#define HEAT_KINDS              3
+
+#define HEAT_IO_BASE            0xD000
+#define HEAT_IO_SIZE            0x1000
+
+extern uint8_t  heat_kind;              // HEAT_FETCH while cpu.c fetches an opcode
+extern uint64_t heat_page[HEAT_KINDS][256];
+extern uint64_t heat_io[2][HEAT_IO_SIZE];       // HEAT_READ, HEAT_WRITE
+
+int  heatmap_start(const char *path, int per_frame);
+void heatmap_frame(void);
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "platform.h"
+#include "drive.h"
+#include "hostdir.h"
+
+// A host directory as a virtual drive.  The listing is built from the host
+// filesystem once and cached; inotify drops the cache when anything in the
+// directory changes.  Files map to CBM names by upper-casing the base name,
+// the extension (.prg/.seq/.usr) gives the file type.
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define HANDLES         16
+
+struct hostdir {
+    char     path[256];
+    int      notify;                    // inotify fd, -1 if unavailable
+    int      valid;                     // cached listing is current
+    struct drive_dirent entries[DRIVE_DIR_MAX];
+    char     files[DRIVE_DIR_MAX][256]; // host file name for each entry
+    struct drive_dir dir;
+    int      fd[HANDLES];
+};
+
+static struct hostdir *mounts[DRIVE_LAST - DRIVE_FIRST + 1];
+
+static uint8_t type_of(const char *ext)
+{
+    if (!strcasecmp(ext, "prg")) return DRIVE_PRG;
+    if (!strcasecmp(ext, "seq")) return DRIVE_SEQ;
+    if (!strcasecmp(ext, "usr")) return DRIVE_USR;
+    return 0;
+}
+
+static const char *ext_of(uint8_t type)
+{
+    switch (type) {
+        case DRIVE_SEQ: return "seq";
+        case DRIVE_USR: return "usr";
+        default:        return "prg";
+    }
+}
+
+// Host name to CBM name: ASCII letters become unshifted PETSCII capitals
+static void to_cbm(char *out, const char *in, size_t len)
+{
+    size_t n;
+
+    for (n = 0; n < len && n < DRIVE_NAME_MAX; n++) {
+        char c = in[n];
+        out[n] = (c >= 'a' && c <= 'z') ? (char)(c - 32) : c;
+    }
+    out[n] = 0;
+}
+
+// CBM name to host name, -1 if it would leave the directory: no '/' and
+// no leading '.', which also keeps out "." and ".."
+static int to_host(char *out, const char *in)
+{
+    if (!*in || *in == '.' || strchr(in, '/'))
+        return -1;
+    for (; *in; in++)
+        *out++ = (*in >= 'A' && *in <= 'Z') ? (char)(*in + 32) : *in;
+    *out = 0;
+    return 0;
+}
+
+// Any event at all means the cached listing is stale
+static void drain_events(struct hostdir *h)
+{
+    char buf[4096];
+
+    if (h->notify < 0) {
+        h->valid = 0;
+        return;
+    }
+    while (read(h->notify, buf, sizeof(buf)) > 0)
+        h->valid = 0;
+}
+
+static void scan(struct hostdir *h)
+{
+    DIR *d = opendir(h->path);
+    struct dirent *de;
+    struct stat st;
+    char full[512];
+    long blocks_used = 0;
+    size_t len;
+
+    h->dir.count = 0;
+    h->dir.entries = h->entries;
+    to_cbm(h->dir.title, strrchr(h->path, '/') ? strrchr(h->path, '/') + 1 : h->path,
+           strlen(h->path));
+    strcpy(h->dir.id, "HD 2A");
+
+    while (d && (de = readdir(d)) != NULL && h->dir.count < DRIVE_DIR_MAX) {
+        const char *dot = strrchr(de->d_name, '.');
+        uint8_t type;
+
+        if (!dot || dot == de->d_name || !(type = type_of(dot + 1)))
+            continue;
+        snprintf(full, sizeof(full), "%s/%s", h->path, de->d_name);
+        if (stat(full, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        len = strlen(de->d_name);
+        if (len >= sizeof(h->files[0]))
+            continue;
+        to_cbm(h->entries[h->dir.count].name, de->d_name, (size_t)(dot - de->d_name));
+        h->entries[h->dir.count].type   = type;
+        h->entries[h->dir.count].blocks = (uint16_t)((st.st_size + 253) / 254);
+        memcpy(h->files[h->dir.count], de->d_name, len);
+        h->files[h->dir.count][len] = 0;
+        blocks_used += h->entries[h->dir.count].blocks;
+        h->dir.count++;
+    }
+    if (d)
+        closedir(d);
+
+    h->dir.blocks_free = blocks_used < 65535 ? (uint16_t)(65535 - blocks_used) : 0;
+    h->valid = 1;
+}
+
+static int hd_dir(void *ctx, const struct drive_dir **dir)
+{
+    struct hostdir *h = ctx;
+
+    drain_events(h);
+    if (!h->valid)
+        scan(h);
+    *dir = &h->dir;
+    return 0;
+}
+
+static int hd_open(void *ctx, const char *name, uint8_t type, int write)
+{
+    struct hostdir *h = ctx;
+    char full[512], host[DRIVE_NAME_MAX + 1];
+    uint16_t i;
+    int n;
+
+    for (n = 0; n < HANDLES && h->fd[n] >= 0; n++)
+        ;
+    if (n == HANDLES)
+        return -1;
+
+    if (write) {
+        if (to_host(host, name) != 0)
+            return DRIVE_BAD_NAME;
+        snprintf(full, sizeof(full), "%s/%s.%s", h->path, host, ext_of(type));
+        h->fd[n] = open(full, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    } else {
+        for (i = 0; i < h->dir.count; i++) {
+            if (!strcmp(h->entries[i].name, name))
+                break;
+        }
+        if (i == h->dir.count)
+            return -1;
+        snprintf(full, sizeof(full), "%s/%s", h->path, h->files[i]);
+        h->fd[n] = open(full, O_RDONLY);
+    }
+    return h->fd[n] >= 0 ? n : -1;
+}
+
+// LOAD asks for the whole file at once, which becomes one read() into RAM
+static long hd_read(void *ctx, int handle, uint8_t *dst, long len)
+{
+    struct hostdir *h = ctx;
+    long done = 0;
+
+    while (done < len) {
+        ssize_t n = read(h->fd[handle], dst + done, (size_t)(len - done));
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+static long hd_write(void *ctx, int handle, const uint8_t *src, long len)
+{
+    struct hostdir *h = ctx;
+    ssize_t n = write(h->fd[handle], src, (size_t)len);
+
+    return n < 0 ? 0 : (long)n;
+}
+
+static void hd_close(void *ctx, int handle)
+{
+    struct hostdir *h = ctx;
+
+    close(h->fd[handle]);
+    h->fd[handle] = -1;
+}
+
+static const struct drive_ops hostdir_ops = {
+    hd_dir, hd_open, hd_read, hd_write, hd_close, NULL
+};
+
+int hostdir_mount(uint8_t device, const char *path)
+{
+    struct hostdir *h;
+    struct stat st;
+    int n;
+
+    if (device < DRIVE_FIRST || device > DRIVE_LAST ||
+        stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        platform_msg("hostdir: %s is not a directory\n", path);
+        return -1;
+    }
+    h = calloc(1, sizeof(*h));
+    if (!h)
+        return -1;
+    strncpy(h->path, path, sizeof(h->path) - 1);
+    n = (int)strlen(h->path);
+    while (n > 1 && h->path[n - 1] == '/')
+        h->path[--n] = 0;
+    for (n = 0; n < HANDLES; n++)
+        h->fd[n] = -1;
+
+    h->notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (h->notify >= 0 &&
+        inotify_add_watch(h->notify, path, IN_CREATE | IN_DELETE | IN_MODIFY |
+                          IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+        close(h->notify);
+        h->notify = -1;
+    }
+
+    free(mounts[device - DRIVE_FIRST]);
+    mounts[device - DRIVE_FIRST] = h;
+    return drive_attach(device, &hostdir_ops, h);
+}
+
+#else
+
+int hostdir_mount(uint8_t device, const char *path)
+{
+    (void)device;
+    platform_msg("hostdir: %s: host directories need a Linux host\n", path);
+    return -1;
+}
+
+#endif
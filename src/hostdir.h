@@ -0,0 +1,8 @@
+#ifndef __HOSTDIR_H
+#define __HOSTDIR_H
+
+#include <stdint.h>
+
+int hostdir_mount(uint8_t device, const char *path);
+
+#endif
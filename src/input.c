@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "platform.h"
+#include "input.h"
+#include "record.h"
+
+// Matrix position of a key: PA bit (column) and PB bit (row)
+#define KEY(col, row)   (0x80 | ((col) << 3) | (row))
+#define SHIFTED         0x40
+#define LSHIFT_COL      1
+#define LSHIFT_ROW      7
+
+// PETSCII to matrix position, 0 = no key
+static const uint8_t petscii_keys[256] = {
+    [0x03] = KEY(7, 7),                 // RUN/STOP
+    [0x0D] = KEY(0, 1),                 // RETURN
+    [0x11] = KEY(0, 7),                 // cursor down
+    [0x13] = KEY(6, 3),                 // HOME
+    [0x14] = KEY(0, 0),                 // DEL
+    [0x1D] = KEY(0, 2),                 // cursor right
+    [0x20] = KEY(7, 4),
+    ['!'] = KEY(7, 0) | SHIFTED, ['"'] = KEY(7, 3) | SHIFTED,
+    ['#'] = KEY(1, 0) | SHIFTED, ['$'] = KEY(1, 3) | SHIFTED,
+    ['%'] = KEY(2, 0) | SHIFTED, ['&'] = KEY(2, 3) | SHIFTED,
+    ['\''] = KEY(3, 0) | SHIFTED, ['('] = KEY(3, 3) | SHIFTED,
+    [')'] = KEY(4, 0) | SHIFTED,
+    ['*'] = KEY(6, 1), ['+'] = KEY(5, 0), [','] = KEY(5, 7), ['-'] = KEY(5, 3),
+    ['.'] = KEY(5, 4), ['/'] = KEY(6, 7),
+    ['0'] = KEY(4, 3), ['1'] = KEY(7, 0), ['2'] = KEY(7, 3), ['3'] = KEY(1, 0),
+    ['4'] = KEY(1, 3), ['5'] = KEY(2, 0), ['6'] = KEY(2, 3), ['7'] = KEY(3, 0),
+    ['8'] = KEY(3, 3), ['9'] = KEY(4, 0),
+    [':'] = KEY(5, 5), [';'] = KEY(6, 2),
+    ['<'] = KEY(5, 7) | SHIFTED, ['='] = KEY(6, 5), ['>'] = KEY(5, 4) | SHIFTED,
+    ['?'] = KEY(6, 7) | SHIFTED, ['@'] = KEY(5, 6),
+    ['A'] = KEY(1, 2), ['B'] = KEY(3, 4), ['C'] = KEY(2, 4), ['D'] = KEY(2, 2),
+    ['E'] = KEY(1, 6), ['F'] = KEY(2, 5), ['G'] = KEY(3, 2), ['H'] = KEY(3, 5),
+    ['I'] = KEY(4, 1), ['J'] = KEY(4, 2), ['K'] = KEY(4, 5), ['L'] = KEY(5, 2),
+    ['M'] = KEY(4, 4), ['N'] = KEY(4, 7), ['O'] = KEY(4, 6), ['P'] = KEY(5, 1),
+    ['Q'] = KEY(7, 6), ['R'] = KEY(2, 1), ['S'] = KEY(1, 5), ['T'] = KEY(2, 6),
+    ['U'] = KEY(3, 6), ['V'] = KEY(3, 7), ['W'] = KEY(1, 1), ['X'] = KEY(2, 7),
+    ['Y'] = KEY(3, 1), ['Z'] = KEY(1, 4),
+    ['['] = KEY(5, 5) | SHIFTED,
+    [0x5C] = KEY(6, 0),                 // pound
+    [']'] = KEY(6, 2) | SHIFTED,
+    [0x5E] = KEY(6, 6),                 // up arrow
+    [0x5F] = KEY(7, 1),                 // left arrow
+    [0x85] = KEY(0, 4), [0x86] = KEY(0, 5), [0x87] = KEY(0, 6), [0x88] = KEY(0, 3),
+    [0x89] = KEY(0, 4) | SHIFTED, [0x8A] = KEY(0, 5) | SHIFTED,
+    [0x8B] = KEY(0, 6) | SHIFTED, [0x8C] = KEY(0, 3) | SHIFTED,
+    [0x91] = KEY(0, 7) | SHIFTED,       // cursor up
+    [0x93] = KEY(6, 3) | SHIFTED,       // CLR
+    [0x94] = KEY(0, 0) | SHIFTED,       // INST
+    [0x9D] = KEY(0, 2) | SHIFTED,       // cursor left
+    [0xC1] = KEY(1, 2) | SHIFTED, [0xC2] = KEY(3, 4) | SHIFTED,
+    [0xC3] = KEY(2, 4) | SHIFTED, [0xC4] = KEY(2, 2) | SHIFTED,
+    [0xC5] = KEY(1, 6) | SHIFTED, [0xC6] = KEY(2, 5) | SHIFTED,
+    [0xC7] = KEY(3, 2) | SHIFTED, [0xC8] = KEY(3, 5) | SHIFTED,
+    [0xC9] = KEY(4, 1) | SHIFTED, [0xCA] = KEY(4, 2) | SHIFTED,
+    [0xCB] = KEY(4, 5) | SHIFTED, [0xCC] = KEY(5, 2) | SHIFTED,
+    [0xCD] = KEY(4, 4) | SHIFTED, [0xCE] = KEY(4, 7) | SHIFTED,
+    [0xCF] = KEY(4, 6) | SHIFTED, [0xD0] = KEY(5, 1) | SHIFTED,
+    [0xD1] = KEY(7, 6) | SHIFTED, [0xD2] = KEY(2, 1) | SHIFTED,
+    [0xD3] = KEY(1, 5) | SHIFTED, [0xD4] = KEY(2, 6) | SHIFTED,
+    [0xD5] = KEY(3, 6) | SHIFTED, [0xD6] = KEY(3, 7) | SHIFTED,
+    [0xD7] = KEY(1, 1) | SHIFTED, [0xD8] = KEY(2, 7) | SHIFTED,
+    [0xD9] = KEY(3, 1) | SHIFTED, [0xDA] = KEY(1, 4) | SHIFTED,
+};
+
+static EMU_TLS uint8_t matrix[8];       // per column, bit set = key in that row down
+static EMU_TLS uint8_t joy[2];          // port 1, port 2; active high
+static EMU_TLS uint8_t queue[INPUT_QUEUE];
+static EMU_TLS uint8_t q_head, q_tail;
+static EMU_TLS uint8_t held;            // frames left for the key in the matrix
+static EMU_TLS uint8_t host_off;        // machine doesn't read the host keyboard
+
+// Queue a key, returns 0 if the queue is full or it has no matrix position
+int input_key(uint8_t petscii)
+{
+    uint8_t next = (q_head + 1) % INPUT_QUEUE;
+
+    if (!petscii_keys[petscii] || next == q_tail)
+        return 0;
+    queue[q_head] = petscii;
+    q_head = next;
+    return 1;
+}
+
+void input_joystick(uint8_t port, uint8_t bits)
+{
+    uint8_t ev[2];
+
+    if ((port != 1 && port != 2) || joy[port - 1] == (bits & 0x1F))
+        return;
+    joy[port - 1] = bits & 0x1F;
+    ev[0] = port;
+    ev[1] = joy[port - 1];
+    record_input(REC_JOY, ev, sizeof(ev));
+}
+
+// Detach this thread's machine from the host keyboard and joysticks
+void input_host(int on)
+{
+    host_off = !on;
+}
+
+// Replay: the matrix exactly as it was recorded
+void input_set_matrix(const uint8_t *columns)
+{
+    memcpy(matrix, columns, sizeof(matrix));
+}
+
+// Pick up whatever the host has for us; never more often than once a frame
+static void poll_host(void)
+{
+    int key;
+
+    while ((q_head + 1) % INPUT_QUEUE != q_tail &&
+           (key = platform_key()) != PLATFORM_NO_KEY)
+        input_key((uint8_t)key);
+
+    input_joystick(1, platform_joystick(1));
+    input_joystick(2, platform_joystick(2));
+}
+
+void input_frame(void)
+{
+    uint8_t code;
+
+    // a replay sets matrix and joysticks from the recording
+    if (record_mode == REPLAYING)
+        return;
+    if (!host_off)
+        poll_host();
+
+    // down for INPUT_HOLD frames, then up for one so repeats register
+    if (held) {
+        if (--held == 0) {
+            memset(matrix, 0, sizeof(matrix));
+            record_input(REC_MATRIX, matrix, sizeof(matrix));
+        }
+        return;
+    }
+    if (q_tail == q_head)
+        return;
+
+    code = petscii_keys[queue[q_tail]];
+    q_tail = (q_tail + 1) % INPUT_QUEUE;
+    matrix[(code >> 3) & 7] |= 1 << (code & 7);
+    if (code & SHIFTED)
+        matrix[LSHIFT_COL] |= 1 << LSHIFT_ROW;
+    held = INPUT_HOLD;
+    record_input(REC_MATRIX, matrix, sizeof(matrix));
+}
+
+// $DC00 read: column lines, pulled low by keys in rows driven low on port B
+// and by joystick 2.  pa/pb are the port outputs, inputs reading high.
+uint8_t input_port_a(uint8_t pa, uint8_t pb)
+{
+    uint8_t col, row;
+
+    for (col = 0; col < 8; col++) {
+        for (row = 0; row < 8; row++) {
+            if ((matrix[col] & (1 << row)) && !(pb & (1 << row)))
+                pa &= ~(1 << col);
+        }
+    }
+    return pa & ~joy[1];
+}
+
+// $DC01 read: the rows of every column driven low on port A, and joystick 1
+uint8_t input_port_b(uint8_t pa, uint8_t pb)
+{
+    uint8_t col;
+
+    for (col = 0; col < 8; col++) {
+        if (!(pa & (1 << col)))
+            pb &= ~matrix[col];
+    }
+    return pb & ~joy[0];
+}
@@ -0,0 +1,29 @@
+#ifndef __INPUT_H
+#define __INPUT_H
+
+#include <stdint.h>
+
+// CIA1 keyboard matrix and joystick ports.  Host keys arrive as PETSCII in
+// a queue that is drained once per frame: each key is held down in the
+// matrix for INPUT_HOLD frames and released for one, which is what the
+// KERNAL (or a game's own scan) needs to see it.
+
+#define INPUT_QUEUE             32
+#define INPUT_HOLD              2
+
+// Joystick bits as seen by the guest, active high here
+#define JOY_UP                  0x01
+#define JOY_DOWN                0x02
+#define JOY_LEFT                0x04
+#define JOY_RIGHT               0x08
+#define JOY_FIRE                0x10
+
+int     input_key(uint8_t petscii);
+void    input_joystick(uint8_t port, uint8_t bits);
+void    input_set_matrix(const uint8_t *columns);
+void    input_host(int on);
+void    input_frame(void);
+uint8_t input_port_a(uint8_t pa, uint8_t pb);
+uint8_t input_port_b(uint8_t pa, uint8_t pb);
+
+#endif
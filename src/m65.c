@@ -1,170 +1,126 @@
-#include "m65.h"
+#include <stdio.h>
+
+#include "platform.h"
+#include "dmagic.h"
 
 
-struct dmagic_dmalist dmalist;
 uint8_t dma_byte;
 
+// dma_peek/dma_poke move one byte through dma_byte, which lives in the
+// first MB; their jobs are set up once and only the far side is patched
+static uint8_t peek_job[DMAGIC_JOB_SIZE] = DMAGIC_JOB(DMAGIC_COPY);
+static uint8_t poke_job[DMAGIC_JOB_SIZE] = DMAGIC_JOB(DMAGIC_COPY);
+
+// screen and colour RAM, one chained list per frame; the colour goes
+// through color_stage to drop its upper nibble, which is open bus on a
+// C64 but selects blink/reverse/underline on the VIC-IV
+static struct dmagic_batch show;
+static uint8_t color_stage[1000];
 
-void do_dma(void)
+void dmagic_trigger(const uint8_t *list)
 {
-    //  unsigned char i;
     mega65_io_enable();
 
-    //  for(i=0;i<24;i++)
-    //    printf("%02x ",PEEK(i+(uint16_t)&dmalist));
-    //  printf("\n");
-    //  while(1) continue;
-
     // Now run DMA job (to and from anywhere, and list is in low 1MB)
     POKE(0xd702U, 0);
     POKE(0xd704U, 0x00); // List is in $00xxxxx
-    POKE(0xd701U, ((uint16_t)&dmalist) >> 8);
-    POKE(0xd705U, ((uint16_t)&dmalist) & 0xff); // triggers enhanced DMA
+    POKE(0xd701U, ((uint16_t)list) >> 8);
+    POKE(0xd705U, ((uint16_t)list) & 0xff); // triggers enhanced DMA
 }
 
 uint8_t dma_peek(uint32_t address)
 {
     // Read the byte at <address> in 28-bit address space
-    // XXX - Optimise out repeated setup etc
-    // (separate DMA lists for peek, poke and copy should
-    // save space, since most fields can stay initialised).
-
-    dmalist.option_0b = 0x0b;
-    dmalist.option_80 = 0x80;
-    dmalist.source_mb = (uint8_t)(address >> 20);
-    dmalist.option_81 = 0x81;
-    dmalist.dest_mb = 0x00; // dma_byte lives in 1st MB
-    dmalist.option_85 = 0x85;
-    dmalist.dest_skip = 1;
-    dmalist.end_of_options = 0x00;
-    dmalist.sub_cmd = 0x00;
-
-    dmalist.command = DMA_COPY_CMD;
-    dmalist.count = 1;
-    dmalist.source_addr = address & 0xffff;
-    dmalist.source_bank = (address >> 16) & 0x0f;
-    dmalist.dest_addr = (uint16_t)&dma_byte;
-    dmalist.dest_bank = 0;
-
-    do_dma();
+    if (!peek_job[DMAGIC_COUNT]) {
+        dmagic_set_dest(peek_job, (uint16_t)&dma_byte);
+        dmagic_set_count(peek_job, 1);
+    }
+    dmagic_set_source(peek_job, address);
+    dmagic_trigger(peek_job);
 
     return dma_byte;
 }
 
-
 void dma_poke(uint32_t address, uint8_t value)
 {
-    dmalist.option_0b = 0x0b;
-    dmalist.option_80 = 0x80;
-    dmalist.source_mb = 0x00; // dma_byte lives in 1st MB
-    dmalist.option_81 = 0x81;
-    dmalist.dest_mb = (uint8_t)(address >> 20);
-    dmalist.option_85 = 0x85;
-    dmalist.dest_skip = 1;
-    dmalist.end_of_options = 0x00;
-    dmalist.sub_cmd = 0x00;
-
+    if (!poke_job[DMAGIC_COUNT]) {
+        dmagic_set_source(poke_job, (uint16_t)&dma_byte);
+        dmagic_set_count(poke_job, 1);
+    }
     dma_byte = value;
-    dmalist.command = DMA_COPY_CMD;
-    dmalist.count = 1;
-    dmalist.source_addr = (uint16_t)&dma_byte;
-    dmalist.source_bank = 0;
-    dmalist.dest_addr = address & 0xffff;
-    dmalist.dest_bank = (address >> 16) & 0x0f;
-
-    do_dma();
-    return;
+    dmagic_set_dest(poke_job, address);
+    dmagic_trigger(poke_job);
 }
 
-void lcopy(
-    uint32_t source_address, uint32_t destination_address, size_t count)
+void mega65_io_enable(void)
 {
-    dmalist.option_0b = 0x0b;
-    dmalist.option_80 = 0x80;
-    dmalist.source_mb = (uint8_t)(source_address >> 20);
-    dmalist.option_81 = 0x81;
-    dmalist.dest_mb = (uint8_t)(destination_address >> 20);
-    dmalist.option_85 = 0x85;
-    dmalist.dest_skip = 1;
-    dmalist.end_of_options = 0x00;
-    dmalist.sub_cmd = 0x00;
-
-    dmalist.command = DMA_COPY_CMD;
-    dmalist.count = count;
-    dmalist.sub_cmd = 0;
-    dmalist.source_addr = source_address & 0xffff;
-    dmalist.source_bank = (source_address >> 16) & 0x0f;
-    // User should provide 28-bit address for IO
-    // (otherwise we can't DMA to/from RAM under IO)
-    //  if (source_address>=0xd000 && source_address<0xe000)
-    //    dmalist.source_bank|=0x80;
-    dmalist.dest_addr = destination_address & 0xffff;
-    dmalist.dest_bank = (destination_address >> 16) & 0x0f;
-    // User should provide 28-bit address for IO
-    // (otherwise we can't DMA to/from RAM under IO)
-    //  if (destination_address>=0xd000 && destination_address<0xe000)
-    //    dmalist.dest_bank|=0x80;
-
-    do_dma();
-    return;
+    POKE(0xd02fU, 0x47);
+    POKE(0xd02fU, 0x53);
+    // Force to full speed
+    POKE(0, 65);
 }
 
-void lfill(uint32_t destination_address, uint8_t value, size_t count)
+// ── platform backend ────────────────────────────────────────────
+
+uint8_t __huge *platform_bank(uint8_t bank)
 {
-    dmalist.option_0b = 0x0b;
-    dmalist.option_80 = 0x80;
-    dmalist.source_mb = 0x00;
-    dmalist.option_81 = 0x81;
-    dmalist.dest_mb = (uint8_t)(destination_address >> 20);
-    dmalist.option_85 = 0x85;
-    dmalist.dest_skip = 1;
-    dmalist.end_of_options = 0x00;
-
-    dmalist.command = DMA_FILL_CMD;
-    dmalist.sub_cmd = 0;
-    dmalist.count = count;
-    dmalist.source_addr = value;
-    dmalist.dest_addr = destination_address & 0xffff;
-    dmalist.dest_bank = (destination_address >> 16) & 0x0f;
-    // User should provide 28-bit address for IO
-    // (otherwise we can't DMA to/from RAM under IO)
-    //  if (destination_address>=0xd000 && destination_address<0xe000)
-    //    dmalist.dest_bank|=0x80;
-
-    do_dma();
-    return;
+    return (uint8_t __huge *)((uint32_t)bank << 16);
 }
 
-void lfill_skip(
-    uint32_t destination_address, uint8_t value, size_t count, uint8_t skip)
+void platform_init(void)
 {
-    dmalist.option_0b = 0x0b;
-    dmalist.option_80 = 0x80;
-    dmalist.source_mb = 0x00;
-    dmalist.option_81 = 0x81;
-    dmalist.dest_mb = (uint8_t)(destination_address >> 20);
-    dmalist.option_85 = 0x85;
-    dmalist.dest_skip = skip;
-    dmalist.end_of_options = 0x00;
-
-    dmalist.command = DMA_FILL_CMD;
-    dmalist.sub_cmd = 0;
-    dmalist.count = count;
-    dmalist.source_addr = value;
-    dmalist.dest_addr = destination_address & 0xffff;
-    dmalist.dest_bank = (destination_address >> 16) & 0x0f;
-
-    do_dma();
-    return;
+    mega65_io_enable();
 }
 
-void mega65_io_enable(void)
+void platform_console_init(void)
 {
-    POKE(0xd02fU, 0x47);
-    POKE(0xd02fU, 0x53);
-    // Force to full speed
-    POKE(0, 65);
+    POKE(0xD020, 0);  // Set border color to black
+    POKE(0xD021, 0);  // Set background color to black
+
+    putchar(0x93);     // Clear screen
+    putchar(0x98);     // white text
+    putchar(0X1B);     // esc-x - 40 col screen
+    putchar(0x58);
+
+    POKE(0xD020, 14);  // Light blue border
+    POKE(0xD021, 6);   // Blue background
 }
 
+// Guest screen and colour RAM go from bank 5 to the VIC-IV's, the colour
+// masked to 4 bits on the way
+void platform_show_text(const uint8_t __huge *screen, const uint8_t __huge *color,
+                        uint8_t border, uint8_t background)
+{
+    uint16_t i;
+
+    if (!show.jobs) {
+        dmagic_batch_copy(&show, 0, HOST_SCREEN, 1000);
+        dmagic_batch_copy(&show, 0, (uint16_t)color_stage, 1000);
+    }
+    dmagic_set_source(dmagic_batch_job(&show, 0), (uint32_t)screen);
+    dmagic_set_source(dmagic_batch_job(&show, 1), (uint32_t)color);
+    dmagic_batch_run(&show);
+    for (i = 0; i < sizeof(color_stage); i++)
+        color_stage[i] &= 0x0F;
+    lcopy((uint16_t)color_stage, HOST_COLOR, sizeof(color_stage));
+    POKE(0xD020, border);
+    POKE(0xD021, background);
+}
+
+// Hardware PETSCII key queue
+int platform_key(void)
+{
+    uint8_t key = PEEK32(0xffd3619);
 
+    if (key == 0xFF || key == 0)
+        return PLATFORM_NO_KEY;
+    POKE32(0xffd3619, 0);
+    return key;
+}
 
+// Real joystick ports, active low; returned active high
+uint8_t platform_joystick(uint8_t port)
+{
+    POKE(0xDC00, 0xFF);
+    return ~PEEK(port == 1 ? 0xDC01 : 0xDC00) & 0x1F;
+}
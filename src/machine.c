@@ -0,0 +1,393 @@
+// Multi-instance library, see machine.h.  Built on the Linux host only:
+// emu.c is compiled in without its main(), like bench.c.
+
+#define EMU_NO_MAIN
+#include "emu.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/sysinfo.h>
+
+#include "machine.h"
+
+#define PAGES           256
+#define PAGE            256
+
+// A machine owns only the RAM pages it has written; every other page is
+// read from the template.  The ROMs are the one copy in bank 4.
+struct machine {
+    struct emu_state state;
+    uint64_t serial;            // new value whenever the pages change
+    uint8_t *page[PAGES];       // private copy, NULL = the template's
+    unsigned pages;             // private pages held
+};
+
+// Every new machine starts as a copy of the booted READY. state
+static struct emu_state template_state;
+static uint8_t template_ram[0x10000];
+static atomic_uint_fast64_t serials = 1;
+
+// The core indexes ram[] directly, so a thread runs its machines in one
+// flat buffer: the template plus the resident machine's own pages.
+// Switching machines only copies the pages either of them owns.
+static EMU_TLS uint8_t *work;
+static EMU_TLS uint64_t resident;               // serial of the machine in work
+static EMU_TLS uint8_t work_private[PAGES];     // page differs from the template
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Load the ROMs and boot (or restore) once on the calling thread
+int machine_setup(const char *romdir, const char *snapshot)
+{
+    bind_memory();
+    if (romset_load(romdir, 0) != 0)
+        return -1;
+    if (init(0, snapshot) != 0)
+        return -1;
+    input_host(0);
+    while (!emu_at_ready()) {
+        uint32_t end = frames_run + 1;
+        while (frames_run < end)
+            step6502();
+    }
+    emu_get_state(&template_state);
+    emu_ram_read(template_ram, 0, sizeof(template_ram));
+    return 0;
+}
+
+// A fork of the template: no RAM of its own until it writes some
+struct machine *machine_create(void)
+{
+    struct machine *m = calloc(1, sizeof(*m));
+
+    if (!m)
+        return NULL;
+    m->state  = template_state;
+    m->serial = atomic_fetch_add(&serials, 1);
+    return m;
+}
+
+void machine_destroy(struct machine *m)
+{
+    unsigned p;
+
+    if (!m)
+        return;
+    for (p = 0; p < PAGES; p++)
+        free(m->page[p]);
+    free(m);
+}
+
+// Bytes of RAM the machine holds beyond the template
+size_t machine_footprint(const struct machine *m)
+{
+    return (size_t)m->pages * PAGE;
+}
+
+void machine_read(const struct machine *m, uint8_t *dst, uint16_t address, size_t count)
+{
+    while (count) {
+        unsigned p = address >> 8, off = address & (PAGE - 1);
+        size_t n = PAGE - off < count ? PAGE - off : count;
+
+        memcpy(dst, (m->page[p] ? m->page[p] : template_ram + p * PAGE) + off, n);
+        dst += n;
+        count -= n;
+        address = (uint16_t)(address + n);
+    }
+}
+
+uint32_t machine_crc(const struct machine *m)
+{
+    uint32_t crc = 0;
+    unsigned p;
+
+    for (p = 0; p < PAGES; p++)
+        crc = crc32(crc, m->page[p] ? m->page[p] : template_ram + p * PAGE, PAGE);
+    return crc;
+}
+
+// Make m this thread's ram[]
+static int attach(struct machine *m)
+{
+    unsigned p;
+
+    if (!work) {
+        work = malloc(sizeof(template_ram));
+        if (!work)
+            return -1;
+        memcpy(work, template_ram, sizeof(template_ram));
+        memset(work_private, 0, sizeof(work_private));
+        resident = 0;
+    }
+    if (resident != m->serial) {
+        for (p = 0; p < PAGES; p++) {
+            if (m->page[p]) {
+                memcpy(work + p * PAGE, m->page[p], PAGE);
+                work_private[p] = 1;
+            } else if (work_private[p]) {
+                memcpy(work + p * PAGE, template_ram + p * PAGE, PAGE);
+                work_private[p] = 0;
+            }
+        }
+        resident = m->serial;
+    }
+    for (p = 0; p < PAGES; p++)
+        page_dirty[p] &= (uint8_t)~DIRTY_FORK;
+    ram = work;
+    return 0;
+}
+
+// Copy-on-write: every page written while attached (write6502 and the
+// host helpers mark page_dirty) becomes, or updates, a private copy
+static int detach(struct machine *m)
+{
+    unsigned p;
+    int rc = 0;
+
+    for (p = 0; p < PAGES; p++) {
+        if (!(page_dirty[p] & DIRTY_FORK))
+            continue;
+        page_dirty[p] &= (uint8_t)~DIRTY_FORK;
+        work_private[p] = 1;
+        if (!m->page[p]) {
+            m->page[p] = malloc(PAGE);
+            if (!m->page[p]) {
+                rc = -1;
+                continue;
+            }
+            m->pages++;
+        }
+        memcpy(m->page[p], work + p * PAGE, PAGE);
+    }
+    m->serial = atomic_fetch_add(&serials, 1);
+    resident  = rc ? 0 : m->serial;
+    return rc;
+}
+
+// Put a PRG into RAM and type RUN (BASIC at $0801) or SYS into the
+// keyboard buffer, as autostart does
+int machine_load(struct machine *m, const uint8_t *prg, uint32_t len)
+{
+    uint16_t addr;
+    uint8_t EMU_HUGE *own = ram;
+    char cmd[16];
+    int rc;
+
+    if (len < 3 || prg[0] + (prg[1] << 8) + len - 2 > 0x10000)
+        return -1;
+    addr = (uint16_t)(prg[0] | (prg[1] << 8));
+
+    if (attach(m) != 0)
+        return -1;
+    emu_ram_write(addr, prg + 2, len - 2);
+    if (addr == 0x0801) {
+        autostart_set_basic_end((uint16_t)(addr + len - 2));
+        strcpy(cmd, "RUN\r");
+    } else {
+        sprintf(cmd, "SYS%u\r", addr);
+    }
+    autostart_keys((const uint8_t *)cmd, (uint8_t)strlen(cmd));
+    rc = detach(m);
+    ram = own;
+    return rc;
+}
+
+static int exited(const struct machine_exit *exit)
+{
+    switch (exit->kind) {
+        case MACHINE_EXIT_PC:    return pc == exit->addr;
+        case MACHINE_EXIT_READY: return emu_at_ready();
+        case MACHINE_EXIT_POKE:  return ram[exit->addr] == exit->value;
+        default:                 return 0;
+    }
+}
+
+// Run m on this thread until the budget is spent or the exit condition
+// holds.  The condition is checked after every instruction.
+int machine_run(struct machine *m, uint64_t budget, const struct machine_exit *exit,
+                uint64_t *cycles)
+{
+    uint8_t EMU_HUGE *own = ram;
+    uint64_t used = 0;
+    uint32_t last;
+    int result = MACHINE_BUDGET;
+
+    if (attach(m) != 0)
+        return -1;
+    emu_set_state(&m->state);
+    hookexternal(tick_50hz);
+    input_host(0);
+
+    last = clockticks6502;
+    while (used < budget) {
+        step6502();
+        used += (uint32_t)(clockticks6502 - last);
+        last = clockticks6502;
+        if (exited(exit)) {
+            result = MACHINE_EXITED;
+            break;
+        }
+    }
+
+    emu_get_state(&m->state);
+    if (detach(m) != 0)
+        result = -1;
+    ram = own;
+    if (cycles)
+        *cycles = used;
+    return result;
+}
+
+// ── Work-stealing pool ───────────────────────────────────────────────
+
+struct deque {
+    pthread_mutex_t lock;
+    unsigned *slot;             // job indices
+    unsigned head, tail;        // steal from head, pop from tail
+};
+
+struct pool {
+    struct machine_job *jobs;
+    struct deque *q;
+    unsigned threads;
+};
+
+struct worker {
+    struct pool *pool;
+    unsigned id;
+    pthread_t thread;
+};
+
+static int take(struct deque *d, int steal, unsigned *job)
+{
+    int got = 0;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->head != d->tail) {
+        *job = steal ? d->slot[d->head++] : d->slot[--d->tail];
+        got = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return got;
+}
+
+static void run_job(struct machine_job *j, unsigned worker)
+{
+    struct machine *m = j->m ? j->m : machine_create();
+    uint64_t start = now_ns();
+
+    j->worker = (uint8_t)worker;
+    j->result = 0xFF;
+    if (!m || (j->prg && machine_load(m, j->prg, j->prg_len) != 0)) {
+        if (!j->m)
+            machine_destroy(m);
+        return;
+    }
+    j->result  = (uint8_t)machine_run(m, j->budget, &j->exit, &j->cycles);
+    j->host_ns = now_ns() - start;
+    j->ram_crc = machine_crc(m);
+    j->footprint = machine_footprint(m);
+    if (!j->m)
+        machine_destroy(m);
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct pool *p = w->pool;
+    unsigned job = 0, i;
+
+    for (;;) {
+        if (take(&p->q[w->id], 0, &job)) {
+            run_job(&p->jobs[job], w->id);
+            continue;
+        }
+        // own deque is empty: steal, starting with the next worker along
+        for (i = 1; i < p->threads; i++) {
+            if (take(&p->q[(w->id + i) % p->threads], 1, &job))
+                break;
+        }
+        if (i == p->threads)
+            break;              // nothing left anywhere, no job adds more
+        run_job(&p->jobs[job], w->id);
+    }
+    free(work);
+    work = NULL;
+    return NULL;
+}
+
+// Run all jobs, threads = 0 uses every online core
+int machine_pool(struct machine_job *jobs, unsigned n, unsigned threads)
+{
+    struct pool p;
+    struct worker *w;
+    unsigned i;
+
+    if (!threads)
+        threads = (unsigned)get_nprocs();
+    if (threads < 1)
+        threads = 1;
+    if (threads > n)
+        threads = n ? n : 1;
+
+    p.jobs    = jobs;
+    p.threads = threads;
+    p.q       = calloc(threads, sizeof(*p.q));
+    w         = calloc(threads, sizeof(*w));
+    if (!p.q || !w) {
+        free(p.q);
+        free(w);
+        return -1;
+    }
+
+    // deal the jobs out round-robin, stealing evens out the long ones
+    for (i = 0; i < threads; i++) {
+        p.q[i].slot = malloc((n / threads + 1) * sizeof(unsigned));
+        if (!p.q[i].slot) {
+            while (i--) {
+                pthread_mutex_destroy(&p.q[i].lock);
+                free(p.q[i].slot);
+            }
+            free(p.q);
+            free(w);
+            return -1;
+        }
+        pthread_mutex_init(&p.q[i].lock, NULL);
+    }
+    for (i = 0; i < n; i++) {
+        struct deque *d = &p.q[i % threads];
+        d->slot[d->tail++] = i;
+    }
+
+    for (i = 0; i < threads; i++) {
+        w[i].pool = &p;
+        w[i].id   = i;
+        if (pthread_create(&w[i].thread, NULL, worker_main, &w[i]) != 0) {
+            platform_msg("machine: cannot start worker %u\n", i);
+            break;
+        }
+    }
+    // if one failed to start, this thread takes its place; the jobs of
+    // any later ones are stolen.  Either way every started worker is
+    // joined before the queues go away.
+    threads = i;
+    if (threads < p.threads)
+        worker_main(&w[threads]);
+    for (i = 0; i < threads; i++)
+        pthread_join(w[i].thread, NULL);
+
+    for (i = 0; i < p.threads; i++) {
+        pthread_mutex_destroy(&p.q[i].lock);
+        free(p.q[i].slot);
+    }
+    free(p.q);
+    free(w);
+    return 0;
+}
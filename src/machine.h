@@ -0,0 +1,63 @@
+#ifndef __MACHINE_H
+#define __MACHINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Many independent machines in one process (Linux host only).  The CPU and
+// chip state is thread-local, so every thread runs one machine at a time;
+// a machine is struct emu_state plus the 256-byte RAM pages it has written
+// since it was forked from the booted template, and can move between
+// threads.  The ROMs are loaded once and shared read-only.
+//
+// A job is a machine, a program, a cycle budget and an exit condition.
+// machine_pool() spreads jobs across worker threads; each worker has its
+// own deque and steals from the others when it runs dry.
+
+enum machine_exit_kind {
+    MACHINE_EXIT_NONE,          // run the whole budget
+    MACHINE_EXIT_PC,            // PC reaches addr
+    MACHINE_EXIT_READY,         // back at BASIC's READY. prompt
+    MACHINE_EXIT_POKE           // RAM at addr holds value
+};
+
+// Why machine_run() returned
+#define MACHINE_BUDGET          0
+#define MACHINE_EXITED          1
+
+struct machine_exit {
+    uint8_t  kind;
+    uint16_t addr;
+    uint8_t  value;
+};
+
+struct machine;
+
+struct machine_job {
+    struct machine *m;          // NULL: a fresh machine, freed after the job
+    const uint8_t *prg;         // PRG with its load address, NULL = none
+    uint32_t prg_len;
+    uint64_t budget;            // emulated cycles
+    struct machine_exit exit;
+
+    // filled in by the pool
+    uint8_t  result;            // MACHINE_BUDGET / MACHINE_EXITED, 0xFF = failed
+    uint64_t cycles;
+    uint64_t host_ns;
+    uint32_t ram_crc;
+    size_t   footprint;         // private RAM bytes at the end
+    uint8_t  worker;
+};
+
+int  machine_setup(const char *romdir, const char *snapshot);
+struct machine *machine_create(void);
+void machine_destroy(struct machine *m);
+size_t machine_footprint(const struct machine *m);
+void machine_read(const struct machine *m, uint8_t *dst, uint16_t address, size_t count);
+uint32_t machine_crc(const struct machine *m);
+int  machine_load(struct machine *m, const uint8_t *prg, uint32_t len);
+int  machine_run(struct machine *m, uint64_t budget, const struct machine_exit *exit,
+                 uint64_t *cycles);
+int  machine_pool(struct machine_job *jobs, unsigned n, unsigned threads);
+
+#endif
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "platform.h"
+#include "mapfile.h"
+
+#ifdef __linux__
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int map_file(const char *path, struct mapped_file *map, int private_write)
+{
+    struct stat st;
+    void *p;
+    int fd;
+
+    map->data = NULL;
+    map->size = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    p = mmap(NULL, (size_t)st.st_size, PROT_READ | (private_write ? PROT_WRITE : 0),
+             MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return -1;
+
+    map->data = p;
+    map->size = (size_t)st.st_size;
+    return 0;
+}
+
+void unmap_file(struct mapped_file *map)
+{
+    if (map->data)
+        munmap((void *)map->data, map->size);
+    map->data = NULL;
+    map->size = 0;
+}
+
+#else
+
+int map_file(const char *path, struct mapped_file *map, int private_write)
+{
+    FILE *f;
+    uint8_t *buf;
+    long size;
+
+    (void)private_write;
+    map->data = NULL;
+    map->size = 0;
+
+    f = fopen(path, "rb");
+    if (!f)
+        return -1;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (size > MAP_HEAP_MAX) {
+        platform_msg("mapfile: %s is %ld bytes, the MEGA65 build reads %u at most\n",
+                     path, size, MAP_HEAP_MAX);
+        fclose(f);
+        return -1;
+    }
+    if (size <= 0 || (buf = malloc((size_t)size)) == NULL) {
+        fclose(f);
+        return -1;
+    }
+    if (fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        free(buf);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    map->data = buf;
+    map->size = (size_t)size;
+    return 0;
+}
+
+void unmap_file(struct mapped_file *map)
+{
+    free((void *)map->data);
+    map->data = NULL;
+    map->size = 0;
+}
+
+#endif
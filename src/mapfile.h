@@ -0,0 +1,25 @@
+#ifndef __MAPFILE_H
+#define __MAPFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Read-only view of a whole file.  On a Linux host this is an mmap of the
+// file, elsewhere the file is read into a heap buffer.  A private mapping
+// may be written to (ROM patches); the changes never reach the file.
+//
+// build.bat links the MEGA65 program with a 4000-byte heap, so there a
+// file larger than MAP_HEAP_MAX is refused with a message: small PRGs
+// autostart, D81 images, cartridges, snapshots and recordings do not.
+
+#define MAP_HEAP_MAX            3072
+
+struct mapped_file {
+    const uint8_t *data;
+    size_t size;
+};
+
+int  map_file(const char *path, struct mapped_file *map, int private_write);
+void unmap_file(struct mapped_file *map);
+
+#endif
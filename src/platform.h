@@ -0,0 +1,59 @@
+#ifndef __PLATFORM_H
+#define __PLATFORM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// What the emulator needs from the machine it runs on: the memory banks
+// holding guest RAM and ROM, bulk copy/fill in the 28-bit MEGA65 address
+// space, a text screen to show the guest's, and a key source.
+//
+// m65.c is the MEGA65 backend (DMAgic, real VIC-IV and hardware key queue),
+// platform_linux.c a plain C one that keeps the banks and a headless
+// screen in host memory, so the same cpu.c/emu.c run on a Linux box.
+
+// EMU_TLS marks per-machine state: on a Linux host every thread can run
+// its own machine (see machine.c), the MEGA65 only ever has one.
+#ifdef __linux__
+#define EMU_HUGE
+#define EMU_TLS                 _Thread_local
+#else
+#define EMU_HUGE                __huge
+#define EMU_TLS
+#include "m65.h"
+#endif
+
+#define BANK_4_ROM              0x40000
+#define BANK_5_RAM              0x50000
+#define HOST_SCREEN             0x0800      // 40x25 text screen shown to the user
+#define HOST_COLOR              0xFF80000   // its colour RAM
+
+#define PLATFORM_NO_KEY         -1
+
+// Messages for the user.  On Linux stdout may be carrying a -ppm or -pcm
+// stream, so they go to stderr; the MEGA65 only has its screen.
+#ifdef __linux__
+#define platform_msg(...)       fprintf(stderr, __VA_ARGS__)
+#else
+#define platform_msg(...)       printf(__VA_ARGS__)
+#endif
+
+// bank 4 / 5 as the emulator addresses them
+uint8_t EMU_HUGE *platform_bank(uint8_t bank);
+
+void platform_init(void);
+void platform_console_init(void);
+void platform_show_text(const uint8_t EMU_HUGE *screen, const uint8_t EMU_HUGE *color,
+                        uint8_t border, uint8_t background);
+int  platform_key(void);
+uint8_t platform_joystick(uint8_t port);
+
+// bulk memory, 28-bit addresses
+uint8_t dma_peek(uint32_t address);
+void dma_poke(uint32_t address, uint8_t value);
+void lcopy(uint32_t source_address, uint32_t destination_address, size_t count);
+void lfill(uint32_t destination_address, uint8_t value, size_t count);
+void lfill_skip(uint32_t destination_address, uint8_t value, size_t count, uint8_t skip);
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "platform.h"
+#include "dmagic.h"
+
+// Linux backend.  The parts of the MEGA65 address space the emulator
+// touches live in host arrays; dma_peek/dma_poke and the DMAgic model
+// behind lcopy/lfill resolve a 28-bit address through the region table.  The text screen is headless:
+// the guest picture comes from video.c's renderer, the copy here is for
+// tools that want to look at the screen without rendering it.
+
+struct region {
+    uint32_t base;
+    uint32_t size;
+    uint8_t *mem;
+};
+
+static uint8_t chip_ram[0x10000];       // bank 0, holds HOST_SCREEN
+static uint8_t bank4[0x10000];
+static uint8_t bank5[0x10000];
+static uint8_t color_ram[0x8000];
+static uint8_t host_border, host_background;
+
+static const struct region regions[] = {
+    { 0x00000,    sizeof(chip_ram),  chip_ram  },
+    { BANK_4_ROM, sizeof(bank4),     bank4     },
+    { BANK_5_RAM, sizeof(bank5),     bank5     },
+    { HOST_COLOR, sizeof(color_ram), color_ram },
+};
+
+// Host pointer for [address, address + count), NULL if it isn't backed
+static uint8_t *resolve(uint32_t address, size_t count)
+{
+    unsigned i;
+
+    address &= 0x0FFFFFFF;
+    for (i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        if (address >= regions[i].base &&
+            address - regions[i].base + count <= regions[i].size)
+            return regions[i].mem + (address - regions[i].base);
+    }
+    platform_msg("platform: no memory at %07lX+%lu\n", (unsigned long)address, (unsigned long)count);
+    return NULL;
+}
+
+uint8_t *platform_bank(uint8_t bank)
+{
+    return resolve((uint32_t)bank << 16, 0x10000);
+}
+
+void platform_init(void)
+{
+}
+
+// stdout may be carrying a PPM stream, so no console codes here
+void platform_console_init(void)
+{
+}
+
+void platform_show_text(const uint8_t *screen, const uint8_t *color,
+                        uint8_t border, uint8_t background)
+{
+    memcpy(chip_ram + HOST_SCREEN, screen, 1000);
+    memcpy(color_ram, color, 1000);
+    host_border     = border;
+    host_background = background;
+}
+
+// stdin, non-blocking; ASCII turned into what the C64 keyboard would give
+int platform_key(void)
+{
+    static int nonblocking;
+    uint8_t c;
+
+    if (!nonblocking) {
+        fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+        nonblocking = 1;
+    }
+    if (read(0, &c, 1) != 1)
+        return PLATFORM_NO_KEY;
+    if (c == '\n')
+        return 0x0D;
+    if (c == 0x7F || c == 0x08)
+        return 0x14;
+    if (c >= 'a' && c <= 'z')
+        return c - 32;              // unshifted letters are capitals on screen
+    return c;
+}
+
+uint8_t platform_joystick(uint8_t port)
+{
+    (void)port;
+    return 0;
+}
+
+uint8_t dma_peek(uint32_t address)
+{
+    uint8_t *p = resolve(address, 1);
+
+    return p ? *p : 0xFF;
+}
+
+void dma_poke(uint32_t address, uint8_t value)
+{
+    uint8_t *p = resolve(address, 1);
+
+    if (p)
+        *p = value;
+}
+
+// DMA lists go through the software model, over the same memory
+void dmagic_trigger(const uint8_t *list)
+{
+    dmagic_model_run(list, resolve);
+}
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "symbols.h"
+#include "runahead.h"
+#include "profile.h"
+
+// The call stacks form a tree: a node is a function entry under its
+// caller's node, found again through a hash of (parent, address), so an
+// instruction costs one add to the current node's self cycles and a call
+// one hash probe.  Frames are popped by stack pointer, not by counting
+// RTS: a frame is gone once SP is back above where the call left it,
+// which copes with code that drops return addresses or resets the stack.
+//
+// At exit the tree is written as collapsed stacks ("a;b;c cycles", one
+// line per stack) for flamegraph.pl, speedscope and friends.
+
+#ifdef PROFILE
+
+#define HASH_SIZE               (PROFILE_NODES * 2)
+
+struct node {
+    uint32_t parent;
+    uint16_t address;           // function entry, 0 for the root
+    uint64_t cycles;            // self
+};
+
+struct frame {
+    uint32_t node;
+    uint8_t  sp;                // SP right after the call pushed
+};
+
+uint8_t profile_on = 0;
+int32_t profile_left;
+
+const uint8_t profile_stack_ops[256] = {
+    [0x20] = 1, [0x00] = 1, [0x60] = 1, [0x40] = 1, [0x9A] = 1
+};
+
+static uint64_t pc_cycles[0x10000];
+static struct node nodes[PROFILE_NODES];
+static uint32_t nnodes = 1;             // 0 is the root
+static uint32_t hash[HASH_SIZE];        // node + 1, 0 = free
+static struct frame stack[PROFILE_DEPTH];
+static unsigned depth;
+static uint32_t sample_period;
+static const char *out_path;
+
+static uint32_t child(uint32_t parent, uint16_t address)
+{
+    uint32_t h = ((parent * 2654435761u) ^ address) & (HASH_SIZE - 1);
+
+    while (hash[h]) {
+        const struct node *n = &nodes[hash[h] - 1];
+        if (n->parent == parent && n->address == address)
+            return hash[h] - 1;
+        h = (h + 1) & (HASH_SIZE - 1);
+    }
+    if (nnodes == PROFILE_NODES)
+        return parent;          // tree full, the caller takes the cycles
+    nodes[nnodes].parent  = parent;
+    nodes[nnodes].address = address;
+    hash[h] = ++nnodes;
+    return nnodes - 1;
+}
+
+static void call(uint16_t address)
+{
+    uint32_t node = child(depth ? stack[depth - 1].node : 0, address);
+
+    // deeper than we track: the frame is simply not there, SP-based
+    // unwinding still pops the tracked ones at the right time
+    if (depth < PROFILE_DEPTH) {
+        stack[depth].node = node;
+        stack[depth].sp   = sp;
+        depth++;
+    }
+}
+
+static void unwind(void)
+{
+    while (depth && stack[depth - 1].sp < sp)
+        depth--;
+}
+
+// After an instruction that is due a sample or moves the call stack
+// (every instruction without a sample period); address and opcode are
+// the instruction's, pc and sp already show its effect
+void profile_step(uint16_t address, uint8_t opcode, uint32_t cycles)
+{
+    uint32_t node;
+
+    if (runahead_active) {
+        profile_left = (int32_t)sample_period;  // the frames are run again for real
+        return;
+    }
+    node = depth ? stack[depth - 1].node : 0;
+    if (sample_period) {
+        while (profile_left <= 0) {
+            profile_left += (int32_t)sample_period;
+            pc_cycles[address] += sample_period;
+            nodes[node].cycles += sample_period;
+        }
+    } else {
+        profile_left = 0;
+        pc_cycles[address] += cycles;
+        nodes[node].cycles += cycles;
+    }
+
+    switch (opcode) {
+        case 0x20:              // JSR
+        case 0x00:              // BRK
+            call(pc);
+            break;
+        case 0x60:              // RTS
+        case 0x40:              // RTI
+        case 0x9A:              // TXS
+            unwind();
+            break;
+    }
+}
+
+// IRQ or NMI taken, pc is the handler
+void profile_interrupt(void)
+{
+    if (!runahead_active)
+        call(pc);
+}
+
+static void write_stack(FILE *f, uint32_t node)
+{
+    char name[SYMBOL_NAME_MAX + 8];
+
+    if (!node) {
+        fputs("c64", f);
+        return;
+    }
+    write_stack(f, nodes[node].parent);
+    symbols_format(name, nodes[node].address);
+    fprintf(f, ";%s", name);
+}
+
+static void profile_write(void)
+{
+    uint32_t top[PROFILE_TOP], i, j, k, n = 0;
+    uint64_t total = 0;
+    char name[SYMBOL_NAME_MAX + 8];
+    FILE *f;
+
+    for (i = 0; i < 0x10000; i++) {
+        total += pc_cycles[i];
+        if (!pc_cycles[i])
+            continue;
+        // insertion into the short top list
+        for (j = 0; j < n && pc_cycles[top[j]] >= pc_cycles[i]; j++)
+            ;
+        if (j == PROFILE_TOP)
+            continue;
+        if (n < PROFILE_TOP)
+            n++;
+        for (k = n - 1; k > j; k--)
+            top[k] = top[k - 1];
+        top[j] = i;
+    }
+
+    platform_msg("profile: %llu cycles%s, %u stacks\n", (unsigned long long)total,
+                 sample_period ? " sampled" : "", nnodes);
+    for (i = 0; i < n; i++) {
+        symbols_format(name, (uint16_t)top[i]);
+        platform_msg("  $%04X  %-24s %12llu  %5.1f%%\n", top[i], name,
+                     (unsigned long long)pc_cycles[top[i]], 100.0 * pc_cycles[top[i]] / total);
+    }
+
+    f = fopen(out_path, "w");
+    if (!f) {
+        platform_msg("profile: cannot create %s\n", out_path);
+        return;
+    }
+    for (i = 0; i < nnodes; i++) {
+        if (!nodes[i].cycles)
+            continue;
+        write_stack(f, i);
+        fprintf(f, " %llu\n", (unsigned long long)nodes[i].cycles);
+    }
+    fclose(f);
+}
+
+// Collapsed stacks go to path at exit; sample_cycles = 0 counts every cycle
+int profile_start(const char *path, uint32_t sample_cycles)
+{
+    out_path      = path;
+    sample_period = sample_cycles;
+    profile_left  = (int32_t)sample_cycles;
+    profile_on    = 1;
+    atexit(profile_write);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <stdint.h>
+
+// Guest profiler, compiled in with -DPROFILE (CFLAGS=-DPROFILE ./build.sh).
+// Cycles are counted per guest PC and per call stack; the stacks come from
+// following JSR/RTS, BRK/RTI and interrupts.  With a sample period only
+// every n-th cycle is attributed: step6502() counts profile_left down and
+// calls profile_step() only when a sample is due or the instruction moves
+// the call stack, so the others cost a subtract and a compare.
+
+#define PROFILE_NODES           65536   // distinct call stacks
+#define PROFILE_DEPTH           64      // tracked call depth
+#define PROFILE_TOP             16      // hottest PCs printed at exit
+
+extern uint8_t profile_on;
+extern int32_t profile_left;                    // cycles to the next sample, <= 0 due
+extern const uint8_t profile_stack_ops[256];    // JSR, BRK, RTS, RTI, TXS
+
+int  profile_start(const char *path, uint32_t sample_cycles);
+void profile_step(uint16_t address, uint8_t opcode, uint32_t cycles);
+void profile_interrupt(void);
+
+#endif
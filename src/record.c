@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "mapfile.h"
+#include "romset.h"
+#include "input.h"
+#include "autostart.h"
+#include "record.h"
+
+#define MAGIC_SIZE      7
+#define HEADER_SIZE     (MAGIC_SIZE + 1 + 4 + 4)
+
+static const uint8_t magic[MAGIC_SIZE] = { 'M', '6', '4', 'R', 'E', 'C', 0x1A };
+
+uint8_t record_mode = RECORD_OFF;
+
+static FILE *out;
+static struct mapped_file log_file;
+static const uint8_t *next, *end;
+static uint32_t last_cycle;             // cycle of the previous event
+static uint32_t next_cycle;             // replay: cycle the next event is due
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+uint32_t record_ram_crc(void)
+{
+    uint8_t buf[256];
+    uint32_t addr, crc = 0;
+
+    for (addr = 0; addr < 0x10000; addr += sizeof(buf)) {
+        emu_ram_read(buf, (uint16_t)addr, sizeof(buf));
+        crc = crc32(crc, buf, sizeof(buf));
+    }
+    return crc;
+}
+
+// ── recording ───────────────────────────────────────────────────
+
+void record_input(uint8_t type, const uint8_t *data, uint8_t len)
+{
+    uint32_t delta;
+
+    if (record_mode != RECORDING)
+        return;
+    delta = clockticks6502 - last_cycle;
+    last_cycle = clockticks6502;
+    while (delta >= 0x80) {
+        fputc((delta & 0x7F) | 0x80, out);
+        delta >>= 7;
+    }
+    fputc(delta, out);
+    fputc(type, out);
+    fwrite(data, 1, len, out);
+}
+
+static void record_stop(void)
+{
+    uint8_t crc[4];
+
+    put32(crc, record_ram_crc());
+    record_input(REC_END, crc, sizeof(crc));
+    fclose(out);
+    record_mode = RECORD_OFF;
+    platform_msg("record: stopped at cycle %lu, ram crc %08lX\n",
+                 (unsigned long)clockticks6502, (unsigned long)get32(crc));
+}
+
+int record_start(const char *path)
+{
+    uint8_t header[HEADER_SIZE];
+
+    out = fopen(path, "wb");
+    if (!out) {
+        platform_msg("record: cannot create %s\n", path);
+        return -1;
+    }
+    memcpy(header, magic, MAGIC_SIZE);
+    header[MAGIC_SIZE] = RECORD_VERSION;
+    put32(header + MAGIC_SIZE + 1, romset.kernal_crc);
+    put32(header + MAGIC_SIZE + 5, clockticks6502);
+    fwrite(header, 1, sizeof(header), out);
+
+    last_cycle  = clockticks6502;
+    record_mode = RECORDING;
+    atexit(record_stop);
+    return 0;
+}
+
+// ── replay ──────────────────────────────────────────────────────
+
+// Decode the cycle of the next event, 0 at the end of the log
+static int read_delta(void)
+{
+    uint32_t delta = 0;
+    uint8_t shift = 0;
+
+    do {
+        if (next >= end || shift > 28)
+            return 0;
+        delta |= (uint32_t)(*next & 0x7F) << shift;
+        shift += 7;
+    } while (*next++ & 0x80);
+    next_cycle += delta;
+    return next < end;
+}
+
+int replay_start(const char *path)
+{
+    const uint8_t *p;
+
+    if (map_file(path, &log_file, 0) != 0) {
+        platform_msg("replay: cannot open %s\n", path);
+        return -1;
+    }
+    p = log_file.data;
+    if (log_file.size < HEADER_SIZE || memcmp(p, magic, MAGIC_SIZE) != 0 ||
+        p[MAGIC_SIZE] != RECORD_VERSION) {
+        platform_msg("replay: %s is not a version %u recording\n", path, RECORD_VERSION);
+        unmap_file(&log_file);
+        return -1;
+    }
+    if (get32(p + MAGIC_SIZE + 1) != romset.kernal_crc)
+        platform_msg("replay: %s was recorded with a different KERNAL\n", path);
+    if (get32(p + MAGIC_SIZE + 5) != clockticks6502)
+        platform_msg("replay: recording starts at cycle %lu, machine is at %lu\n",
+                     (unsigned long)get32(p + MAGIC_SIZE + 5), (unsigned long)clockticks6502);
+
+    next = p + HEADER_SIZE;
+    end  = p + log_file.size;
+    next_cycle = clockticks6502;
+    if (!read_delta()) {
+        platform_msg("replay: empty recording\n");
+        unmap_file(&log_file);
+        return -1;
+    }
+    record_mode = REPLAYING;
+    return 0;
+}
+
+// Apply every event that is due; called where the recorder logs them, so
+// the cycles match exactly
+static void replay_due(void)
+{
+    while ((int32_t)(clockticks6502 - next_cycle) >= 0) {
+        uint8_t type = *next++;
+
+        switch (type) {
+            case REC_MATRIX:
+                input_set_matrix(next);
+                next += 8;
+                break;
+            case REC_JOY:
+                input_joystick(next[0], next[1]);
+                next += 2;
+                break;
+            case REC_TEXT:
+                autostart_keys(next + 1, next[0]);
+                next += 1 + next[0];
+                break;
+            case REC_END:
+                if (next_cycle != clockticks6502)
+                    platform_msg("replay: ended at cycle %lu, recorded %lu\n",
+                                 (unsigned long)clockticks6502, (unsigned long)next_cycle);
+                platform_msg("replay: ram crc %08lX, recorded %08lX\n",
+                             (unsigned long)record_ram_crc(), (unsigned long)get32(next));
+                exit(0);
+            default:
+                platform_msg("replay: bad event %02X\n", type);
+                exit(1);
+        }
+        if (!read_delta()) {
+            platform_msg("replay: recording ends without an end marker\n");
+            record_mode = RECORD_OFF;
+            unmap_file(&log_file);
+            return;
+        }
+    }
+}
+
+void record_frame(void)
+{
+    if (record_mode == REPLAYING)
+        replay_due();
+}
@@ -0,0 +1,35 @@
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include <stdint.h>
+
+// Input recording and replay.  Every host input that reaches the machine
+// (keyboard matrix changes, joysticks, text typed into the KERNAL buffer)
+// is logged against clockticks6502.  A replay feeds the same events back
+// at the same cycles instead of reading the host, so runs started with the
+// same ROMs, snapshot/autostart options and recording end with the same RAM.
+//
+// File layout: "M64REC\x1a" magic, u8 version, u32 KERNAL CRC, u32 start
+// cycle (all little-endian), then events: varint cycle delta, u8 type,
+// payload.  REC_END carries the CRC-32 of RAM when the recording stopped.
+
+#define RECORD_VERSION          1
+
+#define REC_MATRIX              1       // 8 bytes, one per column
+#define REC_JOY                 2       // port, bits
+#define REC_TEXT                3       // length, PETSCII
+#define REC_END                 4       // u32 RAM CRC
+
+#define RECORD_OFF              0
+#define RECORDING               1
+#define REPLAYING               2
+
+extern uint8_t record_mode;
+
+int  record_start(const char *path);
+int  replay_start(const char *path);
+void record_input(uint8_t type, const uint8_t *data, uint8_t len);
+void record_frame(void);
+uint32_t record_ram_crc(void);
+
+#endif
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "platform.h"
+#include "cart.h"
+#include "watch.h"
+#include "runahead.h"
+#include "reu.h"
+
+// Registers:
+//   $DF00 status       $DF01 command       $DF02/03 C64 address
+//   $DF04-06 REU address ($DF06 bank)      $DF07/08 length, 0 = 64K
+//   $DF09 IRQ mask     $DF0A address control (fix C64 / fix REU address)
+//
+// Address and length writes go to the live registers and to a shadow
+// copy, autoload puts the shadow back after a transfer.  A command with
+// bit 7 set runs at once, or at the next write to $FF00 if bit 4 is clear.
+//
+// Transfers whose C64 side is plain RAM run as a handful of bulk copies,
+// split only where the REU address wraps.  Those touching I/O or ROM,
+// wrapping past $FFFF or with a fixed address go a byte at a time through
+// read6502 and write6502, the way the REU sees the bus.  Either way the CPU is
+// stalled for a cycle per byte, two for a swap.
+
+#define CMD_EXECUTE     0x80
+#define CMD_AUTOLOAD    0x20
+#define CMD_NO_FF00     0x10
+
+#define OP_STASH        0               // C64 to REU
+#define OP_FETCH        1               // REU to C64
+#define OP_SWAP         2
+#define OP_VERIFY       3
+
+#define FIX_C64         0x80
+#define FIX_REU         0x40
+
+#define CHUNK           256             // swap and verify go through buffers this size
+
+#ifndef __linux__
+#define REU_ATTIC       0x8000000       // MEGA65 attic RAM, 8 MB
+#endif
+
+uint32_t reu_size;
+EMU_TLS uint8_t reu_status;
+EMU_TLS uint8_t reu_armed;
+
+static EMU_TLS uint8_t  command, irq_mask, control;
+static EMU_TLS uint16_t c64_addr, length, shadow_c64, shadow_length;
+static EMU_TLS uint32_t reu_addr, shadow_reu;
+static EMU_TLS uint8_t  busy;           // a transfer is on the bus
+
+// emu.c, the C64 bus as the CPU sees it
+uint8_t read6502(uint16_t address);
+void write6502(uint16_t address, uint8_t value);
+
+// ── REU memory ──────────────────────────────────────
+
+#ifdef __linux__
+
+static uint8_t *mem;
+
+// While run-ahead speculates, what a transfer overwrites in REU memory is
+// kept here first, in order, so that reu_restore() can put it back
+struct undo {
+    uint32_t reu, count;
+    size_t   at;                        // in undo_data
+};
+
+static struct undo *undo;
+static unsigned undo_n, undo_max;
+static uint8_t *undo_data;
+static size_t   undo_used, undo_size;
+
+static void journal(uint32_t reu, uint32_t count)
+{
+    if (!runahead_active)
+        return;
+    if (undo_n == undo_max) {
+        undo_max = undo_max ? undo_max * 2 : 64;
+        undo = realloc(undo, undo_max * sizeof(*undo));
+    }
+    while (undo_used + count > undo_size) {
+        undo_size = undo_size ? undo_size * 2 : 0x10000;
+        undo_data = realloc(undo_data, undo_size);
+    }
+    if (!undo || !undo_data) {
+        platform_msg("reu: out of memory for the run-ahead journal\n");
+        exit(1);
+    }
+    undo[undo_n].reu   = reu;
+    undo[undo_n].count = count;
+    undo[undo_n].at    = undo_used;
+    memcpy(undo_data + undo_used, mem + reu, count);
+    undo_used += count;
+    undo_n++;
+}
+
+// Newest first, so each byte ends up as it was before the first write
+static void unwind(void)
+{
+    while (undo_n) {
+        undo_n--;
+        memcpy(mem + undo[undo_n].reu, undo_data + undo[undo_n].at, undo[undo_n].count);
+    }
+    undo_used = 0;
+}
+
+static void c64_to_reu(uint16_t c64, uint32_t reu, uint32_t count)
+{
+    journal(reu, count);
+    memcpy(mem + reu, ram + c64, count);
+}
+
+static void reu_to_c64(uint32_t reu, uint16_t c64, uint32_t count)
+{
+    memcpy(ram + c64, mem + reu, count);
+}
+
+static void reu_to_host(uint8_t *dst, uint32_t reu, uint32_t count)
+{
+    memcpy(dst, mem + reu, count);
+}
+
+static void host_to_reu(uint32_t reu, const uint8_t *src, uint32_t count)
+{
+    journal(reu, count);
+    memcpy(mem + reu, src, count);
+}
+
+#else
+
+static void c64_to_reu(uint16_t c64, uint32_t reu, uint32_t count)
+{
+    lcopy((uint32_t)ram + c64, REU_ATTIC + reu, count);
+}
+
+static void reu_to_c64(uint32_t reu, uint16_t c64, uint32_t count)
+{
+    lcopy(REU_ATTIC + reu, (uint32_t)ram + c64, count);
+}
+
+static void reu_to_host(uint8_t *dst, uint32_t reu, uint32_t count)
+{
+    lcopy(REU_ATTIC + reu, (uint32_t)dst, count);
+}
+
+static void host_to_reu(uint32_t reu, const uint8_t *src, uint32_t count)
+{
+    lcopy((uint32_t)src, REU_ATTIC + reu, count);
+}
+
+static void unwind(void)
+{
+}
+
+#endif
+
+int reu_open(unsigned kb)
+{
+    if (kb < REU_MIN_KB || kb > REU_MAX_KB || (kb & (kb - 1))) {
+        platform_msg("reu: size must be a power of two from %u to %u KB\n", REU_MIN_KB, REU_MAX_KB);
+        return -1;
+    }
+#ifdef __linux__
+    mem = calloc(kb, 1024);
+    if (!mem) {
+        platform_msg("reu: cannot allocate %u KB\n", kb);
+        return -1;
+    }
+#else
+    if (kb > 8192) {
+        platform_msg("reu: attic RAM holds 8192 KB at most\n");
+        return -1;
+    }
+#endif
+    reu_size   = (uint32_t)kb * 1024;
+    reu_status = kb > 128 ? REU_256K_CHIPS : 0;
+    command    = CMD_NO_FF00;
+    length     = shadow_length = 0xFFFF;
+    return 0;
+}
+
+// ── registers ───────────────────────────────────────
+
+uint8_t reu_read(uint16_t address)
+{
+    uint8_t value;
+
+    if (busy)
+        return 0xFF;                    // its own registers, from its own DMA
+    switch (address & 0x1F) {
+        case 0x00:
+            value = reu_status;
+            reu_status &= ~(REU_IRQ_PENDING | REU_END_OF_BLOCK | REU_VERIFY_ERROR);
+            return value;
+        case 0x01: return command;
+        case 0x02: return (uint8_t)c64_addr;
+        case 0x03: return (uint8_t)(c64_addr >> 8);
+        case 0x04: return (uint8_t)reu_addr;
+        case 0x05: return (uint8_t)(reu_addr >> 8);
+        case 0x06: return (uint8_t)(reu_addr >> 16) | (reu_size > 0x80000 ? 0x00 : 0xF8);
+        case 0x07: return (uint8_t)length;
+        case 0x08: return (uint8_t)(length >> 8);
+        case 0x09: return irq_mask | 0x1F;
+        case 0x0A: return control | 0x3F;
+    }
+    return 0xFF;
+}
+
+void reu_write(uint16_t address, uint8_t value)
+{
+    if (busy)
+        return;
+    switch (address & 0x1F) {
+        case 0x01:
+            command = value;
+            if (value & CMD_EXECUTE) {
+                if (value & CMD_NO_FF00)
+                    reu_execute();
+                else
+                    reu_armed = 1;
+            }
+            break;
+        case 0x02:
+        case 0x03:
+            shadow_c64 = address & 1 ? (shadow_c64 & 0x00FF) | (value << 8) : (shadow_c64 & 0xFF00) | value;
+            c64_addr = shadow_c64;
+            break;
+        case 0x04:
+        case 0x05:
+        case 0x06:
+            shadow_reu &= ~((uint32_t)0xFF << ((address & 0x1F) - 4) * 8);
+            shadow_reu |= (uint32_t)value << ((address & 0x1F) - 4) * 8;
+            reu_addr = shadow_reu;
+            break;
+        case 0x07:
+        case 0x08:
+            shadow_length = address & 1 ? (shadow_length & 0xFF00) | value : (shadow_length & 0x00FF) | (value << 8);
+            length = shadow_length;
+            break;
+        case 0x09: irq_mask = value; break;
+        case 0x0A: control  = value; break;
+    }
+}
+
+// ── transfers ───────────────────────────────────────
+
+// Whether the C64 side is RAM as the CPU sees it, so the transfer can
+// bypass read6502/write6502: no I/O written, no ROM read, no wrap
+static int plain_ram(uint8_t op, uint16_t c64, uint32_t count)
+{
+    uint32_t end = (uint32_t)c64 + count;
+
+    if (end > 0x10000 || (control & (FIX_C64 | FIX_REU)) || watch_armed)
+        return 0;
+    if (op != OP_STASH && c64 < 0xE000 && end > 0xD000)
+        return 0;                       // writes into I/O
+    if (op != OP_FETCH && end > 0x8000 && !((ram[0x0001] & 0x03) == 0 && !cart_mode))
+        return 0;                       // reads that may hit ROM or I/O
+    return 1;
+}
+
+// Bulk transfer; returns the bytes done, fewer on a verify error
+static uint32_t bulk(uint8_t op, uint16_t c64, uint32_t reu, uint32_t count)
+{
+    static uint8_t a[CHUNK], b[CHUNK];
+    uint32_t done = 0;
+
+    while (done < count) {
+        uint32_t n = count - done, i;
+
+        if (n > reu_size - reu)
+            n = reu_size - reu;         // the REU address wraps
+        if (op == OP_SWAP || op == OP_VERIFY)
+            n = n > CHUNK ? CHUNK : n;
+
+        switch (op) {
+            case OP_STASH:
+                c64_to_reu(c64, reu, n);
+                break;
+            case OP_FETCH:
+                reu_to_c64(reu, c64, n);
+                emu_mark_dirty(c64, n);
+                break;
+            case OP_SWAP:
+                emu_ram_read(a, c64, n);
+                reu_to_c64(reu, c64, n);
+                host_to_reu(reu, a, n);
+                emu_mark_dirty(c64, n);
+                break;
+            case OP_VERIFY:
+                emu_ram_read(a, c64, n);
+                reu_to_host(b, reu, n);
+                for (i = 0; i < n; i++) {
+                    if (a[i] != b[i]) {
+                        reu_status |= REU_VERIFY_ERROR;
+                        return done + i + 1;
+                    }
+                }
+                break;
+        }
+        done += n;
+        c64  += (uint16_t)n;
+        reu   = (reu + n) & (reu_size - 1);
+    }
+    return done;
+}
+
+// One byte at a time over the C64 bus
+static uint32_t bytewise(uint8_t op, uint16_t c64, uint32_t reu, uint32_t count)
+{
+    uint32_t done;
+
+    for (done = 0; done < count; done++) {
+        uint8_t c, r;
+
+        switch (op) {
+            case OP_STASH:
+                c = read6502(c64);
+                host_to_reu(reu, &c, 1);
+                break;
+            case OP_FETCH:
+                reu_to_host(&r, reu, 1);
+                write6502(c64, r);
+                break;
+            case OP_SWAP:
+                c = read6502(c64);
+                reu_to_host(&r, reu, 1);
+                write6502(c64, r);
+                host_to_reu(reu, &c, 1);
+                break;
+            case OP_VERIFY:
+                c = read6502(c64);
+                reu_to_host(&r, reu, 1);
+                if (c != r) {
+                    reu_status |= REU_VERIFY_ERROR;
+                    return done + 1;
+                }
+                break;
+        }
+        if (!(control & FIX_C64))
+            c64++;
+        if (!(control & FIX_REU))
+            reu = (reu + 1) & (reu_size - 1);
+    }
+    return done;
+}
+
+void reu_execute(void)
+{
+    uint8_t  op = command & 0x03;
+    uint32_t count = length ? length : 0x10000, done, left;
+
+    reu_armed = 0;
+    reu_addr &= reu_size - 1;
+    busy = 1;
+    if (plain_ram(op, c64_addr, count))
+        done = bulk(op, c64_addr, reu_addr, count);
+    else
+        done = bytewise(op, c64_addr, reu_addr, count);
+    busy = 0;
+    emu_stall(op == OP_SWAP ? done * 2 : done);
+
+    left = count - done;
+    if (command & CMD_AUTOLOAD) {
+        c64_addr = shadow_c64;
+        reu_addr = shadow_reu;
+        length   = shadow_length;
+    } else {
+        if (!(control & FIX_C64))
+            c64_addr += (uint16_t)done;
+        if (!(control & FIX_REU))
+            reu_addr = (reu_addr + done) & (reu_size - 1);
+        length = left ? (uint16_t)left : 1;
+    }
+    if (!left)
+        reu_status |= REU_END_OF_BLOCK;
+    if ((irq_mask & 0x80) && (reu_status & irq_mask & (REU_END_OF_BLOCK | REU_VERIFY_ERROR)))
+        reu_status |= REU_IRQ_PENDING;
+    command = (command & ~CMD_EXECUTE) | CMD_NO_FF00;
+}
+
+// ── run-ahead ───────────────────────────────────────
+
+static EMU_TLS struct {
+    uint8_t  command, irq_mask, control, status, armed;
+    uint16_t c64_addr, length, shadow_c64, shadow_length;
+    uint32_t reu_addr, shadow_reu;
+} saved;
+
+// Registers now; REU memory is journalled from here until reu_restore()
+void reu_save(void)
+{
+    saved.command  = command;   saved.irq_mask = irq_mask;   saved.control = control;
+    saved.status   = reu_status; saved.armed   = reu_armed;
+    saved.c64_addr = c64_addr;  saved.length   = length;
+    saved.shadow_c64 = shadow_c64; saved.shadow_length = shadow_length;
+    saved.reu_addr = reu_addr;  saved.shadow_reu = shadow_reu;
+}
+
+void reu_restore(void)
+{
+    unwind();
+    command  = saved.command;   irq_mask = saved.irq_mask;   control = saved.control;
+    reu_status = saved.status;  reu_armed = saved.armed;
+    c64_addr = saved.c64_addr;  length   = saved.length;
+    shadow_c64 = saved.shadow_c64; shadow_length = saved.shadow_length;
+    reu_addr = saved.reu_addr;  shadow_reu = saved.shadow_reu;
+}
@@ -0,0 +1,32 @@
+#ifndef __REU_H
+#define __REU_H
+
+#include <stdint.h>
+
+#include "platform.h"
+
+// 17xx RAM Expansion Unit, registers at $DF00 (mirrored every 32 bytes).
+// Its memory is a host buffer on Linux and attic RAM on the MEGA65, and a
+// transfer moves in bulk: memcpy on the host, DMAgic jobs on the MEGA65.
+
+#define REU_MIN_KB              128
+#define REU_MAX_KB              16384
+
+// $DF00 status
+#define REU_IRQ_PENDING         0x80
+#define REU_END_OF_BLOCK        0x40
+#define REU_VERIFY_ERROR        0x20
+#define REU_256K_CHIPS          0x10
+
+extern uint32_t reu_size;                       // bytes, 0 = no REU
+extern EMU_TLS uint8_t reu_status;
+extern EMU_TLS uint8_t reu_armed;               // waiting for a write to $FF00
+
+int     reu_open(unsigned kb);
+uint8_t reu_read(uint16_t address);
+void    reu_write(uint16_t address, uint8_t value);
+void    reu_execute(void);
+void    reu_save(void);                         // run-ahead
+void    reu_restore(void);
+
+#endif
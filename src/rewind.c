@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "rewind.h"
+
+#ifdef __linux__
+
+#include <signal.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PAGE            256
+#define PAGES           256
+#define ALIGN(n)        (((n) + 15) & ~(size_t)15)
+
+struct record {
+    size_t   offset, size;      // where in the arena
+    uint32_t frame;
+    uint16_t npages;            // pages stored
+    uint8_t  key;               // full image; a delta may also hold every page
+};
+
+// Arena layout of one record: state, page numbers (deltas only), pages
+struct record_head {
+    struct emu_state state;
+    uint8_t index[];
+};
+
+static uint8_t *arena;
+static size_t   budget, head;
+static struct record recs[REWIND_RECORDS];
+static unsigned first, count;
+static uint32_t frame, last_key;
+static uint8_t  shadow[PAGES * PAGE] __attribute__((aligned(16)));   // RAM as of the newest record
+static volatile sig_atomic_t pending;
+
+#define REC(i)          (recs[(first + (i)) % REWIND_RECORDS])
+
+static int page_differs(const uint8_t *a, const uint8_t *b)
+{
+#ifdef __SSE2__
+    int i;
+
+    for (i = 0; i < PAGE; i += 64) {
+        __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                    _mm_load_si128((const __m128i *)(b + i)));
+        __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 16)),
+                                    _mm_load_si128((const __m128i *)(b + i + 16)));
+        __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 32)),
+                                    _mm_load_si128((const __m128i *)(b + i + 32)));
+        __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 48)),
+                                    _mm_load_si128((const __m128i *)(b + i + 48)));
+        if (_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(e0, e1),
+                                            _mm_and_si128(e2, e3))) != 0xFFFF)
+            return 1;
+    }
+    return 0;
+#else
+    uint64_t wa, wb;
+    int i;
+
+    for (i = 0; i < PAGE; i += 8) {
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+        if (wa != wb)
+            return 1;
+    }
+    return 0;
+#endif
+}
+
+// Drop the oldest keyframe together with the deltas that depend on it
+static void evict_group(void)
+{
+    do {
+        first = (first + 1) % REWIND_RECORDS;
+        count--;
+    } while (count && !REC(0).key);
+    if (!count)
+        head = 0;
+}
+
+// Circular allocation; a record that doesn't fit before the end wraps to 0
+static size_t make_room(size_t size)
+{
+    for (;;) {
+        size_t tail;
+
+        if (!count)
+            return 0;
+        tail = REC(0).offset;
+        if (count == REWIND_RECORDS) {
+            evict_group();
+            continue;
+        }
+        if (head > tail) {
+            if (head + size <= budget)
+                return head;
+            if (size <= tail)
+                return 0;
+        } else if (head + size <= tail) {
+            return head;
+        }
+        evict_group();
+    }
+}
+
+void rewind_frame(void)
+{
+    uint8_t changed[PAGES];
+    struct record_head *rh;
+    struct record *r;
+    unsigned p, n = 0;
+    size_t size, at;
+    int key;
+
+    if (!arena)
+        return;
+    if (pending) {
+        rewind_frames((unsigned)pending);
+        pending = 0;
+        return;
+    }
+
+    frame++;
+    for (p = 0; p < PAGES; p++) {
+        if ((page_dirty[p] & DIRTY_REWIND) && page_differs(ram + p * PAGE, shadow + p * PAGE))
+            changed[n++] = (uint8_t)p;
+    }
+
+    key = !count || frame - last_key >= REWIND_KEYFRAME;
+    for (;;) {
+        size = ALIGN(sizeof(*rh) + (key ? 0 : n)) + (key ? PAGES : n) * PAGE;
+        if (size > budget)
+            return;     // dirty bits and shadow untouched, compared again next frame
+        at = make_room(size);
+        if (key || count)
+            break;
+        key = 1;        // the keyframe this delta needed was just evicted
+    }
+
+    rh = (struct record_head *)(arena + at);
+    emu_get_state(&rh->state);
+    if (key) {
+        memcpy(arena + at + ALIGN(sizeof(*rh)), ram, sizeof(shadow));
+        last_key = frame;
+    } else {
+        uint8_t *data = arena + at + ALIGN(sizeof(*rh) + n);
+        memcpy(rh->index, changed, n);
+        for (p = 0; p < n; p++)
+            memcpy(data + p * PAGE, ram + changed[p] * PAGE, PAGE);
+    }
+
+    r = &REC(count);
+    r->offset = at;
+    r->size   = size;
+    r->frame  = frame;
+    r->npages = key ? PAGES : (uint16_t)n;
+    r->key    = (uint8_t)key;
+    count++;
+    head = at + size;
+
+    // only now that the record is in does the shadow move on
+    if (key) {
+        memcpy(shadow, ram, sizeof(shadow));
+    } else {
+        for (p = 0; p < n; p++)
+            memcpy(shadow + changed[p] * PAGE, ram + changed[p] * PAGE, PAGE);
+    }
+    for (p = 0; p < PAGES; p++)
+        page_dirty[p] &= ~DIRTY_REWIND;
+}
+
+// Go back the given number of frames; newer history is discarded
+int rewind_frames(unsigned frames)
+{
+    unsigned long t0 = emu_host_ms();
+    unsigned target, k, i, p;
+    const struct record_head *rh;
+
+    if (!arena || !count)
+        return -1;
+    if (frames >= count)
+        frames = count - 1;
+    target = count - 1 - frames;
+    for (k = target; !REC(k).key; k--)
+        ;
+
+    memcpy(shadow, arena + REC(k).offset + ALIGN(sizeof(*rh)), sizeof(shadow));
+    for (i = k + 1; i <= target; i++) {
+        const uint8_t *data;
+
+        rh = (const struct record_head *)(arena + REC(i).offset);
+        data = arena + REC(i).offset + ALIGN(sizeof(*rh) + REC(i).npages);
+        for (p = 0; p < REC(i).npages; p++)
+            memcpy(shadow + rh->index[p] * PAGE, data + p * PAGE, PAGE);
+    }
+
+    rh = (const struct record_head *)(arena + REC(target).offset);
+    emu_ram_write(0, shadow, sizeof(shadow));
+    emu_set_state(&rh->state);
+    for (p = 0; p < PAGES; p++)
+        page_dirty[p] &= ~DIRTY_REWIND;
+
+    frame = REC(target).frame;
+    last_key = REC(k).frame;
+    head = REC(target).offset + REC(target).size;
+    count = target + 1;
+
+    platform_msg("rewind: back %u frames in %lu ms (%u applied, %u kept)\n",
+                 frames, emu_host_ms() - t0, target - k, count);
+    return 0;
+}
+
+static void on_sigusr2(int sig)
+{
+    (void)sig;
+    pending = REWIND_STEP;
+}
+
+int rewind_init(size_t size)
+{
+    budget = size;
+    arena = malloc(budget);
+    if (!arena) {
+        platform_msg("rewind: cannot allocate %lu bytes\n", (unsigned long)budget);
+        return -1;
+    }
+    memcpy(shadow, ram, sizeof(shadow));
+    memset(page_dirty, 0xFF, sizeof(page_dirty));   // first frame is a keyframe anyway
+    signal(SIGUSR2, on_sigusr2);
+    return 0;
+}
+
+#else
+
+int rewind_init(size_t size)
+{
+    (void)size;
+    platform_msg("rewind: needs a Linux host\n");
+    return -1;
+}
+
+void rewind_frame(void)
+{
+}
+
+int rewind_frames(unsigned frames)
+{
+    (void)frames;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __REWIND_H
+#define __REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Rewind history kept in a fixed-size ring.  Every REWIND_KEYFRAME frames a
+// full copy of RAM is stored, in between only the 256-byte pages that
+// changed since the previous frame.  When the ring is full the oldest
+// keyframe and its deltas are dropped together.
+
+#ifndef REWIND_KEYFRAME
+#define REWIND_KEYFRAME         50      // one full copy per second
+#endif
+#define REWIND_RECORDS          8192    // frames the ring can index
+#define REWIND_STEP             250     // frames per SIGUSR2
+
+int  rewind_init(size_t budget);
+void rewind_frame(void);
+int  rewind_frames(unsigned frames);
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "platform.h"
+#include "mapfile.h"
+#include "romset.h"
+
+// ROM set loading.  On a Linux host kernal.bin, basic.bin and chargen.bin
+// are mapped and basic/kernal/chars point straight into the mappings.  On
+// the MEGA65 the BOOT program has already put them in BANK_4_ROM, so they
+// are only checksummed in place.  Either way a wrong size or an unknown
+// BASIC/KERNAL revision stops the emulator before the CPU runs.
+
+struct romset romset;
+
+struct rom_revision {
+    uint32_t crc;
+    const char *name;
+};
+
+static const struct rom_revision basic_revs[] = {
+    { CRC_BASIC_901226_01, "901226-01" }, { 0, NULL }
+};
+static const struct rom_revision kernal_revs[] = {
+    { CRC_KERNAL_901227_01, "901227-01" },
+    { CRC_KERNAL_901227_02, "901227-02" },
+    { CRC_KERNAL_901227_03, "901227-03" }, { 0, NULL }
+};
+static const struct rom_revision chargen_revs[] = {
+    { CRC_CHARGEN_901225_01, "901225-01" }, { 0, NULL }
+};
+
+// Nibble-table CRC-32 (IEEE), small enough for the MEGA65 build
+uint32_t crc32(uint32_t crc, const uint8_t *p, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+// 0 = known revision, 1 = unknown
+static int check(const char *file, uint32_t crc, const struct rom_revision *revs)
+{
+    for (; revs->name; revs++) {
+        if (revs->crc == crc) {
+            platform_msg("rom: %s %s\n", file, revs->name);
+            return 0;
+        }
+    }
+    platform_msg("rom: %s has unknown revision (crc %08lX)\n", file, (unsigned long)crc);
+    return 1;
+}
+
+#ifdef __linux__
+
+static struct mapped_file maps[3];
+
+// Private writable mapping: traps may patch the KERNAL, the file is untouched
+static uint8_t *map_rom(int n, const char *dir, const char *file, size_t size, uint32_t *crc)
+{
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    if (map_file(path, &maps[n], 1) != 0) {
+        platform_msg("rom: cannot open %s\n", path);
+        return NULL;
+    }
+    if (maps[n].size != size) {
+        platform_msg("rom: %s is %lu bytes, expected %lu\n", path,
+                     (unsigned long)maps[n].size, (unsigned long)size);
+        unmap_file(&maps[n]);
+        return NULL;
+    }
+    *crc = crc32(0, maps[n].data, size);
+    return (uint8_t *)maps[n].data;
+}
+
+int romset_load(const char *dir, int force)
+{
+    uint8_t *b, *k, *c;
+    int unknown;
+
+    b = map_rom(0, dir, "basic.bin",   ROM_BASIC_SIZE,   &romset.basic_crc);
+    k = map_rom(1, dir, "kernal.bin",  ROM_KERNAL_SIZE,  &romset.kernal_crc);
+    c = map_rom(2, dir, "chargen.bin", ROM_CHARGEN_SIZE, &romset.chargen_crc);
+    if (!b || !k || !c)
+        return -1;
+
+    unknown  = check("basic.bin",  romset.basic_crc,  basic_revs);
+    unknown |= check("kernal.bin", romset.kernal_crc, kernal_revs);
+    // the character set is never executed, a custom one is fine
+    check("chargen.bin", romset.chargen_crc, chargen_revs);
+    if (unknown && !force) {
+        platform_msg("rom: refusing unknown BASIC/KERNAL, use -romforce to run anyway\n");
+        return -1;
+    }
+
+    basic  = b;
+    kernal = k;
+    chars  = c;
+    return 0;
+}
+
+#else
+
+// CRC of an image in far memory, pulled through a bounce buffer by DMA
+static uint32_t crc_far(uint32_t address, size_t len)
+{
+    static uint8_t buf[256];
+    uint32_t crc = 0;
+
+    while (len) {
+        size_t n = len > sizeof(buf) ? sizeof(buf) : len;
+        lcopy(address, (uint32_t)buf, n);
+        crc = crc32(crc, buf, n);
+        address += n;
+        len -= n;
+    }
+    return crc;
+}
+
+int romset_load(const char *dir, int force)
+{
+    int unknown;
+
+    (void)dir;
+    romset.basic_crc   = crc_far((uint32_t)basic,  ROM_BASIC_SIZE);
+    romset.kernal_crc  = crc_far((uint32_t)kernal, ROM_KERNAL_SIZE);
+    romset.chargen_crc = crc_far((uint32_t)chars,  ROM_CHARGEN_SIZE);
+
+    unknown  = check("basic.bin",  romset.basic_crc,  basic_revs);
+    unknown |= check("kernal.bin", romset.kernal_crc, kernal_revs);
+    check("chargen.bin", romset.chargen_crc, chargen_revs);
+    if (unknown && !force) {
+        platform_msg("rom: unknown BASIC/KERNAL in bank 4, RUN\"BOOT\" loads the ROMs\n");
+        return -1;
+    }
+    return 0;
+}
+
+#endif
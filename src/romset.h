@@ -0,0 +1,31 @@
+#ifndef __ROMSET_H
+#define __ROMSET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ROM_BASIC_SIZE          0x2000
+#define ROM_KERNAL_SIZE         0x2000
+#define ROM_CHARGEN_SIZE        0x1000
+
+// CRC-32 of known C64 ROM revisions
+#define CRC_BASIC_901226_01     0xF833D117u
+#define CRC_KERNAL_901227_01    0xDCE782FAu
+#define CRC_KERNAL_901227_02    0xA5C687B3u
+#define CRC_KERNAL_901227_03    0xDBE3E7C7u
+#define CRC_CHARGEN_901225_01   0xEC4272EEu
+
+// Checksums of the pristine images, before any trap is planted in them.
+// Code keyed to a ROM revision (traps, snapshots) checks these.
+struct romset {
+    uint32_t basic_crc;
+    uint32_t kernal_crc;
+    uint32_t chargen_crc;
+};
+
+extern struct romset romset;
+
+uint32_t crc32(uint32_t crc, const uint8_t *p, size_t len);
+int romset_load(const char *dir, int force);
+
+#endif
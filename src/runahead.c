@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "platform.h"
+#include "video.h"
+#include "cart.h"
+#include "reu.h"
+#include "runahead.h"
+
+EMU_TLS uint8_t runahead_active;
+uint8_t runahead_pending;
+
+#ifdef __linux__
+
+#include <time.h>
+
+// Save and restore are cheap because both only touch what changed: RAM
+// pages are copied to the shadow when their DIRTY_RUNAHEAD bit says they
+// were written since the last save, and copied back when a speculative
+// frame wrote them.  CPU, CIA and VIC state is one struct emu_state.  The
+// REU's registers are saved alongside, and what speculative transfers
+// overwrite in its memory is journalled by reu.c and put back.
+//
+// While frames run ahead only the renderer sees them, and only the last
+// one: end_frame() leaves out input, SID, recording, rewind and the
+// rest, traps let the ROM code run rather than touch host files, and the
+// watch, trace and diff hooks in main() are not called.  Watchpoints hit
+// from read6502/write6502 and the profile and heat map counters ignore
+// them too.  The real frames are held back from the renderer instead.
+//
+// The budget is the share of a PAL frame's host time the speculation may
+// take, 0 for no limit.  Over it, one frame less is run ahead; well under
+// it, one more, up to what was asked for.  At 0 frames ahead the real
+// frames are shown.
+
+#define PAGE            256
+#define PAGES           256
+#define RETRY           50              // real frames before a paused run-ahead tries again
+
+static uint8_t  shadow[PAGES * PAGE];
+static struct emu_state state;
+static uint8_t  saved_cart_mode;
+static const uint8_t *saved_roml, *saved_romh;
+
+static unsigned want, ahead;            // frames asked for, frames run ahead now
+static unsigned budget_us;
+static unsigned frames_left;
+static unsigned paused;
+
+// cpu.c
+void step6502(void);
+
+static unsigned long host_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000 + (unsigned long)now.tv_nsec / 1000;
+}
+
+static void save(void)
+{
+    unsigned p;
+
+    for (p = 0; p < PAGES; p++) {
+        if (page_dirty[p] & DIRTY_RUNAHEAD) {
+            page_dirty[p] &= ~DIRTY_RUNAHEAD;
+            memcpy(shadow + p * PAGE, ram + p * PAGE, PAGE);
+        }
+    }
+    emu_get_state(&state);
+    saved_cart_mode = cart_mode;
+    saved_roml = cart_roml;
+    saved_romh = cart_romh;
+    if (reu_size)
+        reu_save();
+}
+
+static void restore(void)
+{
+    unsigned p;
+
+    for (p = 0; p < PAGES; p++) {
+        if (page_dirty[p] & DIRTY_RUNAHEAD) {
+            page_dirty[p] &= ~DIRTY_RUNAHEAD;
+            memcpy(ram + p * PAGE, shadow + p * PAGE, PAGE);
+        }
+    }
+    emu_set_state(&state);
+    cart_mode = saved_cart_mode;
+    cart_roml = saved_roml;
+    cart_romh = saved_romh;
+    if (reu_size)
+        reu_restore();
+}
+
+// frames: how far to run ahead; budget: percent of a frame's host time
+int runahead_init(unsigned frames, unsigned budget)
+{
+    unsigned p;
+
+    if (frames < 1 || frames > RUNAHEAD_MAX) {
+        platform_msg("runahead: 1 to %u frames\n", RUNAHEAD_MAX);
+        return -1;
+    }
+    want = ahead = frames;
+    budget_us = budget * (RUNAHEAD_FRAME_US / 100);
+    memcpy(shadow, ram, sizeof(shadow));
+    for (p = 0; p < PAGES; p++)
+        page_dirty[p] &= ~DIRTY_RUNAHEAD;
+    video_hold(1);
+    return 0;
+}
+
+// End of a real frame
+void runahead_frame(void)
+{
+    if (want)
+        runahead_pending = 1;
+}
+
+// End of a speculative frame, in place of the usual end-of-frame work
+void runahead_end_frame(void)
+{
+    video_end_frame();
+    frames_left--;
+    video_hold(frames_left != 1);       // only the last one is shown
+}
+
+// From the main loop, between two instructions
+void runahead_run(void)
+{
+    unsigned long t0 = host_us(), spent;
+
+    runahead_pending = 0;
+    if (!ahead) {
+        // paused for the budget, real frames are shown; try again now and then
+        if (++paused == RETRY)
+            ahead = 1;
+        return;
+    }
+    paused = 0;
+
+    save();
+    runahead_active = 1;
+    frames_left = ahead;
+    video_hold(frames_left != 1);
+    while (frames_left)
+        step6502();
+    runahead_active = 0;
+    restore();
+    video_hold(1);
+    video_restart_frame();
+
+    spent = host_us() - t0;
+    if (budget_us && spent > budget_us) {
+        ahead--;
+        video_hold(ahead != 0);
+    } else if (spent < budget_us / 2 && ahead < want) {
+        ahead++;
+    }
+}
+
+#else
+
+int runahead_init(unsigned frames, unsigned budget)
+{
+    (void)frames; (void)budget;
+    platform_msg("runahead: needs a Linux host\n");
+    return -1;
+}
+
+void runahead_frame(void)
+{
+}
+
+void runahead_end_frame(void)
+{
+}
+
+void runahead_run(void)
+{
+}
+
+#endif
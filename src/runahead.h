@@ -0,0 +1,25 @@
+#ifndef __RUNAHEAD_H
+#define __RUNAHEAD_H
+
+#include <stdint.h>
+
+#include "platform.h"
+
+// Run-ahead: at the end of every frame, once the frame's input is in, the
+// machine is saved, run a few frames further with the input held, the
+// last of those frames is shown, and the machine is put back.  What the
+// guest does with a key or joystick move is on screen that many frames
+// sooner, for that many frames' worth of extra emulation.
+
+#define RUNAHEAD_MAX            8       // frames
+#define RUNAHEAD_FRAME_US       20000   // one PAL frame of host time
+
+extern EMU_TLS uint8_t runahead_active;     // the frames running now are speculative
+extern uint8_t runahead_pending;            // run ahead before the next instruction
+
+int  runahead_init(unsigned frames, unsigned budget);
+void runahead_frame(void);
+void runahead_end_frame(void);
+void runahead_run(void);
+
+#endif
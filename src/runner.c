@@ -0,0 +1,144 @@
+// Batch runner: every PRG on the command line becomes a job on its own
+// machine, run by a work-stealing pool across all cores.  Built on the
+// Linux host only, see build.sh.
+//
+//   runner [-romdir dir] [-snapshot file] [-threads n] [-budget cycles]
+//          [-exit ready|none|pc:ADDR|poke:ADDR=VAL] [-repeat n] [-q] prg ...
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "emu.h"
+#include "mapfile.h"
+#include "machine.h"
+
+#define RUNNER_BUDGET           (CPU_HZ * 10)   // 10 s of emulated time
+
+static const char *reasons[] = { "budget", "exit" };
+
+static int parse_exit(const char *s, struct machine_exit *e)
+{
+    char *end;
+
+    if (!strcmp(s, "ready"))
+        e->kind = MACHINE_EXIT_READY;
+    else if (!strcmp(s, "none"))
+        e->kind = MACHINE_EXIT_NONE;
+    else if (!strncmp(s, "pc:", 3)) {
+        e->kind = MACHINE_EXIT_PC;
+        e->addr = (uint16_t)strtoul(s + 3, &end, 16);
+        return *end ? -1 : 0;
+    } else if (!strncmp(s, "poke:", 5)) {
+        e->kind = MACHINE_EXIT_POKE;
+        e->addr = (uint16_t)strtoul(s + 5, &end, 16);
+        if (*end != '=')
+            return -1;
+        e->value = (uint8_t)strtoul(end + 1, &end, 16);
+        return *end ? -1 : 0;
+    } else
+        return -1;
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *romdir = "roms";
+    const char *snapshot = NULL;
+    struct machine_exit exit_on = { MACHINE_EXIT_READY, 0, 0 };
+    uint64_t budget = RUNNER_BUDGET, cycles = 0, footprint = 0, start, ns;
+    unsigned threads = 0, repeat = 1, nprg = 0, n, i;
+    int quiet = 0;
+    const char **names;
+    struct mapped_file *files;
+    struct machine_job *jobs;
+
+    names = calloc((size_t)argc, sizeof(*names));
+    if (!names)
+        return 1;
+    for (i = 1; i < (unsigned)argc; i++) {
+        if (!strcmp(argv[i], "-romdir") && i + 1 < (unsigned)argc)
+            romdir = argv[++i];
+        else if (!strcmp(argv[i], "-snapshot") && i + 1 < (unsigned)argc)
+            snapshot = argv[++i];
+        else if (!strcmp(argv[i], "-threads") && i + 1 < (unsigned)argc)
+            threads = (unsigned)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-budget") && i + 1 < (unsigned)argc)
+            budget = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-repeat") && i + 1 < (unsigned)argc)
+            repeat = (unsigned)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-q"))
+            quiet = 1;
+        else if (!strcmp(argv[i], "-exit") && i + 1 < (unsigned)argc) {
+            if (parse_exit(argv[++i], &exit_on) != 0) {
+                printf("runner: bad exit condition %s\n", argv[i]);
+                return 1;
+            }
+        } else
+            names[nprg++] = argv[i];
+    }
+    if (!nprg || !repeat) {
+        puts("usage: runner [-romdir dir] [-snapshot file] [-threads n] [-budget cycles]\n"
+             "              [-exit ready|none|pc:ADDR|poke:ADDR=VAL] [-repeat n] [-q] prg ...");
+        return 1;
+    }
+
+    // the guest must not see whatever is on our stdin
+    if (!freopen("/dev/null", "r", stdin))
+        return 1;
+    if (machine_setup(romdir, snapshot) != 0)
+        return 1;
+
+    files = calloc(nprg, sizeof(*files));
+    n = nprg * repeat;
+    jobs = calloc(n, sizeof(*jobs));
+    if (!files || !jobs)
+        return 1;
+    for (i = 0; i < nprg; i++) {
+        if (map_file(names[i], &files[i], 0) != 0)
+            return 1;
+    }
+    for (i = 0; i < n; i++) {
+        jobs[i].prg     = files[i % nprg].data;
+        jobs[i].prg_len = (uint32_t)files[i % nprg].size;
+        jobs[i].budget  = budget;
+        jobs[i].exit    = exit_on;
+    }
+
+    start = now_ns();
+    if (machine_pool(jobs, n, threads) != 0)
+        return 1;
+    ns = now_ns() - start;
+
+    if (!quiet)
+        printf("%-24s %6s %-6s %12s %10s %8s %8s\n",
+               "job", "worker", "result", "cycles", "host ms", "ram crc", "ram kb");
+    for (i = 0; i < n; i++) {
+        cycles += jobs[i].cycles;
+        footprint += jobs[i].footprint;
+        if (quiet)
+            continue;
+        printf("%-24s %6u %-6s %12llu %10.3f %08lX %8.2f\n", names[i % nprg], jobs[i].worker,
+               jobs[i].result <= MACHINE_EXITED ? reasons[jobs[i].result] : "failed",
+               (unsigned long long)jobs[i].cycles, jobs[i].host_ns / 1e6,
+               (unsigned long)jobs[i].ram_crc, jobs[i].footprint / 1024.0);
+    }
+    printf("%u jobs in %.3f s: %.1f jobs/s, %.1f emulated MHz total, %llu cycles/job, "
+           "%.2f KB RAM/job\n",
+           n, ns / 1e9, ns ? n * 1e9 / ns : 0, ns ? cycles * 1e3 / ns : 0,
+           (unsigned long long)(cycles / n), footprint / 1024.0 / n);
+
+    for (i = 0; i < nprg; i++)
+        unmap_file(&files[i]);
+    return 0;
+}
@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "platform.h"
+#include "sid.h"
+#include "runahead.h"
+
+#ifdef __linux__
+
+#include <math.h>
+
+// Writes are only logged while the frame runs.  At the end of the frame
+// (or when the log fills, or the guest reads OSC3/ENV3) the log is played
+// back: the samples up to each write's cycle are synthesised with the
+// registers as they were, then the write is applied.
+//
+// A pass over up to SID_BLOCK samples goes stage by stage, each over the
+// whole block: oscillator phases, waveforms, envelopes, then the mix and
+// the filter.  The phase and waveform loops carry nothing from one sample
+// to the next and vectorise; only sync (phases), noise, the envelopes and
+// the filter recurrence are sample by sample.
+//
+// Model notes: oscillators, sync and ring modulation are exact at sample
+// rate.  Combined waveforms are the AND of their parts.  The envelope
+// uses the real rate periods and the exponential decay steps.  The filter
+// is a state-variable one with a 6581- or 8580-like cutoff curve.  The
+// 6581's mixer DC makes $D418 volume writes audible, so 4-bit digis play.
+
+#define CPS             ((uint32_t)(((uint64_t)CPU_HZ << 16) / SID_RATE))   // cycles per sample, 16.16
+#define RESYNC_MAX      (CPU_HZ / 50)   // cycles still caught up after a restore
+
+#define ENV_ATTACK      0
+#define ENV_DECAY       1               // down to sustain, then holds
+#define ENV_RELEASE     2
+
+#define CTRL_GATE       0x01
+#define CTRL_SYNC       0x02
+#define CTRL_RING       0x04
+#define CTRL_TEST       0x08
+#define CTRL_TRI        0x10
+#define CTRL_SAW        0x20
+#define CTRL_PULSE      0x40
+#define CTRL_NOISE      0x80
+
+#define DC_6581         (0x380 * 255 * 3)  // mixer offset, volume-scaled
+
+struct voice {
+    uint64_t phase;                     // 24.16 accumulator
+    uint32_t noise;                     // 23-bit shift register
+    uint16_t freq, pw;
+    uint8_t  ctrl, ad, sr;
+    uint8_t  env, state;
+    uint32_t env_acc;                   // cycles toward the next step, 16.16
+};
+
+struct sid_write {
+    uint32_t cycle;
+    uint8_t  reg, value;
+};
+
+static const uint16_t rate_period[16] = {
+    9, 32, 63, 95, 149, 220, 267, 313, 392, 977, 1954, 3126, 3907, 11720, 19532, 31251
+};
+
+static uint8_t  sid_on;
+static uint8_t  model;
+static FILE    *out;
+static uint8_t  wav;
+static uint32_t wav_bytes;
+
+static uint8_t  regs[SID_REGS];
+static struct voice voice[3];
+static float    lp, bp, dc_in, dc_out;  // filter and output DC blocker state
+static uint32_t synth_cycle;            // synthesised up to here
+static uint32_t sample_pos;             // cycles since the last sample, 16.16
+
+static struct sid_write log_buf[SID_LOG_MAX];
+static unsigned nlog;
+
+static int16_t  pcm[SID_BLOCK];
+
+// sync and ring modulation source: voice 1 <- 3, 2 <- 1, 3 <- 2
+#define SRC(v)  ((v) == 0 ? 2 : (v) - 1)
+
+static void apply(uint8_t reg, uint8_t value)
+{
+    struct voice *v;
+
+    regs[reg] = value;
+    if (reg >= 21)
+        return;                         // filter and volume are read per block
+    v = &voice[reg / 7];
+    switch (reg % 7) {
+        case 0: v->freq = (v->freq & 0xFF00) | value;                   break;
+        case 1: v->freq = (v->freq & 0x00FF) | (value << 8);            break;
+        case 2: v->pw   = (v->pw & 0x0F00) | value;                     break;
+        case 3: v->pw   = (v->pw & 0x00FF) | ((value & 0x0F) << 8);     break;
+        case 4:
+            if ((value & CTRL_GATE) && !(v->ctrl & CTRL_GATE))
+                v->state = ENV_ATTACK;
+            else if (!(value & CTRL_GATE) && (v->ctrl & CTRL_GATE))
+                v->state = ENV_RELEASE;
+            if (value & CTRL_TEST) {
+                v->phase = 0;
+                v->noise = 0x7FFFFF;
+            }
+            v->ctrl = value;
+            break;
+        case 5: v->ad = value;                                          break;
+        case 6: v->sr = value;                                          break;
+    }
+}
+
+// Phases of all three voices for n samples, 24-bit, plus how often each
+// noise register is clocked (bit 19 rising) in each sample
+static void oscillators(uint32_t acc[3][SID_BLOCK], uint8_t clocks[3][SID_BLOCK], unsigned n)
+{
+    uint64_t step[3];
+    unsigned v, i;
+
+    for (v = 0; v < 3; v++)
+        step[v] = (uint64_t)voice[v].freq * CPS;
+
+    if (!((voice[0].ctrl | voice[1].ctrl | voice[2].ctrl) & CTRL_SYNC)) {
+        for (v = 0; v < 3; v++) {
+            uint64_t base = voice[v].phase, s = voice[v].ctrl & CTRL_TEST ? 0 : step[v];
+
+            for (i = 0; i < n; i++) {
+                uint64_t before = (base + i * s) >> 16, after = (base + (i + 1) * s) >> 16;
+                acc[v][i]    = (uint32_t)after & 0xFFFFFF;
+                clocks[v][i] = (uint8_t)(((after + 0x80000) >> 20) - ((before + 0x80000) >> 20));
+            }
+            voice[v].phase = (base + n * s) & 0xFFFFFFFFFFull;
+        }
+        return;
+    }
+
+    // sync resets a phase when its source's top bit rises, so the voices
+    // go forward together
+    for (i = 0; i < n; i++) {
+        uint8_t rose[3];
+
+        for (v = 0; v < 3; v++) {
+            uint64_t before = voice[v].phase >> 16;
+
+            if (!(voice[v].ctrl & CTRL_TEST))
+                voice[v].phase = (voice[v].phase + step[v]) & 0xFFFFFFFFFFull;
+            clocks[v][i] = (uint8_t)((((voice[v].phase >> 16) + 0x80000) >> 20) - ((before + 0x80000) >> 20));
+            rose[v] = !(before & 0x800000) && ((voice[v].phase >> 16) & 0x800000);
+        }
+        for (v = 0; v < 3; v++) {
+            if ((voice[v].ctrl & CTRL_SYNC) && rose[SRC(v)])
+                voice[v].phase = 0;
+            acc[v][i] = (uint32_t)(voice[v].phase >> 16);
+        }
+    }
+}
+
+static uint16_t noise_out(uint32_t n)
+{
+    return (uint16_t)((((n >> 22) & 1) << 11) | (((n >> 20) & 1) << 10) |
+                      (((n >> 16) & 1) << 9)  | (((n >> 13) & 1) << 8) |
+                      (((n >> 11) & 1) << 7)  | (((n >> 7) & 1) << 6) |
+                      (((n >> 4) & 1) << 5)   | (((n >> 2) & 1) << 4));
+}
+
+// a is the voice's phase, src its ring modulation source's
+static void waveform(struct voice *vc, const uint32_t *a, const uint32_t *src,
+                     const uint8_t *clocks, uint16_t *wave, unsigned n)
+{
+    uint32_t tmask = vc->ctrl & CTRL_TRI   ? 0xFFF : 0;
+    uint32_t smask = vc->ctrl & CTRL_SAW   ? 0xFFF : 0;
+    uint32_t pmask = vc->ctrl & CTRL_PULSE ? 0xFFF : 0;
+    uint32_t nmask = vc->ctrl & CTRL_NOISE ? 0xFFF : 0;
+    uint32_t ring  = vc->ctrl & CTRL_RING  ? 0xFFFFFF : 0;
+    uint32_t pw    = vc->ctrl & CTRL_TEST  ? 0 : vc->pw;
+    uint16_t noise[SID_BLOCK];
+    unsigned i, k;
+
+    if (!(tmask | smask | pmask | nmask)) {
+        for (i = 0; i < n; i++)
+            wave[i] = 0x800;            // no waveform: silence
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        for (k = clocks[i]; k; k--) {
+            uint32_t bit = ((vc->noise >> 22) ^ (vc->noise >> 17)) & 1;
+            vc->noise = ((vc->noise << 1) | bit) & 0x7FFFFF;
+        }
+        noise[i] = noise_out(vc->noise);
+    }
+
+    for (i = 0; i < n; i++) {
+        uint32_t msb  = (a[i] ^ (src[i] & ring)) & 0x800000;
+        uint32_t tri  = ((msb ? ~a[i] : a[i]) >> 11) & 0xFFF;
+        uint32_t saw  = a[i] >> 12;
+        uint32_t pul  = saw >= pw ? 0xFFF : 0;
+
+        wave[i] = (uint16_t)((tri | ~tmask) & (saw | ~smask) & (pul | ~pmask) &
+                             (noise[i] | ~nmask) & 0xFFF);
+    }
+}
+
+static void envelope(struct voice *v, uint8_t *env, unsigned n)
+{
+    uint8_t sustain = (v->sr >> 4) * 17;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        uint32_t period;
+
+        v->env_acc += CPS;
+        for (;;) {
+            if (v->state == ENV_ATTACK) {
+                period = rate_period[v->ad >> 4];
+            } else {
+                period = rate_period[v->state == ENV_DECAY ? v->ad & 0x0F : v->sr & 0x0F];
+                // exponential decay: slower steps as the level falls
+                period *= v->env >= 93 ? 1 : v->env >= 54 ? 2 : v->env >= 26 ? 4 :
+                          v->env >= 14 ? 8 : v->env >= 6 ? 16 : 30;
+            }
+            if (v->env_acc < (period << 16))
+                break;
+            v->env_acc -= period << 16;
+
+            if (v->state == ENV_ATTACK) {
+                if (v->env < 0xFF)
+                    v->env++;
+                if (v->env == 0xFF)
+                    v->state = ENV_DECAY;
+            } else if (v->state == ENV_DECAY) {
+                if (v->env > sustain)
+                    v->env--;
+                else
+                    v->env_acc = 0;     // holding, nothing to catch up
+            } else if (v->env) {
+                v->env--;
+            } else {
+                v->env_acc = 0;
+            }
+            if (!v->env_acc)
+                break;
+        }
+        env[i] = v->env;
+    }
+}
+
+// Cutoff register to filter coefficient, 2x oversampled
+static float cutoff(void)
+{
+    float c = (float)((regs[0x16] << 3) | (regs[0x15] & 0x07)) / 2047.0f;
+    float hz = model == SID_8580 ? 30.0f + c * 12000.0f
+                                 : 220.0f + c * c * 17000.0f;
+
+    return 2.0f * sinf(3.14159265f * hz / (2.0f * SID_RATE));
+}
+
+static void render(int16_t *dst, unsigned n)
+{
+    static uint32_t acc[3][SID_BLOCK];
+    static uint8_t  clocks[3][SID_BLOCK];
+    uint16_t wave[SID_BLOCK];
+    uint8_t  env[SID_BLOCK];
+    int32_t  direct[SID_BLOCK], filt[SID_BLOCK];
+    uint8_t  route = regs[0x17], mode = regs[0x18];
+    int32_t  volume = mode & 0x0F;
+    float    f = cutoff(), q = 1.4f - (regs[0x17] >> 4) * (0.7f / 15.0f);
+    unsigned v, i;
+
+    oscillators(acc, clocks, n);
+    memset(direct, 0, sizeof(direct[0]) * n);
+    memset(filt, 0, sizeof(filt[0]) * n);
+    for (v = 0; v < 3; v++) {
+        int32_t *to = route & (1 << v) ? filt : direct;
+
+        waveform(&voice[v], acc[v], acc[SRC(v)], clocks[v], wave, n);
+        envelope(&voice[v], env, n);
+        if (v == 2 && (mode & 0x80) && !(route & 0x04))
+            continue;                   // 3OFF
+        for (i = 0; i < n; i++)
+            to[i] += ((int32_t)wave[i] - 0x800) * env[i];
+    }
+
+    for (i = 0; i < n; i++) {
+        float in = (float)filt[i], hp, y = 0;
+        int   k;
+
+        for (k = 0; k < 2; k++) {
+            hp  = in - lp - q * bp;
+            bp += f * hp;
+            lp += f * bp;
+        }
+        if (mode & 0x10) y += lp;
+        if (mode & 0x20) y += bp;
+        if (mode & 0x40) y += hp;
+
+        {
+            float s = ((float)direct[i] + y + (model == SID_6581 ? DC_6581 : 0)) * volume / 15.0f;
+            float o = s - dc_in + 0.999f * dc_out;   // the output is AC coupled
+
+            dc_in = s;
+            dc_out = o;
+            o /= 48.0f;
+            dst[i] = o > 32767.0f ? 32767 : o < -32768.0f ? -32768 : (int16_t)o;
+        }
+    }
+}
+
+static void put_le(uint8_t *p, uint32_t v, int bytes)
+{
+    while (bytes--) {
+        *p++ = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+static void emit(const int16_t *s, unsigned n)
+{
+    uint8_t le[SID_BLOCK * 2];
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        put_le(le + i * 2, (uint16_t)s[i], 2);
+    fwrite(le, 2, n, out);
+    wav_bytes += n * 2;
+}
+
+// Samples for the next `cycles` cycles with the registers as they are
+static void advance(uint32_t cycles)
+{
+    uint64_t pos = sample_pos + ((uint64_t)cycles << 16);
+    uint32_t n = (uint32_t)(pos / CPS);
+
+    sample_pos = (uint32_t)(pos - (uint64_t)n * CPS);
+    while (n) {
+        unsigned chunk = n > SID_BLOCK ? SID_BLOCK : n;
+        render(pcm, chunk);
+        emit(pcm, chunk);
+        n -= chunk;
+    }
+}
+
+// Play the log back up to cycle `until`
+static void run(uint32_t until)
+{
+    unsigned i;
+
+    // nothing behind synth_cycle is synthesised twice, see sid_resync()
+    for (i = 0; i < nlog; i++) {
+        if (log_buf[i].cycle > synth_cycle) {
+            advance(log_buf[i].cycle - synth_cycle);
+            synth_cycle = log_buf[i].cycle;
+        }
+        apply(log_buf[i].reg, log_buf[i].value);
+    }
+    nlog = 0;
+    if (until > synth_cycle)
+        advance(until - synth_cycle);
+    synth_cycle = until;
+}
+
+static void wav_header(void)
+{
+    uint8_t h[44];
+
+    memcpy(h, "RIFF", 4);       put_le(h + 4, 36 + wav_bytes, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le(h + 16, 16, 4);      put_le(h + 20, 1, 2);          // PCM
+    put_le(h + 22, 1, 2);       put_le(h + 24, SID_RATE, 4);   // mono
+    put_le(h + 28, SID_RATE * 2, 4);
+    put_le(h + 32, 2, 2);       put_le(h + 34, 16, 2);
+    memcpy(h + 36, "data", 4);  put_le(h + 40, wav_bytes, 4);
+    fwrite(h, 1, sizeof(h), out);
+}
+
+static void sid_stop(void)
+{
+    run(clockticks6502);
+    if (wav && fseek(out, 0, SEEK_SET) == 0)
+        wav_header();               // now with the sizes
+    fflush(out);
+}
+
+int sid_start(FILE *f, int as_wav, int sid_model)
+{
+    unsigned v;
+
+    out   = f;
+    wav   = (uint8_t)as_wav;
+    model = (uint8_t)sid_model;
+    for (v = 0; v < 3; v++) {
+        voice[v].noise = 0x7FFFFF;
+        voice[v].state = ENV_RELEASE;
+    }
+    // pick up what the guest already wrote
+    for (v = 0; v < SID_REGS; v++)
+        apply((uint8_t)v, ram[0xD400 + v]);
+    synth_cycle = clockticks6502;
+    if (wav)
+        wav_header();
+    sid_on = 1;
+    atexit(sid_stop);
+    return 0;
+}
+
+void sid_write(uint16_t address, uint8_t value)
+{
+    if (!sid_on || runahead_active)
+        return;                         // run-ahead frames are never heard
+    if (nlog == SID_LOG_MAX)
+        run(clockticks6502);
+    log_buf[nlog].cycle = clockticks6502;
+    log_buf[nlog].reg   = address & (SID_REGS - 1);
+    log_buf[nlog].value = value;
+    nlog++;
+}
+
+// OSC3 and ENV3 need the synthesis brought up to now
+uint8_t sid_read(uint16_t address)
+{
+    uint8_t reg = address & (SID_REGS - 1);
+
+    if (!sid_on || runahead_active || (reg != 0x1B && reg != 0x1C))
+        return ram[address];
+    run(clockticks6502);
+    if (reg == 0x1C)
+        return voice[2].env;
+    {
+        uint32_t a   = (uint32_t)(voice[2].phase >> 16) & 0xFFFFFF;
+        uint32_t src = (uint32_t)(voice[SRC(2)].phase >> 16) & 0xFFFFFF;
+        uint8_t  clocks = 0;
+        uint16_t wave;
+
+        waveform(&voice[2], &a, &src, &clocks, &wave, 1);
+        return (uint8_t)(wave >> 4);
+    }
+}
+
+void sid_frame(void)
+{
+    if (sid_on)
+        run(clockticks6502);
+}
+
+// After emu_set_state(): the clock may have gone back (rewind, diff undo)
+// or far ahead (snapshot).  Writes logged before the new clock still play
+// in time; otherwise the log is dropped, the registers are taken from RAM
+// as restored, and synthesis carries on from the new clock.
+void sid_resync(void)
+{
+    unsigned i;
+
+    if (!sid_on)
+        return;
+    for (i = 0; i < nlog && log_buf[i].cycle < clockticks6502; i++)
+        ;
+    nlog = i;
+    if (clockticks6502 >= synth_cycle && clockticks6502 - synth_cycle <= RESYNC_MAX) {
+        run(clockticks6502);
+        return;
+    }
+    nlog = 0;
+    for (i = 0; i < SID_REGS; i++)
+        apply((uint8_t)i, ram[0xD400 + i]);
+    synth_cycle = clockticks6502;
+}
+
+#else
+
+// The MEGA65's own SID at $D400 gets the guest's registers as written
+
+int sid_start(FILE *f, int as_wav, int sid_model)
+{
+    (void)f; (void)as_wav; (void)sid_model;
+    return 0;
+}
+
+void sid_write(uint16_t address, uint8_t value)
+{
+    POKE(0xD400U + (address & (SID_REGS - 1)), value);
+}
+
+uint8_t sid_read(uint16_t address)
+{
+    uint8_t reg = address & (SID_REGS - 1);
+
+    if (reg == 0x1B || reg == 0x1C)
+        return PEEK(0xD400U + reg);
+    return ram[address];
+}
+
+void sid_frame(void)
+{
+}
+
+void sid_resync(void)
+{
+    uint8_t reg;
+
+    for (reg = 0; reg < 0x19; reg++)
+        POKE(0xD400U + reg, ram[0xD400 + reg]);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __SID_H
+#define __SID_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// SID at $D400-$D7FF (32 registers, mirrored).  On the MEGA65 guest writes
+// go straight to one of its own SIDs.  On a Linux host they are logged with
+// their cycle and the sound is synthesised a block at a time, once a frame,
+// into a WAV file or a raw PCM stream (signed 16-bit mono, little endian).
+
+#define SID_REGS                0x20
+#define SID_RATE                44100   // output samples per second
+#define SID_BLOCK               512     // samples synthesised per pass
+#define SID_LOG_MAX             1024    // writes per frame before an early flush
+
+#define SID_6581                0
+#define SID_8580                1
+
+int  sid_start(FILE *out, int wav, int model);
+void sid_write(uint16_t address, uint8_t value);
+uint8_t sid_read(uint16_t address);
+void sid_frame(void);
+void sid_resync(void);
+
+#endif
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "mapfile.h"
+#include "romset.h"
+#include "snapshot.h"
+#include "video.h"
+
+// Fields are packed one by one so the file is the same whatever the
+// compiler does with struct emu_state.
+
+#define MAGIC_SIZE      8
+#define HEADER_SIZE     (MAGIC_SIZE + 2 + 3 * 4)
+#define STATE_SIZE      (2 + 6 + 4 + 8 + 4 + 4 + 2 + (2 + 6) + (2 + 4) + VIDEO_VIC_REGS)
+#define RAM_SIZE        0x10000
+#define COLOR_BASE      0xD800
+#define COLOR_SIZE      0x400
+#define FILE_SIZE       (HEADER_SIZE + STATE_SIZE + RAM_SIZE + COLOR_SIZE)
+
+static const uint8_t magic[MAGIC_SIZE] = { 'M', '6', '4', 'S', 'N', 'A', 'P', 0x1A };
+
+static const char *pending_save;
+
+static uint8_t *put16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; return p + 2; }
+static uint8_t *put32(uint8_t *p, uint32_t v) { p = put16(p, v); return put16(p, v >> 16); }
+static uint16_t get16(const uint8_t *p) { return p[0] | (uint16_t)p[1] << 8; }
+static uint32_t get32(const uint8_t *p) { return get16(p) | (uint32_t)get16(p + 2) << 16; }
+
+static void put_state(uint8_t *p, const struct emu_state *s)
+{
+    p = put16(p, s->pc);
+    *p++ = s->sp; *p++ = s->a; *p++ = s->x; *p++ = s->y;
+    *p++ = s->status; *p++ = s->irq_triggered;
+    p = put32(p, s->clockticks);
+    p = put32(p, (uint32_t)s->instructions);
+    p = put32(p, (uint32_t)(s->instructions >> 32));
+    p = put32(p, s->cycle_acc);
+    p = put32(p, s->frame_ticks);
+    p = put16(p, s->raster_line);
+    p = put16(p, s->cia1_timer);
+    *p++ = s->cia1_talo; *p++ = s->cia1_tahi; *p++ = s->cia1_ctrl;
+    *p++ = s->cia1_icr_mask; *p++ = s->cia1_ifr; *p++ = s->cia1_crb;
+    p = put16(p, s->cia2_timer);
+    *p++ = s->cia2_talo; *p++ = s->cia2_tahi; *p++ = s->cia2_ctrl; *p++ = s->cia2_ifr;
+    memcpy(p, s->vic, VIDEO_VIC_REGS);
+}
+
+static void get_state(const uint8_t *p, struct emu_state *s)
+{
+    s->pc = get16(p); p += 2;
+    s->sp = *p++; s->a = *p++; s->x = *p++; s->y = *p++;
+    s->status = *p++; s->irq_triggered = *p++;
+    s->clockticks = get32(p); p += 4;
+    s->instructions = get32(p) | (uint64_t)get32(p + 4) << 32; p += 8;
+    s->cycle_acc = get32(p); p += 4;
+    s->frame_ticks = get32(p); p += 4;
+    s->raster_line = get16(p); p += 2;
+    s->cia1_timer = get16(p); p += 2;
+    s->cia1_talo = *p++; s->cia1_tahi = *p++; s->cia1_ctrl = *p++;
+    s->cia1_icr_mask = *p++; s->cia1_ifr = *p++; s->cia1_crb = *p++;
+    s->cia2_timer = get16(p); p += 2;
+    s->cia2_talo = *p++; s->cia2_tahi = *p++; s->cia2_ctrl = *p++; s->cia2_ifr = *p++;
+    memcpy(s->vic, p, VIDEO_VIC_REGS);
+}
+
+int snapshot_save(const char *path)
+{
+    uint8_t buf[256];
+    struct emu_state s;
+    uint8_t *p;
+    uint32_t addr;
+    FILE *f = fopen(path, "wb");
+
+    if (!f) {
+        platform_msg("snapshot: cannot create %s\n", path);
+        return -1;
+    }
+
+    memcpy(buf, magic, MAGIC_SIZE);
+    p = put16(buf + MAGIC_SIZE, SNAPSHOT_VERSION);
+    p = put32(p, romset.basic_crc);
+    p = put32(p, romset.kernal_crc);
+    put32(p, romset.chargen_crc);
+    emu_get_state(&s);
+    put_state(buf + HEADER_SIZE, &s);
+    fwrite(buf, 1, HEADER_SIZE + STATE_SIZE, f);
+
+    // RAM goes through a small buffer, it is not in the CPU's address space on the MEGA65
+    for (addr = 0; addr < RAM_SIZE; addr += sizeof(buf)) {
+        emu_ram_read(buf, (uint16_t)addr, sizeof(buf));
+        fwrite(buf, 1, sizeof(buf), f);
+    }
+    for (addr = COLOR_BASE; addr < COLOR_BASE + COLOR_SIZE; addr += sizeof(buf)) {
+        emu_ram_read(buf, (uint16_t)addr, sizeof(buf));
+        fwrite(buf, 1, sizeof(buf), f);
+    }
+
+    if (ferror(f) | fclose(f)) {
+        platform_msg("snapshot: error writing %s\n", path);
+        return -1;
+    }
+    platform_msg("snapshot: saved %s\n", path);
+    return 0;
+}
+
+int snapshot_load(const char *path)
+{
+    struct mapped_file map;
+    struct emu_state s;
+    const uint8_t *p;
+
+    if (map_file(path, &map, 0) != 0) {
+        platform_msg("snapshot: cannot open %s\n", path);
+        return -1;
+    }
+    p = map.data;
+    if (map.size != FILE_SIZE || memcmp(p, magic, MAGIC_SIZE) != 0) {
+        platform_msg("snapshot: %s is not a snapshot\n", path);
+        goto fail;
+    }
+    if (get16(p + MAGIC_SIZE) != SNAPSHOT_VERSION) {
+        platform_msg("snapshot: %s is version %u, need %u\n", path,
+                     get16(p + MAGIC_SIZE), SNAPSHOT_VERSION);
+        goto fail;
+    }
+    // A snapshot holds KERNAL/BASIC state (vectors, pointers, the stack) that
+    // is only valid with the exact ROMs it was taken on
+    if (get32(p + MAGIC_SIZE + 2) != romset.basic_crc ||
+        get32(p + MAGIC_SIZE + 6) != romset.kernal_crc ||
+        get32(p + MAGIC_SIZE + 10) != romset.chargen_crc) {
+        platform_msg("snapshot: %s was taken with a different ROM set\n", path);
+        goto fail;
+    }
+
+    get_state(p + HEADER_SIZE, &s);
+    p += HEADER_SIZE + STATE_SIZE;
+    emu_ram_write(0, p, RAM_SIZE);
+    emu_ram_write(COLOR_BASE, p + RAM_SIZE, COLOR_SIZE);
+    emu_set_state(&s);
+
+    unmap_file(&map);
+    platform_msg("snapshot: restored %s\n", path);
+    return 0;
+
+fail:
+    unmap_file(&map);
+    return -1;
+}
+
+// -savesnap: written at the first READY. prompt, i.e. the snapshot to ship
+void snapshot_save_at_ready(const char *path)
+{
+    pending_save = path;
+}
+
+void snapshot_frame(void)
+{
+    if (!pending_save || !emu_at_ready())
+        return;
+    snapshot_save(pending_save);
+    pending_save = NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdint.h>
+
+// Whole-machine snapshots: CPU registers, 64K RAM, colour RAM, VIC and CIA
+// state plus the checksums of the ROM set they were taken with.  Restoring
+// one replaces the boot code entirely, so a READY. snapshot per ROM set
+// gives an instant cold start.
+//
+// File layout, all fields little-endian:
+//   "M64SNAP\x1a"  magic
+//   u16            version
+//   u32 x3         BASIC, KERNAL, chargen CRC-32
+//   state          see put_state() in snapshot.c
+//   65536 bytes    RAM
+//   1024 bytes     colour RAM ($D800-$DBFF)
+
+#define SNAPSHOT_VERSION        1
+
+int  snapshot_save(const char *path);
+int  snapshot_load(const char *path);
+void snapshot_save_at_ready(const char *path);
+void snapshot_frame(void);
+
+#endif
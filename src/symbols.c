@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "platform.h"
+#include "romset.h"
+#include "symbols.h"
+
+// Label files, one symbol per line, in either of the usual forms:
+//
+//   al C:0810 .main            VICE monitor labels (ca65 -Ln, ACME -l via vice)
+//   main = $0810               assembler symbol listings
+//
+// Anything else on a line is ignored.  Lookups pick the closest symbol at
+// or below the address, within SYMBOL_RANGE bytes.
+
+#define SYMBOL_RANGE            0x400
+
+struct symbol {
+    uint16_t address;
+    char     name[SYMBOL_NAME_MAX + 1];
+};
+
+struct builtin {
+    uint16_t address;
+    const char *name;
+};
+
+// BASIC 901226-01, sorted
+static const struct builtin basic_syms[] = {
+    { 0xA483, "main" },     { 0xA560, "inlin" },    { 0xA579, "crunch" },
+    { 0xA613, "fndlin" },   { 0xA65E, "clr" },      { 0xA742, "for" },
+    { 0xA7AE, "newstt" },   { 0xA7E4, "gone" },     { 0xA871, "run" },
+    { 0xA883, "gosub" },    { 0xA8A0, "goto" },     { 0xA8D2, "return" },
+    { 0xA928, "if" },       { 0xAAA0, "print" },    { 0xAB1E, "strout" },
+    { 0xAD1E, "next" },     { 0xAD9E, "frmevl" },   { 0xAE83, "eval" },
+    { 0xB08B, "ptrget" },   { 0xB391, "givayf" },   { 0xB7F7, "getadr" },
+    { 0xB80D, "peek" },     { 0xB824, "poke" },     { 0xB850, "fsub" },
+    { 0xB867, "fadd" },     { 0xB9EA, "log" },      { 0xBA28, "fmult" },
+    { 0xBB12, "fdiv" },     { 0xBCCC, "int" },      { 0xBDCD, "linprt" },
+    { 0xBDDD, "fout" },     { 0xBF71, "sqr" },      { 0xBF7B, "fpwrt" },
+    { 0xBFED, "exp" },
+};
+
+// KERNAL 901227-02/03 (with the BASIC code that lives in it), sorted
+static const struct builtin kernal_syms[] = {
+    { 0xE097, "rnd" },      { 0xE10C, "bchout" },   { 0xE112, "bchin" },
+    { 0xE118, "bckout" },   { 0xE11E, "bckin" },    { 0xE124, "bgetin" },
+    { 0xE264, "cos" },      { 0xE26B, "sin" },      { 0xE2B4, "tan" },
+    { 0xE30E, "atn" },      { 0xE37B, "warm" },     { 0xE394, "init" },
+    { 0xE3BF, "initcz" },   { 0xE422, "initms" },   { 0xE453, "initv" },
+    { 0xE50A, "plot" },     { 0xE544, "clrscr" },   { 0xE566, "home" },
+    { 0xE5B4, "getkbuf" },  { 0xE5CA, "waitkey" },  { 0xE632, "scrinp" },
+    { 0xE716, "scrout" },   { 0xE8EA, "scroll" },   { 0xE9FF, "clrln" },
+    { 0xEA31, "irq" },      { 0xEA87, "scnkey" },   { 0xED09, "talk" },
+    { 0xED0C, "listn" },    { 0xEDB9, "second" },   { 0xEDC7, "tksa" },
+    { 0xEDDD, "ciout" },    { 0xEDEF, "untlk" },    { 0xEDFE, "unlsn" },
+    { 0xEE13, "acptr" },    { 0xF13E, "getin" },    { 0xF157, "chrin" },
+    { 0xF1CA, "chrout" },   { 0xF20E, "chkin" },    { 0xF250, "chkout" },
+    { 0xF291, "close" },    { 0xF32F, "clall" },    { 0xF333, "clrchn" },
+    { 0xF34A, "open" },     { 0xF49E, "load" },     { 0xF5DD, "save" },
+    { 0xF69B, "udtim" },    { 0xF6ED, "stop" },     { 0xFCE2, "reset" },
+    { 0xFD15, "restor" },   { 0xFD50, "ramtas" },   { 0xFDA3, "ioinit" },
+    { 0xFDF9, "setnam" },   { 0xFE00, "setlfs" },   { 0xFE43, "nmi" },
+    { 0xFF48, "irqentry" }, { 0xFF5B, "cint" },
+    { 0xFF81, "CINT" },     { 0xFF84, "IOINIT" },   { 0xFF87, "RAMTAS" },
+    { 0xFF8A, "RESTOR" },   { 0xFF9F, "SCNKEY" },   { 0xFFB1, "LISTEN" },
+    { 0xFFB4, "TALK" },     { 0xFFBA, "SETLFS" },   { 0xFFBD, "SETNAM" },
+    { 0xFFC0, "OPEN" },     { 0xFFC3, "CLOSE" },    { 0xFFC6, "CHKIN" },
+    { 0xFFC9, "CHKOUT" },   { 0xFFCC, "CLRCHN" },   { 0xFFCF, "CHRIN" },
+    { 0xFFD2, "CHROUT" },   { 0xFFD5, "LOAD" },     { 0xFFD8, "SAVE" },
+    { 0xFFE1, "STOP" },     { 0xFFE4, "GETIN" },    { 0xFFE7, "CLALL" },
+    { 0xFFEA, "UDTIM" },    { 0xFFF0, "PLOT" },
+};
+
+static struct symbol *syms;
+static unsigned nsyms, cap;
+
+static int by_address(const void *x, const void *y)
+{
+    const struct symbol *s = x, *t = y;
+
+    return (int)s->address - (int)t->address;
+}
+
+static int add(uint16_t address, const char *name, size_t len)
+{
+    struct symbol *s;
+
+    if (nsyms == cap) {
+        s = realloc(syms, (cap ? cap * 2 : 256) * sizeof(*s));
+        if (!s)
+            return -1;
+        syms = s;
+        cap = cap ? cap * 2 : 256;
+    }
+    s = &syms[nsyms++];
+    s->address = address;
+    if (len > SYMBOL_NAME_MAX)
+        len = SYMBOL_NAME_MAX;
+    memcpy(s->name, name, len);
+    s->name[len] = 0;
+    return 0;
+}
+
+int symbols_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[256], *p, *name;
+    unsigned long address;
+    unsigned n = 0;
+
+    if (!f) {
+        platform_msg("symbols: cannot open %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (!strncmp(line, "al ", 3)) {
+            // al C:0810 .main
+            p = line + 3;
+            if (p[0] && p[1] == ':')
+                p += 2;
+            address = strtoul(p, &p, 16);
+            while (*p == ' ')
+                p++;
+            if (*p == '.')
+                p++;
+            name = p;
+        } else if ((p = strchr(line, '=')) != NULL) {
+            // main = $0810
+            char *eq = p;
+
+            name = line;
+            while (*name == ' ' || *name == '\t')
+                name++;
+            while (p > name && (p[-1] == ' ' || p[-1] == '\t'))
+                p--;
+            *p = 0;
+            p = eq + 1;
+            while (*p == ' ' || *p == '\t')
+                p++;
+            if (*p == '$')
+                address = strtoul(p + 1, NULL, 16);
+            else
+                address = strtoul(p, NULL, 0);
+        } else {
+            continue;
+        }
+        name[strcspn(name, " \t\r\n")] = 0;
+        if (!*name || address > 0xFFFF)
+            continue;
+        if (add((uint16_t)address, name, strlen(name)) != 0)
+            break;
+        n++;
+    }
+    fclose(f);
+    qsort(syms, nsyms, sizeof(*syms), by_address);
+    platform_msg("symbols: %u from %s\n", n, path);
+    return 0;
+}
+
+// Highest label file symbol at or below address, NULL if none
+static const struct symbol *user_below(uint16_t address)
+{
+    unsigned lo = 0, hi = nsyms;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (syms[mid].address <= address)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo ? &syms[lo - 1] : NULL;
+}
+
+static const struct builtin *builtin_below(const struct builtin *t, unsigned n, uint16_t address)
+{
+    const struct builtin *best = NULL;
+    unsigned i;
+
+    for (i = 0; i < n && t[i].address <= address; i++)
+        best = &t[i];
+    return best;
+}
+
+const char *symbols_lookup(uint16_t address, uint16_t *offset)
+{
+    const struct symbol *u = user_below(address);
+    const struct builtin *b = NULL;
+    uint16_t at = 0;
+    const char *name = NULL;
+
+    if (address >= 0xE000 &&
+        (romset.kernal_crc == CRC_KERNAL_901227_02 || romset.kernal_crc == CRC_KERNAL_901227_03))
+        b = builtin_below(kernal_syms, sizeof(kernal_syms) / sizeof(kernal_syms[0]), address);
+    else if (address >= 0xA000 && address < 0xC000 && romset.basic_crc == CRC_BASIC_901226_01)
+        b = builtin_below(basic_syms, sizeof(basic_syms) / sizeof(basic_syms[0]), address);
+
+    if (b) {
+        at = b->address;
+        name = b->name;
+    }
+    if (u && (!name || u->address >= at)) {
+        at = u->address;
+        name = u->name;
+    }
+    if (!name || address - at >= SYMBOL_RANGE)
+        return NULL;
+    if (offset)
+        *offset = (uint16_t)(address - at);
+    return name;
+}
+
+const char *symbols_exact(uint16_t address)
+{
+    uint16_t offset;
+    const char *name = symbols_lookup(address, &offset);
+
+    return name && !offset ? name : NULL;
+}
+
+// name, name+$xx or $xxxx; out holds SYMBOL_NAME_MAX + 8
+void symbols_format(char *out, uint16_t address)
+{
+    uint16_t offset;
+    const char *name = symbols_lookup(address, &offset);
+
+    if (!name)
+        sprintf(out, "$%04X", address);
+    else if (offset)
+        sprintf(out, "%s+$%X", name, offset);
+    else
+        strcpy(out, name);
+}
@@ -0,0 +1,17 @@
+#ifndef __SYMBOLS_H
+#define __SYMBOLS_H
+
+#include <stdint.h>
+
+// Guest address to name.  The stock BASIC and KERNAL routines are built
+// in (only when romset says the ROMs are the known revisions); label
+// files add to them and win on the same address.
+
+#define SYMBOL_NAME_MAX         31
+
+int  symbols_load(const char *path);
+const char *symbols_exact(uint16_t address);
+const char *symbols_lookup(uint16_t address, uint16_t *offset);
+void symbols_format(char *out, uint16_t address);
+
+#endif
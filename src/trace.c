@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <signal.h>
+#endif
+
+#include "emu.h"
+#include "disasm.h"
+#include "trace.h"
+
+// A record is the instruction as it is about to run:
+//
+//   flags  opcode  operands  [pc16] [a] [x] [y] [sp] [p]  cycles8 | cycles32
+//
+// Registers are only stored when they differ from the previous record,
+// PC only when it is not the previous PC plus its instruction length, and
+// the cycle count as the distance from the previous record.  Multi-byte
+// fields are little endian.  Each TRACE_BLOCK of the ring opens with a
+// keyframe holding what the first record is compared against, so blocks
+// decode on their own and the oldest can be overwritten whole.
+//
+// Dump file, host byte order for the header fields:
+//
+//   "C64T" u32 version  u32 block size  u32 blocks
+//   then per block, oldest first: u32 used  u64 first instruction  used bytes
+
+uint8_t trace_on = 0;
+
+struct block {
+    uint32_t used;
+    uint64_t first;                     // instruction number of the first record
+};
+
+static uint8_t *ring;
+static struct block *blocks;
+static uint32_t nblocks, cur, fill;
+static uint8_t wrapped;
+static const char *out_path;
+static volatile uint8_t dump_pending;
+
+// what the next record is compared against
+static uint16_t next_pc;
+static uint8_t  last_a, last_x, last_y, last_sp, last_p;
+static uint32_t last_cycle;
+
+static void keyframe(void)
+{
+    uint8_t *p = ring + (size_t)cur * TRACE_BLOCK;
+
+    p[0] = next_pc & 0xFF; p[1] = next_pc >> 8;
+    p[2] = last_a; p[3] = last_x; p[4] = last_y; p[5] = last_sp; p[6] = last_p;
+    p[7]  = last_cycle & 0xFF;         p[8]  = (last_cycle >> 8) & 0xFF;
+    p[9]  = (last_cycle >> 16) & 0xFF; p[10] = last_cycle >> 24;
+    fill = TRACE_KEYFRAME;
+    blocks[cur].used  = fill;
+    blocks[cur].first = instructions;
+}
+
+static void next_block(void)
+{
+    if (++cur == nblocks) {
+        cur = 0;
+        wrapped = 1;
+    }
+    keyframe();
+}
+
+#ifdef __linux__
+static void (*usr1_next)(int);          // SIGUSR1 is shared with drive.c
+
+static void on_signal(int sig)
+{
+    if (sig == SIGUSR1) {
+        dump_pending = 1;               // written by the next trace_step()
+        if (usr1_next != SIG_DFL && usr1_next != SIG_IGN && usr1_next != SIG_ERR)
+            usr1_next(sig);
+        return;
+    }
+    trace_dump();
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+#endif
+
+// Room for about millions instructions, dumped to path
+int trace_start(const char *path, uint32_t millions)
+{
+    uint64_t bytes = (uint64_t)millions * 1000000u * TRACE_BYTES;
+
+    nblocks = (uint32_t)((bytes + TRACE_BLOCK - 1) / TRACE_BLOCK);
+    if (nblocks < 2)
+        nblocks = 2;
+    ring   = malloc((size_t)nblocks * TRACE_BLOCK);
+    blocks = calloc(nblocks, sizeof(*blocks));
+    if (!ring || !blocks) {
+        platform_msg("trace: cannot allocate %lu KB\n", (unsigned long)nblocks * (TRACE_BLOCK / 1024));
+        free(ring);
+        free(blocks);
+        return -1;
+    }
+    out_path = path;
+
+    next_pc = pc;
+    last_a = a; last_x = x; last_y = y; last_sp = sp; last_p = status;
+    last_cycle = clockticks6502;
+    cur = 0;
+    keyframe();
+
+#ifdef __linux__
+    if ((usr1_next = signal(SIGUSR1, on_signal)) == on_signal)
+        usr1_next = SIG_DFL;
+    signal(SIGSEGV, on_signal);
+    signal(SIGBUS,  on_signal);
+    signal(SIGILL,  on_signal);
+    signal(SIGFPE,  on_signal);
+    signal(SIGABRT, on_signal);
+#endif
+    trace_on = 1;
+    return 0;
+}
+
+// Before every instruction
+void trace_step(void)
+{
+    uint8_t *p, *flags, n, i;
+    uint32_t delta;
+
+    if (dump_pending) {
+        dump_pending = 0;
+        trace_dump();
+    }
+    if (fill + TRACE_RECORD_MAX > TRACE_BLOCK)
+        next_block();
+
+    p = ring + (size_t)cur * TRACE_BLOCK + fill;
+    flags = p++;
+    *flags = 0;
+
+    *p = emu_peek(pc);
+    n = disasm_length(*p++);
+    for (i = 1; i < n; i++)
+        *p++ = emu_peek((uint16_t)(pc + i));
+
+    if (pc != next_pc) {
+        *flags |= TRACE_PC;
+        *p++ = pc & 0xFF;
+        *p++ = pc >> 8;
+    }
+    if (a != last_a)        { *flags |= TRACE_A;  *p++ = last_a  = a; }
+    if (x != last_x)        { *flags |= TRACE_X;  *p++ = last_x  = x; }
+    if (y != last_y)        { *flags |= TRACE_Y;  *p++ = last_y  = y; }
+    if (sp != last_sp)      { *flags |= TRACE_SP; *p++ = last_sp = sp; }
+    if (status != last_p)   { *flags |= TRACE_P;  *p++ = last_p  = status; }
+
+    delta = clockticks6502 - last_cycle;
+    if (delta > 0xFF) {
+        *flags |= TRACE_LONG;
+        *p++ = delta & 0xFF;         *p++ = (delta >> 8) & 0xFF;
+        *p++ = (delta >> 16) & 0xFF; *p++ = delta >> 24;
+    } else {
+        *p++ = (uint8_t)delta;
+    }
+    last_cycle = clockticks6502;
+    next_pc = (uint16_t)(pc + n);
+
+    fill = (uint32_t)(p - (ring + (size_t)cur * TRACE_BLOCK));
+    blocks[cur].used = fill;
+}
+
+int trace_dump(void)
+{
+    uint32_t version = TRACE_VERSION, size = TRACE_BLOCK;
+    uint32_t count = wrapped ? nblocks : cur + 1;
+    uint32_t i, b;
+    FILE *f;
+
+    if (!ring)
+        return -1;
+    f = fopen(out_path, "wb");
+    if (!f) {
+        platform_msg("trace: cannot create %s\n", out_path);
+        return -1;
+    }
+    fwrite("C64T", 1, 4, f);
+    fwrite(&version, sizeof(version), 1, f);
+    fwrite(&size, sizeof(size), 1, f);
+    fwrite(&count, sizeof(count), 1, f);
+    for (i = 0; i < count; i++) {
+        b = wrapped ? (cur + 1 + i) % nblocks : i;
+        fwrite(&blocks[b].used, sizeof(blocks[b].used), 1, f);
+        fwrite(&blocks[b].first, sizeof(blocks[b].first), 1, f);
+        fwrite(ring + (size_t)b * TRACE_BLOCK, 1, blocks[b].used, f);
+    }
+    fclose(f);
+    platform_msg("trace: %lu blocks to %s\n", (unsigned long)count, out_path);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+// Instruction trace ring: every instruction is appended as a small
+// delta-encoded record, the oldest ones are dropped as the ring fills.
+// The ring goes to disk on SIGUSR1, on a host crash or a -diff mismatch;
+// tracedump decodes and disassembles it.
+
+#define TRACE_BLOCK             65536   // ring unit, starts with a keyframe
+#define TRACE_BYTES             5       // typical record size, for sizing
+#define TRACE_VERSION           1
+
+// record flags, the fields that follow the opcode and operands
+#define TRACE_PC                0x01    // PC is not the one after the last instruction
+#define TRACE_A                 0x02
+#define TRACE_X                 0x04
+#define TRACE_Y                 0x08
+#define TRACE_SP                0x10
+#define TRACE_P                 0x20
+#define TRACE_LONG              0x40    // cycle delta is 4 bytes, not 1
+
+#define TRACE_KEYFRAME          11      // pc, a, x, y, sp, p, cycle
+#define TRACE_RECORD_MAX        16
+
+extern uint8_t trace_on;
+
+int  trace_start(const char *path, uint32_t millions);
+void trace_step(void);
+int  trace_dump(void);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "disasm.h"
+#include "trace.h"
+
+// Decodes a trace ring dump (see trace.c) into one line per instruction:
+//
+//   ./tracedump trace.bin              everything in the dump
+//   ./tracedump -last 200 trace.bin    only the newest 200
+//
+// instruction number, cycle, PC, bytes, disassembly and the registers the
+// instruction started with.
+
+struct block {
+    uint32_t used;
+    uint64_t first;
+    uint8_t *data;
+};
+
+static struct block *blocks;
+static uint32_t nblocks;
+
+static int load(const char *path)
+{
+    char magic[4];
+    uint32_t version, size, i;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        printf("tracedump: cannot open %s\n", path);
+        return -1;
+    }
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, "C64T", 4) ||
+        fread(&version, sizeof(version), 1, f) != 1 || version != TRACE_VERSION ||
+        fread(&size, sizeof(size), 1, f) != 1 ||
+        fread(&nblocks, sizeof(nblocks), 1, f) != 1) {
+        printf("tracedump: %s is not a version %u trace\n", path, TRACE_VERSION);
+        fclose(f);
+        return -1;
+    }
+    blocks = calloc(nblocks, sizeof(*blocks));
+    for (i = 0; blocks && i < nblocks; i++) {
+        struct block *b = &blocks[i];
+
+        if (fread(&b->used, sizeof(b->used), 1, f) != 1 ||
+            fread(&b->first, sizeof(b->first), 1, f) != 1 ||
+            b->used > size || b->used < TRACE_KEYFRAME ||
+            !(b->data = malloc(b->used)) ||
+            fread(b->data, 1, b->used, f) != b->used) {
+            printf("tracedump: %s is truncated at block %lu\n", path, (unsigned long)i);
+            nblocks = i;
+            break;
+        }
+    }
+    fclose(f);
+    return blocks ? 0 : -1;
+}
+
+// Walks one block; lines are printed from instruction number `from` on.
+// Returns the number of records.
+static uint64_t decode(const struct block *blk, uint64_t from)
+{
+    const uint8_t *p = blk->data, *end = blk->data + blk->used;
+    uint16_t pc = p[0] | (p[1] << 8);
+    uint8_t  a = p[2], x = p[3], y = p[4], sp = p[5], status = p[6];
+    uint32_t cycle = p[7] | (p[8] << 8) | (p[9] << 16) | ((uint32_t)p[10] << 24);
+    uint64_t n = 0;
+    uint8_t flags, bytes[3], len, i;
+    char text[DISASM_MAX + 16];
+
+    p += TRACE_KEYFRAME;
+    while (p < end) {
+        flags    = *p++;
+        bytes[0] = *p++;
+        bytes[1] = bytes[2] = 0;
+        len = disasm_length(bytes[0]);
+        for (i = 1; i < len; i++)
+            bytes[i] = *p++;
+        if (flags & TRACE_PC) { pc = p[0] | (p[1] << 8); p += 2; }
+        if (flags & TRACE_A)  a = *p++;
+        if (flags & TRACE_X)  x = *p++;
+        if (flags & TRACE_Y)  y = *p++;
+        if (flags & TRACE_SP) sp = *p++;
+        if (flags & TRACE_P)  status = *p++;
+        if (flags & TRACE_LONG) {
+            cycle += p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+            p += 4;
+        } else {
+            cycle += *p++;
+        }
+
+        if (blk->first + n >= from) {
+            disasm(text, pc, bytes);
+            printf("%10llu %10lu  %04X  ", (unsigned long long)(blk->first + n),
+                   (unsigned long)cycle, pc);
+            for (i = 0; i < 3; i++)
+                printf(i < len ? "%02X " : "   ", bytes[i]);
+            printf(" %-16s A=%02X X=%02X Y=%02X SP=%02X P=%02X\n", text, a, x, y, sp, status);
+        }
+        pc = (uint16_t)(pc + len);
+        n++;
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    uint64_t last = 0, total = 0, from = 0;
+    uint32_t i;
+
+    for (i = 1; i < (uint32_t)argc; i++) {
+        if (!strcmp(argv[i], "-last") && i + 1 < (uint32_t)argc)
+            last = strtoull(argv[++i], NULL, 0);
+        else
+            path = argv[i];
+    }
+    if (!path) {
+        printf("usage: tracedump [-last n] trace.bin\n");
+        return 1;
+    }
+    if (load(path) != 0)
+        return 1;
+    if (!nblocks)
+        return 0;
+
+    // the newest block ends at the last instruction traced
+    total = blocks[nblocks - 1].first + decode(&blocks[nblocks - 1], UINT64_MAX);
+    if (last && last < total)
+        from = total - last;
+    for (i = 0; i < nblocks; i++) {
+        if (i + 1 < nblocks && blocks[i + 1].first <= from)
+            continue;
+        decode(&blocks[i], from);
+    }
+    return 0;
+}
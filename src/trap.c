@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "trap.h"
+#include "runahead.h"
+
+// KERNAL traps.  The first byte of a trapped routine is swapped for a JAM
+// opcode in the KERNAL image; cpu.c hands those back to trap_dispatch(),
+// so code that never hits a trap runs exactly as fast as before.
+
+extern int (*traphook6502)(uint16_t address);
+
+struct trap {
+    uint16_t address;
+    uint8_t  original;
+    trap_handler handler;
+};
+
+static struct trap traps[TRAP_MAX];
+static uint8_t ntraps = 0;
+
+static int trap_dispatch(uint16_t address)
+{
+    uint8_t i;
+
+    for (i = 0; i < ntraps; i++) {
+        if (traps[i].address != address)
+            continue;
+        // only while the KERNAL ROM is banked in, otherwise it's RAM;
+        // run-ahead frames take the ROM path and leave host files alone
+        if ((ram[0x0001] & 0x02) && !runahead_active && traps[i].handler()) {
+            emu_mark_dirty(0x0000, 0x0300);     // zero page, stack, $02xx
+            return -1;
+        }
+        return traps[i].original;
+    }
+    return 0xEA;    // a real JAM in guest code stays a NOP
+}
+
+// Plant a trap at a KERNAL address; expect is the byte the ROM must hold
+// there, so a different KERNAL revision is refused rather than corrupted.
+int trap_install(uint16_t address, uint8_t expect, trap_handler handler)
+{
+    uint8_t EMU_HUGE *p = kernal + (address - 0xE000);
+
+    if (address < 0xE000 || ntraps == TRAP_MAX || *p != expect)
+        return -1;
+
+    traps[ntraps].address  = address;
+    traps[ntraps].original = *p;
+    traps[ntraps].handler  = handler;
+    ntraps++;
+
+    *p = TRAP_OPCODE;
+    traphook6502 = trap_dispatch;
+    return 0;
+}
+
+void trap_remove_all(void)
+{
+    while (ntraps) {
+        ntraps--;
+        kernal[traps[ntraps].address - 0xE000] = traps[ntraps].original;
+    }
+    traphook6502 = NULL;
+}
+
+// Return from the trapped subroutine as its RTS would
+void trap_rts(void)
+{
+    uint16_t lo = ram[0x0100 + (uint8_t)(sp + 1)];
+    uint16_t hi = ram[0x0100 + (uint8_t)(sp + 2)];
+
+    sp += 2;
+    pc = (uint16_t)((lo | (hi << 8)) + 1);
+}
+
+void trap_carry(int set)
+{
+    if (set)
+        status |= 0x01;
+    else
+        status &= (uint8_t)~0x01;
+}
@@ -0,0 +1,18 @@
+#ifndef __TRAP_H
+#define __TRAP_H
+
+#include <stdint.h>
+
+#define TRAP_MAX                24
+#define TRAP_OPCODE             0x02    // JAM, never used by the KERNAL
+
+// A handler returns 1 when it did the work of the trapped routine (and set up
+// the return with trap_rts()), 0 to let the original ROM code run.
+typedef int (*trap_handler)(void);
+
+int  trap_install(uint16_t address, uint8_t expect, trap_handler handler);
+void trap_remove_all(void);
+void trap_rts(void);
+void trap_carry(int set);
+
+#endif
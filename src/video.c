@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "platform.h"
+#include "video.h"
+
+// The emulation side only ever captures frame inputs; turning them into
+// pixels happens elsewhere.  On the MEGA65 the VIC-IV is the renderer, so a
+// frame is handed over with two DMA jobs.  On a Linux host a render worker
+// owns the framebuffer and encoder and is fed through a single-producer /
+// single-consumer ring, so the emulation thread never waits on it: if the
+// ring is full the frame is dropped, not the guest stalled.
+
+uint32_t video_frames         = 0;
+uint32_t video_frames_dropped = 0;
+
+// VIC register state as last written by the guest.  Start from what the
+// KERNAL would have left behind, FASTBOOT skips its init code.
+static EMU_TLS uint8_t vic_shadow[VIDEO_VIC_REGS] = {
+    [0x11] = 0x1B, [0x16] = 0xC8, [0x18] = 0x15, [0x20] = 14, [0x21] = 6
+};
+
+static uint16_t frame_cycles_per_line = 63;
+static EMU_TLS uint32_t frame_start_cycle     = 0;
+static EMU_TLS uint8_t  held;           // frames end without being shown
+
+// Screen and charset addresses as the VIC would see them
+static uint16_t screen_base(uint16_t *charset_base)
+{
+    uint8_t  d018 = vic_shadow[0x18];
+    // CIA-2 port A bits 0/1 pick the VIC bank, inverted; inputs read as 1
+    uint8_t  pa   = ram[0xDD00] | (uint8_t)~ram[0xDD02];
+    uint16_t bank = (uint16_t)(3 - (pa & 3)) << 14;
+
+    *charset_base = bank + ((uint16_t)((d018 >> 1) & 7) << 11);
+    return bank + ((uint16_t)(d018 >> 4) << 10);
+}
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+static const uint8_t palette[16][3] = {
+    {0x00,0x00,0x00}, {0xFF,0xFF,0xFF}, {0x88,0x00,0x00}, {0xAA,0xFF,0xEE},
+    {0xCC,0x44,0xCC}, {0x00,0xCC,0x55}, {0x00,0x00,0xAA}, {0xEE,0xEE,0x77},
+    {0xDD,0x88,0x55}, {0x66,0x44,0x00}, {0xFF,0x77,0x77}, {0x33,0x33,0x33},
+    {0x77,0x77,0x77}, {0xAA,0xFF,0x66}, {0x00,0x88,0xFF}, {0xBB,0xBB,0xBB}
+};
+
+#define FIRST_RASTER_LINE   15      // raster line shown on framebuffer row 0
+
+static struct frame_inputs *ring;
+static unsigned ring_depth;
+static atomic_uint ring_head;       // next slot to publish, producer only
+static atomic_uint ring_tail;       // next slot to render, consumer only
+static EMU_TLS struct frame_inputs *cur;    // slot being filled, or &scratch; NULL off the emulation thread
+static struct frame_inputs scratch; // frames that will be dropped land here
+
+static pthread_t worker;
+static sem_t ring_ready;
+static atomic_int worker_stop;
+static int worker_running = 0;
+
+// ── render worker state, touched by the worker thread only ──────
+static uint8_t fb[VIDEO_FB_HEIGHT][VIDEO_FB_WIDTH];
+static uint8_t rgb[VIDEO_FB_HEIGHT * VIDEO_FB_WIDTH * 3];
+static FILE   *encoder_out = NULL;
+
+static void capture(struct frame_inputs *f)
+{
+    uint16_t cbase;
+    uint16_t i;
+
+    f->frame           = video_frames;
+    f->start_cycle     = frame_start_cycle;
+    f->cycles_per_line = frame_cycles_per_line;
+    f->screen_base     = screen_base(&cbase);
+
+    // banks 0 and 2 see the character ROM at $1000-$1FFF
+    f->rom_charset = (!(cbase & 0x4000) && (cbase & 0x3000) == 0x1000);
+
+    for (i = 0; i < VIDEO_SCREEN_SIZE; i++) {
+        f->screen[i] = ram[(uint16_t)(f->screen_base + i)];
+        f->color[i]  = ram[0xD800 + i] & 0x0F;
+    }
+    if (!f->rom_charset) {
+        for (i = 0; i < sizeof(f->charset); i++)
+            f->charset[i] = ram[(uint16_t)(cbase + i)];
+    }
+}
+
+static void next_slot(void)
+{
+    unsigned head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+
+    cur = (head - tail < ring_depth) ? &ring[head % ring_depth] : &scratch;
+    memcpy(cur->vic, vic_shadow, sizeof(vic_shadow));
+    cur->nwrites = 0;
+}
+
+static void render(const struct frame_inputs *f)
+{
+    uint8_t vic[VIDEO_VIC_REGS];
+    const uint8_t *glyphs;
+    uint16_t next = 0;
+    int y, x;
+
+    memcpy(vic, f->vic, sizeof(vic));
+    glyphs = f->rom_charset ? (const uint8_t *)chars + (vic[0x18] & 0x02 ? 0x800 : 0)
+                            : f->charset;
+
+    for (y = 0; y < VIDEO_FB_HEIGHT; y++) {
+        uint32_t line = (uint32_t)y + FIRST_RASTER_LINE;
+        uint8_t *row = fb[y];
+        uint8_t border, background;
+        int cy = y - VIDEO_FB_TOP;
+
+        // replay register writes up to the start of this raster line
+        while (next < f->nwrites &&
+               (f->log[next].cycle - f->start_cycle) / f->cycles_per_line <= line) {
+            vic[f->log[next].reg] = f->log[next].value;
+            next++;
+        }
+        border     = vic[0x20] & 0x0F;
+        background = vic[0x21] & 0x0F;
+
+        if (cy < 0 || cy >= 200 || !(vic[0x11] & 0x10)) {
+            memset(row, border, VIDEO_FB_WIDTH);
+            continue;
+        }
+
+        memset(row, border, VIDEO_FB_LEFT);
+        memset(row + VIDEO_FB_LEFT + 320, border, VIDEO_FB_WIDTH - VIDEO_FB_LEFT - 320);
+        for (x = 0; x < VIDEO_COLS; x++) {
+            uint16_t cell = (uint16_t)(cy >> 3) * VIDEO_COLS + x;
+            uint8_t bits = glyphs[(uint16_t)f->screen[cell] * 8 + (cy & 7)];
+            uint8_t fg = f->color[cell];
+            uint8_t *px = row + VIDEO_FB_LEFT + x * 8;
+            int b;
+
+            for (b = 0; b < 8; b++)
+                px[b] = (bits & (0x80 >> b)) ? fg : background;
+        }
+    }
+}
+
+static void encode(void)
+{
+    int i;
+
+    if (!encoder_out)
+        return;
+    for (i = 0; i < VIDEO_FB_WIDTH * VIDEO_FB_HEIGHT; i++)
+        memcpy(&rgb[i * 3], palette[((uint8_t *)fb)[i]], 3);
+    fprintf(encoder_out, "P6\n%d %d\n255\n", VIDEO_FB_WIDTH, VIDEO_FB_HEIGHT);
+    fwrite(rgb, 1, sizeof(rgb), encoder_out);
+}
+
+static void *render_worker(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        unsigned tail;
+
+        sem_wait(&ring_ready);
+        tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+        if (tail == atomic_load_explicit(&ring_head, memory_order_acquire)) {
+            if (atomic_load(&worker_stop))
+                break;
+            continue;
+        }
+        render(&ring[tail % ring_depth]);
+        atomic_store_explicit(&ring_tail, tail + 1, memory_order_release);
+        encode();
+    }
+    if (encoder_out)
+        fflush(encoder_out);
+    return NULL;
+}
+
+int video_init(unsigned depth, uint16_t cycles_per_line)
+{
+    if (depth < 1 || depth > VIDEO_RING_MAX)
+        return -1;
+    ring = calloc(depth, sizeof(*ring));
+    if (!ring)
+        return -1;
+    ring_depth = depth;
+    frame_cycles_per_line = cycles_per_line;
+    atomic_init(&ring_head, 0);
+    atomic_init(&ring_tail, 0);
+    atomic_init(&worker_stop, 0);
+    sem_init(&ring_ready, 0, 0);
+    if (pthread_create(&worker, NULL, render_worker, NULL) != 0) {
+        free(ring);
+        ring = NULL;
+        return -1;
+    }
+    worker_running = 1;
+    next_slot();
+    return 0;
+}
+
+void video_shutdown(void)
+{
+    if (!worker_running)
+        return;
+    atomic_store(&worker_stop, 1);
+    sem_post(&ring_ready);
+    pthread_join(worker, NULL);
+    sem_destroy(&ring_ready);
+    worker_running = 0;
+    free(ring);
+    ring = NULL;
+    cur = NULL;
+}
+
+// Must be called before video_init(), the worker owns the encoder after that
+void video_set_output(FILE *out)
+{
+    encoder_out = out;
+}
+
+void video_log_write(uint16_t address, uint8_t value)
+{
+    uint8_t reg = (uint8_t)(address - 0xD000);
+
+    vic_shadow[reg] = value;
+    if (cur && cur->nwrites < VIDEO_LOG_MAX) {
+        cur->log[cur->nwrites].cycle = clockticks6502;
+        cur->log[cur->nwrites].reg   = reg;
+        cur->log[cur->nwrites].value = value;
+        cur->nwrites++;
+    }
+}
+
+// The machine was put back to the start of the frame in progress (run-ahead):
+// its log starts over from the VIC state as it is now
+void video_restart_frame(void)
+{
+    frame_start_cycle = clockticks6502;
+    if (cur) {
+        memcpy(cur->vic, vic_shadow, sizeof(vic_shadow));
+        cur->nwrites = 0;
+    }
+}
+
+void video_end_frame(void)
+{
+    if (!cur)
+        return;
+    if (held) {
+        video_restart_frame();
+        return;
+    }
+
+    capture(cur);
+    platform_show_text(cur->screen, cur->color,
+                       vic_shadow[0x20] & 0x0F, vic_shadow[0x21] & 0x0F);
+    if (cur != &scratch) {
+        atomic_store_explicit(&ring_head,
+            atomic_load_explicit(&ring_head, memory_order_relaxed) + 1,
+            memory_order_release);
+        sem_post(&ring_ready);
+    } else {
+        video_frames_dropped++;
+    }
+
+    video_frames++;
+    frame_start_cycle = clockticks6502;
+    next_slot();
+}
+
+#else
+
+int video_init(unsigned depth, uint16_t cycles_per_line)
+{
+    (void)depth;
+    frame_cycles_per_line = cycles_per_line;
+    return 0;
+}
+
+void video_shutdown(void)
+{
+}
+
+void video_set_output(FILE *out)
+{
+    (void)out;
+}
+
+void video_log_write(uint16_t address, uint8_t value)
+{
+    vic_shadow[(uint8_t)(address - 0xD000)] = value;
+}
+
+void video_restart_frame(void)
+{
+    frame_start_cycle = clockticks6502;
+}
+
+void video_end_frame(void)
+{
+    if (held) {
+        video_restart_frame();
+        return;
+    }
+
+    // screen and colour RAM go straight from the guest bank to the host
+    // screen once a frame, no per-write POKEs
+    uint16_t cbase;
+
+    platform_show_text(ram + screen_base(&cbase), ram + 0xD800,
+                       vic_shadow[0x20] & 0x0F, vic_shadow[0x21] & 0x0F);
+
+    video_frames++;
+    frame_start_cycle = clockticks6502;
+}
+
+#endif
+
+// Run-ahead shows only the frames it ran ahead to
+void video_hold(int on)
+{
+    held = (uint8_t)on;
+}
+
+uint8_t video_reg(uint16_t address)
+{
+    return vic_shadow[(uint8_t)(address - 0xD000)];
+}
+
+// VIC register state for machine snapshots
+void video_get_regs(uint8_t *regs)
+{
+    memcpy(regs, vic_shadow, sizeof(vic_shadow));
+}
+
+void video_set_regs(const uint8_t *regs)
+{
+    memcpy(vic_shadow, regs, sizeof(vic_shadow));
+}
@@ -0,0 +1,59 @@
+#ifndef __VIDEO_H
+#define __VIDEO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define VIDEO_COLS              40
+#define VIDEO_ROWS              25
+#define VIDEO_SCREEN_SIZE       (VIDEO_COLS * VIDEO_ROWS)
+#define VIDEO_VIC_REGS          0x2F    // $D000-$D02E
+#define VIDEO_LOG_MAX           256     // VIC writes kept per frame, extras are dropped
+
+#ifndef VIDEO_RING_DEPTH
+#define VIDEO_RING_DEPTH        4       // frames in flight between emulation and render
+#endif
+#define VIDEO_RING_MAX          64
+
+// Host framebuffer: 320x200 display window plus PAL-ish borders
+#define VIDEO_FB_WIDTH          384
+#define VIDEO_FB_HEIGHT         272
+#define VIDEO_FB_LEFT           32
+#define VIDEO_FB_TOP            36
+
+struct vic_write {
+    uint32_t cycle;             // clockticks6502 at the time of the write
+    uint8_t  reg;               // offset from $D000
+    uint8_t  value;
+};
+
+// Everything the renderer needs to draw one frame, captured at end of frame
+struct frame_inputs {
+    uint32_t frame;             // frame number
+    uint32_t start_cycle;       // clockticks6502 at raster line 0
+    uint16_t cycles_per_line;
+    uint16_t screen_base;       // guest address of the text screen
+    uint8_t  rom_charset;       // 1 = chargen ROM, 0 = charset[] below
+    uint8_t  screen[VIDEO_SCREEN_SIZE];
+    uint8_t  color[VIDEO_SCREEN_SIZE];
+    uint8_t  vic[VIDEO_VIC_REGS];   // register state at the start of the frame
+    uint8_t  charset[2048];     // only filled for RAM charsets
+    uint16_t nwrites;
+    struct vic_write log[VIDEO_LOG_MAX];
+};
+
+extern uint32_t video_frames;
+extern uint32_t video_frames_dropped;
+
+int  video_init(unsigned depth, uint16_t cycles_per_line);
+void video_shutdown(void);
+void video_set_output(FILE *out);
+void video_log_write(uint16_t address, uint8_t value);
+uint8_t video_reg(uint16_t address);
+void video_get_regs(uint8_t *regs);
+void video_set_regs(const uint8_t *regs);
+void video_end_frame(void);
+void video_hold(int on);
+void video_restart_frame(void);
+
+#endif
@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "emu.h"
+#include "disasm.h"
+#include "symbols.h"
+#include "runahead.h"
+#include "watch.h"
+
+// A watch covers an address range for some kinds of access, with an
+// optional condition: up to WATCH_TERMS comparisons joined by &&, each
+// "lhs op number" where lhs is a, x, y, sp, p, pc, value (the byte read or
+// written), hits (this watch's count, this access included) or [addr]
+// (the byte there, peeked without side effects).
+//
+// A hit during an instruction is held until the instruction is done, so
+// the handler always sees the machine between instructions.  Without a
+// handler hits are printed and the machine runs on.
+//
+// Scripts (-watch file) are the same thing from a file, one command per
+// line, run up to each "continue" and picked up again at the next hit:
+//
+//   break $E5CD if a == $0D      watch w $0400-$07E7      watch rw $D020
+//   delete [id]                  continue                 quit [status]
+//   regs    mem addr [len]    dis [addr] [count]    set reg value    poke addr value
+//
+// When the script runs out the watches stay and just report.
+
+enum { L_A, L_X, L_Y, L_SP, L_P, L_PC, L_VALUE, L_HITS, L_MEM };
+enum { OP_EQ, OP_NE, OP_LE, OP_GE, OP_LT, OP_GT };
+
+struct term {
+    uint8_t  lhs, op;
+    uint16_t address;                   // L_MEM
+    uint32_t rhs;
+};
+
+struct watch {
+    uint8_t  used, kind, nterms;
+    uint16_t start, end;
+    uint32_t hits;
+    struct term term[WATCH_TERMS];
+};
+
+extern EMU_TLS uint16_t oldpc;
+uint8_t read6502(uint16_t address);
+
+uint8_t watch_page[256];
+uint8_t watch_armed = 0;
+uint8_t watch_busy = 0;
+
+static struct watch watches[WATCH_MAX];
+static watch_handler handler;
+static struct watch_hit pending;
+static uint8_t have_pending;
+static uint64_t resumed_at = ~0ull;     // instruction a breakpoint stopped before
+static FILE *script;
+
+static const char *const lhs_names[] = { "a", "x", "y", "sp", "p", "pc", "value", "hits" };
+static const char *const op_names[]  = { "==", "!=", "<=", ">=", "<", ">" };
+
+static const char *skip(const char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    return s;
+}
+
+// $hex, 0xhex or decimal
+static int number(const char **s, uint32_t *out)
+{
+    const char *p = skip(*s);
+    unsigned long n;
+    char *end;
+
+    if (*p == '$')
+        n = strtoul(p + 1, &end, 16);
+    else
+        n = strtoul(p, &end, 0);
+    if (end == p || (end == p + 1 && *p == '$'))
+        return -1;
+    *out = (uint32_t)n;
+    *s = end;
+    return 0;
+}
+
+static int parse_cond(struct watch *w, const char *s)
+{
+    unsigned i;
+    uint32_t n;
+
+    w->nterms = 0;
+    for (;;) {
+        struct term *t;
+
+        s = skip(s);
+        if (!*s)
+            return w->nterms ? 0 : -1;
+        if (w->nterms == WATCH_TERMS)
+            return -1;
+        t = &w->term[w->nterms++];
+
+        if (*s == '[') {
+            s++;
+            if (number(&s, &n) != 0 || n > 0xFFFF || *(s = skip(s)) != ']')
+                return -1;
+            s++;
+            t->lhs = L_MEM;
+            t->address = (uint16_t)n;
+        } else {
+            for (i = 0; i < sizeof(lhs_names) / sizeof(lhs_names[0]); i++) {
+                size_t len = strlen(lhs_names[i]);
+                if (!strncmp(s, lhs_names[i], len) && !(s[len] >= 'a' && s[len] <= 'z'))
+                    break;
+            }
+            if (i == sizeof(lhs_names) / sizeof(lhs_names[0]))
+                return -1;
+            s += strlen(lhs_names[i]);
+            t->lhs = (uint8_t)i;
+        }
+
+        s = skip(s);
+        for (i = 0; i < sizeof(op_names) / sizeof(op_names[0]); i++) {
+            if (!strncmp(s, op_names[i], strlen(op_names[i])))
+                break;
+        }
+        if (i == sizeof(op_names) / sizeof(op_names[0]))
+            return -1;
+        s += strlen(op_names[i]);
+        t->op = (uint8_t)i;
+        if (number(&s, &t->rhs) != 0)
+            return -1;
+
+        s = skip(s);
+        if (!strncmp(s, "&&", 2))
+            s += 2;
+        else if (*s)
+            return -1;
+    }
+}
+
+static int holds(const struct watch *w, uint8_t value)
+{
+    unsigned i;
+    uint32_t v = 0;
+
+    for (i = 0; i < w->nterms; i++) {
+        const struct term *t = &w->term[i];
+
+        switch (t->lhs) {
+            case L_A:     v = a;                        break;
+            case L_X:     v = x;                        break;
+            case L_Y:     v = y;                        break;
+            case L_SP:    v = sp;                       break;
+            case L_P:     v = status;                   break;
+            case L_PC:    v = pc;                       break;
+            case L_VALUE: v = value;                    break;
+            case L_HITS:  v = w->hits;                  break;
+            case L_MEM:   v = emu_peek(t->address);     break;
+        }
+        switch (t->op) {
+            case OP_EQ: if (!(v == t->rhs)) return 0;   break;
+            case OP_NE: if (!(v != t->rhs)) return 0;   break;
+            case OP_LE: if (!(v <= t->rhs)) return 0;   break;
+            case OP_GE: if (!(v >= t->rhs)) return 0;   break;
+            case OP_LT: if (!(v <  t->rhs)) return 0;   break;
+            case OP_GT: if (!(v >  t->rhs)) return 0;   break;
+        }
+    }
+    return 1;
+}
+
+static void rebuild(void)
+{
+    unsigned i, p;
+
+    memset(watch_page, 0, sizeof(watch_page));
+    watch_armed = 0;
+    for (i = 0; i < WATCH_MAX; i++) {
+        const struct watch *w = &watches[i];
+        if (!w->used)
+            continue;
+        for (p = w->start >> 8; p <= (unsigned)(w->end >> 8); p++)
+            watch_page[p] |= w->kind;
+        watch_armed = 1;
+    }
+    if (script)
+        watch_armed = 1;
+}
+
+// Returns the watch id, -1 if cond does not parse or all are in use
+int watch_add(uint8_t kind, uint16_t start, uint16_t end, const char *cond)
+{
+    struct watch *w;
+    int id;
+
+    for (id = 0; id < WATCH_MAX && watches[id].used; id++)
+        ;
+    if (id == WATCH_MAX || end < start)
+        return -1;
+    w = &watches[id];
+    memset(w, 0, sizeof(*w));
+    if (cond && parse_cond(w, cond) != 0)
+        return -1;
+    w->kind  = kind;
+    w->start = start;
+    w->end   = end;
+    w->used  = 1;
+    rebuild();
+    return id;
+}
+
+// id -1 deletes them all
+int watch_delete(int id)
+{
+    if (id < 0) {
+        memset(watches, 0, sizeof(watches));
+    } else {
+        if (id >= WATCH_MAX || !watches[id].used)
+            return -1;
+        watches[id].used = 0;
+    }
+    rebuild();
+    return 0;
+}
+
+void watch_set_handler(watch_handler fn)
+{
+    handler = fn;
+}
+
+static void check(uint8_t kind, uint16_t address, uint8_t value)
+{
+    int id;
+
+    if (runahead_active)
+        return;                         // speculative frames are thrown away
+    for (id = 0; id < WATCH_MAX; id++) {
+        struct watch *w = &watches[id];
+
+        if (!w->used || !(w->kind & kind) || address < w->start || address > w->end)
+            continue;
+        w->hits++;
+        if (have_pending || !holds(w, value))
+            continue;
+        pending.id      = id;
+        pending.kind    = kind;
+        pending.address = address;
+        pending.value   = value;
+        pending.pc      = kind == WATCH_EXEC ? pc : oldpc;
+        have_pending    = 1;
+    }
+}
+
+// read6502 on a page with a read watch: the real read, then the check
+uint8_t watch_read(uint16_t address)
+{
+    uint8_t value;
+
+    watch_busy = 1;
+    value = read6502(address);
+    watch_busy = 0;
+    check(WATCH_READ, address, value);
+    return value;
+}
+
+// write6502 on a page with a write watch, before the store
+void watch_write(uint16_t address, uint8_t value)
+{
+    check(WATCH_WRITE, address, value);
+}
+
+// ── script ─────────────────────────────────────────
+
+static void show_regs(void)
+{
+    char name[SYMBOL_NAME_MAX + 8];
+
+    symbols_format(name, pc);
+    platform_msg("PC=%04X A=%02X X=%02X Y=%02X SP=%02X P=%02X  cycle %lu  %s\n", pc, a, x, y, sp,
+                 status, (unsigned long)clockticks6502, name);
+}
+
+static void show_mem(uint16_t address, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (i % 16 == 0)
+            platform_msg(i ? "\n%04X " : "%04X ", (uint16_t)(address + i));
+        platform_msg(" %02X", emu_peek((uint16_t)(address + i)));
+    }
+    platform_msg("\n");
+}
+
+static void show_dis(uint16_t address, uint32_t count)
+{
+    uint8_t bytes[3];
+    char text[DISASM_MAX];
+
+    while (count--) {
+        bytes[0] = emu_peek(address);
+        bytes[1] = emu_peek((uint16_t)(address + 1));
+        bytes[2] = emu_peek((uint16_t)(address + 2));
+        disasm(text, address, bytes);
+        platform_msg("%04X  %s\n", address, text);
+        address = (uint16_t)(address + disasm_length(bytes[0]));
+    }
+}
+
+static void show_hit(const struct watch_hit *hit)
+{
+    char name[SYMBOL_NAME_MAX + 8];
+
+    symbols_format(name, hit->pc);
+    if (hit->kind == WATCH_EXEC)
+        platform_msg("watch %d: break at $%04X (%s)\n", hit->id, hit->pc, name);
+    else
+        platform_msg("watch %d: %s $%04X = $%02X by $%04X (%s)\n", hit->id,
+                     hit->kind == WATCH_READ ? "read" : "write", hit->address, hit->value, hit->pc, name);
+}
+
+// "$0400" or "$0400-$07E7"
+static int range(const char **s, uint16_t *start, uint16_t *end)
+{
+    uint32_t lo, hi;
+
+    if (number(s, &lo) != 0 || lo > 0xFFFF)
+        return -1;
+    hi = lo;
+    if (**s == '-') {
+        (*s)++;
+        if (number(s, &hi) != 0 || hi > 0xFFFF)
+            return -1;
+    }
+    *start = (uint16_t)lo;
+    *end   = (uint16_t)hi;
+    return 0;
+}
+
+static int command_add(uint8_t kind, const char *s)
+{
+    uint16_t start, end;
+    const char *cond = NULL;
+    int id;
+
+    if (range(&s, &start, &end) != 0)
+        return -1;
+    s = skip(s);
+    if (!strncmp(s, "if ", 3))
+        cond = s + 3;
+    id = watch_add(kind, start, end, cond);
+    if (id >= 0)
+        platform_msg("watch %d: $%04X-$%04X%s%s\n", id, start, end, cond ? " if " : "", cond ? cond : "");
+    return id < 0 ? -1 : 0;
+}
+
+static int command_set(const char *s)
+{
+    static const char *const regs[] = { "a", "x", "y", "sp", "p", "pc" };
+    unsigned i;
+    uint32_t v;
+
+    for (i = 0; i < 6; i++) {
+        size_t len = strlen(regs[i]);
+        if (!strncmp(s, regs[i], len) && (s[len] == ' ' || s[len] == '\t'))
+            break;
+    }
+    if (i == 6)
+        return -1;
+    s += strlen(regs[i]);
+    if (number(&s, &v) != 0)
+        return -1;
+    switch (i) {
+        case 0: a = (uint8_t)v;         break;
+        case 1: x = (uint8_t)v;         break;
+        case 2: y = (uint8_t)v;         break;
+        case 3: sp = (uint8_t)v;        break;
+        case 4: status = (uint8_t)v;    break;
+        case 5: pc = (uint16_t)v;       break;
+    }
+    return 0;
+}
+
+// Until "continue" or the end of the script
+static void run_script(void)
+{
+    char line[256];
+    const char *s;
+    uint32_t n, v;
+    int err;
+
+    while (fgets(line, sizeof(line), script)) {
+        line[strcspn(line, "\r\n")] = 0;
+        s = skip(line);
+        err = 0;
+        if (!*s || *s == '#')
+            continue;
+        if (!strncmp(s, "continue", 8)) {
+            return;
+        } else if (!strncmp(s, "break ", 6)) {
+            err = command_add(WATCH_EXEC, s + 6);
+        } else if (!strncmp(s, "watch ", 6)) {
+            uint8_t kind = 0;
+            s = skip(s + 6);
+            for (; *s == 'r' || *s == 'w'; s++)
+                kind |= *s == 'r' ? WATCH_READ : WATCH_WRITE;
+            err = kind ? command_add(kind, s) : -1;
+        } else if (!strncmp(s, "delete", 6)) {
+            s += 6;
+            err = watch_delete(number(&s, &n) == 0 ? (int)n : -1);
+        } else if (!strncmp(s, "regs", 4)) {
+            show_regs();
+        } else if (!strncmp(s, "mem ", 4)) {
+            s += 4;
+            if (number(&s, &n) != 0)
+                err = -1;
+            else
+                show_mem((uint16_t)n, number(&s, &v) == 0 ? v : 16);
+        } else if (!strncmp(s, "dis", 3)) {
+            s += 3;
+            n = pc;
+            v = 8;
+            if (number(&s, &n) == 0)
+                number(&s, &v);
+            show_dis((uint16_t)n, v);
+        } else if (!strncmp(s, "set ", 4)) {
+            err = command_set(skip(s + 4));
+        } else if (!strncmp(s, "poke ", 5)) {
+            uint8_t byte;
+            s += 5;
+            if (number(&s, &n) != 0 || number(&s, &v) != 0) {
+                err = -1;
+            } else {
+                byte = (uint8_t)v;
+                emu_ram_write((uint16_t)n, &byte, 1);
+            }
+        } else if (!strncmp(s, "quit", 4)) {
+            s += 4;
+            exit(number(&s, &n) == 0 ? (int)n : 0);
+        } else {
+            err = -1;
+        }
+        if (err)
+            platform_msg("watch: cannot do %s\n", line);
+    }
+    fclose(script);
+    script = NULL;
+    rebuild();
+}
+
+static void script_handler(const struct watch_hit *hit)
+{
+    show_hit(hit);
+    if (script)
+        run_script();
+}
+
+// Runs the script up to its first "continue"
+int watch_script(const char *path)
+{
+    script = fopen(path, "r");
+    if (!script) {
+        platform_msg("watch: cannot open %s\n", path);
+        return -1;
+    }
+    handler = script_handler;
+    rebuild();
+    run_script();
+    return 0;
+}
+
+// ── between instructions ───────────────────────────
+
+static void stop(void)
+{
+    struct watch_hit hit = pending;
+
+    have_pending = 0;
+    if (handler)
+        handler(&hit);
+    else
+        show_hit(&hit);
+}
+
+// Before each instruction while watch_armed
+void watch_step(void)
+{
+    if (have_pending)
+        stop();                         // from the last instruction's accesses
+    if ((watch_page[pc >> 8] & WATCH_EXEC) && instructions != resumed_at) {
+        check(WATCH_EXEC, pc, emu_peek(pc));
+        if (have_pending) {
+            resumed_at = instructions;  // stopping again here would never resume
+            stop();
+        }
+    }
+}
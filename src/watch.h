@@ -0,0 +1,45 @@
+#ifndef __WATCH_H
+#define __WATCH_H
+
+#include <stdint.h>
+
+// Breakpoints and watchpoints.  watch_page[] has a bit per kind for every
+// page some watch covers; read6502/write6502 look at it and only accesses
+// to those pages go through watch.c.  Execution breakpoints are checked
+// between instructions while watch_armed is set.  With nothing watched
+// the cost is a table lookup per access and a flag test per instruction.
+
+#define WATCH_EXEC              0x01
+#define WATCH_READ              0x02    // opcode and operand fetches included
+#define WATCH_WRITE             0x04
+
+#define WATCH_MAX               32
+#define WATCH_TERMS             4       // "a == $0D && [$C6] != 0"
+
+struct watch_hit {
+    int      id;
+    uint8_t  kind;
+    uint16_t address;
+    uint8_t  value;                     // read or written, opcode for WATCH_EXEC
+    uint16_t pc;                        // instruction that did it
+};
+
+// Called once the instruction that hit has finished (before it, for a
+// breakpoint).  The machine is stopped until it returns; it may inspect
+// and change anything, add and delete watches, or exit.
+typedef void (*watch_handler)(const struct watch_hit *hit);
+
+extern uint8_t watch_page[256];
+extern uint8_t watch_armed;
+extern uint8_t watch_busy;
+
+int  watch_add(uint8_t kind, uint16_t start, uint16_t end, const char *cond);
+int  watch_delete(int id);
+void watch_set_handler(watch_handler fn);
+int  watch_script(const char *path);
+
+uint8_t watch_read(uint16_t address);
+void watch_write(uint16_t address, uint8_t value);
+void watch_step(void);
+
+#endif